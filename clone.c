@@ -77,7 +77,7 @@ SYS_FUNC(clone)
 {
 #ifdef ENABLE_DATASERIES
 	if (ds_module)
-		ds_set_clone_ctid_index(ds_module, ARG_CTID);
+		ds_stage_clone_ctid_index(ARG_CTID);
 #endif /* ENABLE_DATASERIES */
 	const kernel_ulong_t flags = tcp->u_arg[ARG_FLAGS] & ~CSIGNAL;
 
@@ -372,9 +372,12 @@ struct tcb {
 	/* DataSeries-specific Real Time timespec structs */
 	int64_t entry_real_ns;  /* Syscall entry time (CLOCK_REALTIME in nanoseconds) */
 	int64_t exit_real_ns;  /* Syscall exit time (CLOCK_REALTIME in nanoseconds) */
+	struct ds_arena_chunk *ds_arena; /* Captured syscall arguments */
+	uint64_t ds_stack_id;	/* Stack of the current syscall, 0 if unknown */
 #endif /* ENABLE_DATASERIES */
 
 	struct mmap_cache_t *mmap_cache;
+	struct fdtable *fdtable;
 
 	/*
 	 * Data that is stored during process wait traversal.
@@ -385,6 +388,11 @@ struct tcb {
 	/** Wait data storage for a delayed process. */
 	struct tcb_wait_data *delayed_wait_data;
 	struct list_item wait_list;
+	/* In the list of tcbs with buffered output, see --output-buffer */
+	struct list_item output_list;
+	struct tcb *next_free;	/* Next free tcb, if this one is free */
+	uint64_t dispatch_seq;	/* When its last event was dispatched */
+	struct stop_latency *stop_latency;
 
 
 # ifdef HAVE_LINUX_KVM_H
@@ -432,6 +440,9 @@ struct tcb {
 # define TCB_SECCOMP_FILTER	0x8000	/* This process has a seccomp filter
 					 * attached.
 					 */
+# define TCB_FDTABLE_CLOSING	0x10000	/* The current syscall may close
+					 * descriptors of the fdtable.
+					 */
 
 /* qualifier flags */
 # define QUAL_TRACE	0x001	/* this system call should be traced */
@@ -611,6 +622,50 @@ extern void syscall_exiting_finish(struct tcb *);
 extern void count_syscall(struct tcb *, const struct timespec *);
 extern void call_summary(FILE *);
 
+/* stop_latency.c */
+extern bool stop_latency_enabled;
+extern void stop_latency_stopped(struct tcb *);
+extern void stop_latency_restarted(struct tcb *);
+extern void stop_latency_drop(struct tcb *);
+extern void stop_latency_summary(FILE *);
+
+/* profile_tracer.c */
+enum profile_phase {
+	PROFILE_OTHER,
+	PROFILE_WAIT,
+	PROFILE_REGS,
+	PROFILE_DECODE,
+	PROFILE_UMOVE,
+	PROFILE_OUTPUT,
+	PROFILE_DATASERIES,
+	PROFILE_RESTART,
+
+	PROFILE_PHASES
+};
+
+extern bool profile_tracer;
+extern enum profile_phase profile_switch(enum profile_phase);
+extern void profile_syscall_stop(struct tcb *);
+extern void profile_stop_done(void);
+extern void profile_summary(FILE *);
+
+/*
+ * Starts timing the given phase of --profile-tracer, returns the phase
+ * to pass to profile_leave() when it is over.
+ */
+static inline enum profile_phase
+profile_enter(const enum profile_phase phase)
+{
+	return profile_tracer ? profile_switch(phase) : PROFILE_OTHER;
+}
+
+static inline void
+profile_leave(const enum profile_phase prev)
+{
+	if (profile_tracer)
+		profile_switch(prev);
+}
+
 extern void clear_regs(struct tcb *tcp);
 extern int get_scno(struct tcb *);
 extern kernel_ulong_t get_rt_sigframe_addr(struct tcb *);
@@ -678,6 +733,15 @@ umoven(struct tcb *, kernel_ulong_t addr, unsigned int len, void *laddr);
 # define umove(pid, addr, objp)	\
 	umoven((pid), (addr), sizeof(*(objp)), (void *) (objp))
 
+struct iovec;
+/**
+ * @return the number of buffers copied, fetched[i] is set
+ *         for each of them.
+ */
+extern size_t
+umove_iovec(struct tcb *, const struct iovec *rvec, const struct iovec *lvec,
+	    size_t cnt, bool *fetched);
+
 /**
  * @return true on success, false on error.
  */
@@ -753,6 +817,7 @@ umovestr(struct tcb *, kernel_ulong_t addr, unsigned int len, char *laddr);
 
 /* Invalidate the cache used by umove* functions.  */
 extern void invalidate_umove_cache(void);
+extern void print_umove_cache_stats(void);
 
 extern int upeek(struct tcb *tcp, unsigned long, kernel_ulong_t *);
 extern int upoke(struct tcb *tcp, unsigned long, kernel_ulong_t);
@@ -778,10 +843,30 @@ pathtrace_match(struct tcb *tcp)
 	return pathtrace_match_set(tcp, &global_path_set);
 }
 
+extern int get_tgid(int pid);
 extern int getfdpath(struct tcb *, int, char *, unsigned);
 extern unsigned long getfdinode(struct tcb *, int);
 extern enum sock_proto getfdproto(struct tcb *, int);
 
+/* fdtable.c */
+extern void fdtable_enable(void);
+extern void fdtable_release(struct tcb *);
+extern const char *fdtable_lookup_path(struct tcb *, int fd);
+extern void fdtable_store_path(struct tcb *, int fd, const char *path);
+extern const char *fdtable_lookup_ds_path(struct tcb *, int fd);
+extern void fdtable_store_ds_path(struct tcb *, int fd, const char *path);
+extern enum sock_proto fdtable_lookup_proto(struct tcb *, int fd);
+extern void fdtable_store_proto(struct tcb *, int fd, enum sock_proto);
+extern bool fdtable_lookup_type(struct tcb *, int fd,
+				unsigned int *type, dev_t *rdev);
+extern void fdtable_store_type(struct tcb *, int fd,
+			       unsigned int type, dev_t rdev);
+extern void fdtable_forget(struct tcb *, int fd);
+extern void fdtable_syscall_entering(struct tcb *);
+extern void fdtable_syscall_exiting(struct tcb *);
+extern unsigned int fdtable_new_fds(struct tcb *, int fds[2]);
+extern void print_fdtable_stats(void);
+
 extern const char *xlookup(const struct xlat *, const uint64_t);
 extern const char *xlookup_le(const struct xlat *, uint64_t *);
 
@@ -1200,6 +1285,8 @@ extern int parse_ts(const char *s, struct timespec *t);
 
 # ifdef ENABLE_STACKTRACE
 extern void unwind_init(void);
+extern void unwind_fin(void);
+extern void unwind_set_cache_file(const char *);
 extern void unwind_tcb_init(struct tcb *);
 extern void unwind_tcb_fin(struct tcb *);
 extern void unwind_tcb_print(struct tcb *);
@@ -1358,17 +1445,28 @@ extern void print_user_desc(struct tcb *, kernel_ulong_t addr,
 extern struct tcb *printing_tcp;
 extern void printleader(struct tcb *);
 extern void line_ended(void);
+/* Flushes the output of tcp, or defers it with --output-buffer. */
+extern void flush_tcp_output(struct tcb *);
 extern void tabto(void);
 extern void tprintf(const char *fmt, ...) ATTRIBUTE_FORMAT((printf, 1, 2));
 extern void tprints(const char *str);
 extern void tprintf_comment(const char *fmt, ...) ATTRIBUTE_FORMAT((printf, 1, 2));
 extern void tprints_comment(const char *str);
 
+/*
+ * Opens a file as the user strace was run by, close-on-exec.
+ * Dies if it cannot be opened.
+ */
+extern FILE *strace_fopen(const char *path, const char *mode);
+
 /*
  * Staging output for status qualifier.
  */
 extern FILE *strace_open_memstream(struct tcb *tcp);
 extern void strace_close_memstream(struct tcb *tcp, bool publish);
+extern void strace_free_memstream(struct tcb *tcp);
+extern bool strace_output_staged(const struct tcb *tcp);
+extern FILE *strace_unstaged_outf(const struct tcb *tcp);
 
 static inline void
 printaddr_comment(const kernel_ulong_t addr)
@@ -1625,15 +1723,19 @@ scno_is_valid(kernel_ulong_t scno)
 #ifdef ENABLE_DATASERIES
 # define DS_SET_IOCTL_SIZE(x)	do { \
   if (ds_module)				\
-    ds_set_ioctl_size(ds_module, sizeof(x)); } while (0)
+    ds_stage_ioctl_size(sizeof(x)); } while (0)
 # define DS_SET_IOCTL_SIZEN(x,n)	do {		\
   if (ds_module)				\
-    ds_set_ioctl_size(ds_module, (n) * sizeof(x)); } while (0)
+    ds_stage_ioctl_size((n) * sizeof(x)); } while (0)
 
 # define DS_MAX_ARGS 3 /* Maximum number of v_args defined for dataseries */
 extern char *ds_get_path(struct tcb *tcp, long addr);
 extern char *ds_get_name(struct tcb *tcp, long addr);
 extern void *ds_get_buffer(struct tcb *tcp, long addr, long len);
+extern void *ds_get_payload(struct tcb *tcp, long addr, long len,
+			    unsigned int index, void **common_fields);
+extern void *ds_get_bounded_buffer(struct tcb *tcp, long addr, long len,
+				   unsigned int index, void **common_fields);
 extern struct stat *ds_get_stat_buffer(struct tcb *tcp, const long addr);
 extern struct iovec *ds_get_iov_args(struct tcb *tcp, const long addr);
 extern void ds_write_iov_records(struct tcb *tcp,
@@ -1653,5 +1755,157 @@ extern void ds_write_execve_records(struct tcb *tcp,
 				    void **common_fields,
 				    void **v_args);
 extern struct flock *ds_get_flock(struct tcb *tcp, const long addr);
+
+/* syscall.c */
+extern int64_t timespec_to_ns(struct timespec *t);
+
+/* ds_arena.c */
+extern void *ds_arena_alloc(struct tcb *tcp, size_t size);
+extern void ds_arena_trim(struct tcb *tcp, void *ptr, size_t size);
+extern void ds_arena_reset(struct tcb *tcp);
+extern void ds_arena_free(struct tcb *tcp);
+extern void ds_arena_print_stats(void);
+
+/* filter_qualify.c */
+enum ds_capture_mode {
+	DS_CAPTURE_FULL,	/* the whole buffer */
+	DS_CAPTURE_TRUNCATE,	/* at most limit bytes, in the payload store */
+	DS_CAPTURE_HASH,	/* a digest only, in the payload store */
+	DS_CAPTURE_NONE,	/* nothing but the size */
+};
+struct ds_capture_policy {
+	enum ds_capture_mode mode;
+	unsigned int limit;
+};
+extern bool ds_capture_needs_store;
+extern void qualify_ds_capture(const char *);
+extern const struct ds_capture_policy *ds_capture_policy(const struct tcb *);
+
+/* ds_capture.c */
+/*
+ * Writes the record of a syscall described by ds_capture.in.
+ * Returns false if the syscall is left to the caller.
+ */
+extern bool ds_capture_exiting(struct tcb *tcp, void **common_fields,
+			       void **v_args);
+/*
+ * Returns false for syscalls DataSeries output deliberately does not
+ * record, which need not be stopped at with --seccomp-bpf.
+ */
+extern bool ds_capture_traced(const struct_sysent *);
+
+/* ds_clock.c */
+extern bool ds_clock_calibrated;
+extern void ds_set_clock_mode(const char *arg);
+extern void ds_clock_init(const char *ds_fname);
+/*
+ * Takes the timestamp of a syscall stop: CLOCK_MONOTONIC in mono and
+ * CLOCK_REALTIME in nanoseconds in real_ns.
+ */
+extern void ds_clock_read(struct timespec *mono, int64_t *real_ns);
+extern void ds_clock_finish(void);
+
+/* ds_dedup.c */
+extern unsigned int ds_dedup_chunk_size;
+extern void ds_set_dedup_chunk_size(const char *arg);
+extern void ds_dedup_init(const char *ds_fname);
+/*
+ * Gives the records of a syscall an explicit unique id if the store is
+ * in use, or if split, that is, if a payload of theirs is streamed.
+ */
+extern void ds_dedup_claim_id(struct tcb *tcp, void **common_fields,
+			      bool split);
+/*
+ * Moves a captured payload of len bytes to the chunk store and returns
+ * NULL, or returns buf unchanged if it is not to be deduplicated.
+ */
+extern void *ds_dedup_payload(struct tcb *tcp, void *buf, size_t len,
+			      unsigned int index, void **common_fields);
+extern void ds_store_prefix(struct tcb *tcp, const void *buf, size_t size,
+			    size_t len, unsigned int index,
+			    void **common_fields);
+extern void ds_store_digest(struct tcb *tcp, const void *buf, size_t len,
+			    unsigned int index, void **common_fields);
+/*
+ * Payloads larger than ds_stream_limit are streamed to the store:
+ * ds_stream_begin(), then ds_stream_piece() for each consecutive piece
+ * of at most ds_stream_piece_size() bytes, then ds_stream_end().
+ */
+extern unsigned int ds_stream_limit;
+extern void ds_set_stream_limit(const char *arg);
+extern size_t ds_stream_piece_size(void);
+extern void ds_stream_begin(struct tcb *tcp, size_t len, bool hash,
+			    unsigned int index, void **common_fields);
+extern void ds_stream_piece(struct tcb *tcp, const void *buf, size_t size);
+extern void ds_stream_end(bool complete);
+extern void ds_dedup_finish(void);
+
+/* ds_fds.c */
+extern bool ds_fds_enabled;
+extern void ds_fds_init(const char *ds_fname);
+/*
+ * Called like ds_stacks_claim_id() and ds_stacks_record(),
+ * ds_fds_record() with the v_args of the record.
+ */
+extern void ds_fds_claim_id(struct tcb *, void **common_fields);
+extern void ds_fds_record(struct tcb *, void **common_fields, void **v_args);
+extern void ds_fds_finish(void);
+
+/* ds_sidecar.c */
+/*
+ * Creates DSFILE.SUFFIX next to the DataSeries file and writes magic
+ * to it.  Dies if it cannot be created.
+ */
+extern FILE *ds_open_sidecar(const char *ds_fname, const char *suffix,
+			     const char *magic);
+extern void ds_put_u32(FILE *, uint32_t);
+extern void ds_put_u64(FILE *, uint64_t);
+
+/* ds_stacks.c */
+# ifdef ENABLE_STACKTRACE
+extern void qualify_ds_stacks(const char *);
+extern void ds_stacks_init(const char *ds_fname);
+extern void ds_stacks_capture(struct tcb *);
+/*
+ * ds_stacks_claim_id() is called before the records of a syscall are
+ * written, ds_stacks_record() after, with the same common_fields.
+ */
+extern void ds_stacks_claim_id(struct tcb *, void **common_fields);
+extern void ds_stacks_record(struct tcb *, void **common_fields);
+extern void ds_stacks_finish(void);
+# else
+static inline void ds_stacks_init(const char *ds_fname) {}
+static inline void ds_stacks_capture(struct tcb *tcp) {}
+static inline void ds_stacks_claim_id(struct tcb *tcp, void **common_fields) {}
+static inline void ds_stacks_record(struct tcb *tcp, void **common_fields) {}
+static inline void ds_stacks_finish(void) {}
+# endif
+
+/* ds_writer.c */
+extern unsigned int ds_async_queue_depth;
+extern void ds_set_async_queue_depth(const char *arg);
+extern void ds_writer_start(void);
+extern void ds_writer_finish(void);
+/*
+ * Registers the size of a buffer that is about to be stored in v_args,
+ * so that the asynchronous writer can copy it.  Returns ptr.
+ */
+extern void *ds_note_arg(void *ptr, size_t len);
+# define DS_SCALAR_ARG(x) ds_note_arg(&(x), sizeof(x))
+extern void ds_forget_args(void);
+extern void ds_submit_record(const char *extent_name, kernel_ulong_t *args,
+			     void **common_fields, void **v_args);
+extern void ds_submit_into_same_record(const char *extent_name,
+				       kernel_ulong_t *args,
+				       void **common_fields, void **v_args);
+extern void ds_submit_untraced(const char *sys_name, kernel_ulong_t scno);
+extern void ds_submit_warning(const char *sys_name, kernel_ulong_t scno);
+extern void ds_stage_ioctl_size(int size);
+extern int ds_staged_ioctl_size(void);
+extern void ds_stage_clone_ctid_index(unsigned int index);
+extern unsigned int ds_staged_clone_ctid_index(void);
+/* Makes the unique ids those of a tracer shard. */
+extern void ds_set_shard(unsigned int shard);
+extern uint64_t ds_next_id(void);
 #endif /* ENABLE_DATASERIES */
 #endif /* !STRACE_DEFS_H */
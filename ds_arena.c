@@ -0,0 +1,163 @@
+/*
+ * Per-tcb bump allocator for DataSeries argument capture.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Every path, name and buffer captured for a DataSeries record lives
+ * only until the end of the syscall, so instead of a malloc/free pair
+ * per captured argument they are carved out of a per-tcb arena that is
+ * reset in syscall_exiting_finish().
+ *
+ * The arena is a list of chunks; allocations never move.  When a reset
+ * finds more than one chunk, they are replaced by a single chunk big
+ * enough for the whole previous syscall, so the steady state is one
+ * chunk and no allocator calls at all.
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include <stdalign.h>
+
+/* Size of the first chunk allocated for a tcb. */
+# define DS_ARENA_CHUNK_SIZE	(64 * 1024)
+/* Chunks larger than this are not kept across syscalls. */
+# define DS_ARENA_KEEP_MAX	(1024 * 1024)
+
+struct ds_arena_chunk {
+	struct ds_arena_chunk *prev;
+	size_t size;
+	size_t used;
+	alignas(max_align_t) char data[];
+};
+
+static struct {
+	uint64_t resets;
+	uint64_t chunk_allocs;
+	size_t peak;
+} ds_arena_stats;
+
+static size_t
+align_up(const size_t size)
+{
+	return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+static struct ds_arena_chunk *
+alloc_chunk(struct ds_arena_chunk *const prev, const size_t size)
+{
+	struct ds_arena_chunk *const chunk = xmalloc(sizeof(*chunk) + size);
+
+	chunk->prev = prev;
+	chunk->size = size;
+	chunk->used = 0;
+	++ds_arena_stats.chunk_allocs;
+
+	return chunk;
+}
+
+void *
+ds_arena_alloc(struct tcb *const tcp, const size_t size)
+{
+	struct ds_arena_chunk *chunk = tcp->ds_arena;
+	const size_t need = align_up(size);
+
+	if (!chunk || chunk->size - chunk->used < need) {
+		size_t chunk_size = chunk ? chunk->size * 2
+					  : DS_ARENA_CHUNK_SIZE;
+		if (chunk_size < need)
+			chunk_size = need;
+		chunk = tcp->ds_arena = alloc_chunk(chunk, chunk_size);
+	}
+
+	void *const p = chunk->data + chunk->used;
+	chunk->used += need;
+
+	return p;
+}
+
+/*
+ * Shrinks the most recent allocation ptr to size bytes,
+ * size 0 gives the whole allocation back.
+ */
+void
+ds_arena_trim(struct tcb *const tcp, void *const ptr, const size_t size)
+{
+	struct ds_arena_chunk *const chunk = tcp->ds_arena;
+
+	if (!chunk || (char *) ptr < chunk->data
+	    || (char *) ptr >= chunk->data + chunk->used)
+		return;
+
+	chunk->used = ((char *) ptr - chunk->data) + align_up(size);
+}
+
+static size_t
+free_chunks(struct ds_arena_chunk *chunk)
+{
+	size_t total = 0;
+
+	while (chunk) {
+		struct ds_arena_chunk *const prev = chunk->prev;
+
+		total += chunk->used;
+		free(chunk);
+		chunk = prev;
+	}
+
+	return total;
+}
+
+void
+ds_arena_reset(struct tcb *const tcp)
+{
+	struct ds_arena_chunk *const chunk = tcp->ds_arena;
+
+	if (!chunk || (!chunk->used && !chunk->prev))
+		return;
+
+	++ds_arena_stats.resets;
+
+	if (!chunk->prev && chunk->size <= DS_ARENA_KEEP_MAX) {
+		if (chunk->used > ds_arena_stats.peak)
+			ds_arena_stats.peak = chunk->used;
+		chunk->used = 0;
+		return;
+	}
+
+	/*
+	 * The previous syscall did not fit into a single chunk,
+	 * replace the chain with one chunk that would have fit.
+	 */
+	const size_t total = free_chunks(chunk);
+	if (total > ds_arena_stats.peak)
+		ds_arena_stats.peak = total;
+	tcp->ds_arena = NULL;
+	if (total <= DS_ARENA_KEEP_MAX)
+		tcp->ds_arena = alloc_chunk(NULL, total > DS_ARENA_CHUNK_SIZE
+						  ? total : DS_ARENA_CHUNK_SIZE);
+}
+
+void
+ds_arena_free(struct tcb *const tcp)
+{
+	free_chunks(tcp->ds_arena);
+	tcp->ds_arena = NULL;
+}
+
+void
+ds_arena_print_stats(void)
+{
+	debug_msg("DataSeries arena: %" PRIu64 " resets, %" PRIu64
+		  " chunk allocations, peak %zu bytes per syscall",
+		  ds_arena_stats.resets, ds_arena_stats.chunk_allocs,
+		  ds_arena_stats.peak);
+}
+
+#endif /* ENABLE_DATASERIES */
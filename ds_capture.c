@@ -0,0 +1,164 @@
+/*
+ * Table-driven capture of DataSeries records on syscall exit.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * The arguments captured for most syscalls are just paths, names and
+ * buffers at fixed argument positions, so instead of a hand-written
+ * case for each of them they are described in ds_capture.in, which is
+ * turned into a table indexed by SEN at build time.  Syscalls that need
+ * more than that are marked custom and left to syscall_exiting_trace().
+ */
+
+#include "defs.h"
+#include "static_assert.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include <sys/resource.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/statfs.h>
+
+enum ds_exit_how {
+	DS_EXIT_UNKNOWN,	/* not in the table, warn about it */
+	DS_EXIT_ARGS,
+	DS_EXIT_NULL_ARGS,
+	DS_EXIT_UNTRACED,
+	DS_EXIT_CUSTOM,
+};
+
+enum ds_arg_kind {
+	DS_ARG_NONE,
+	DS_ARG_PATH_KIND,
+	DS_ARG_NAME_KIND,
+	DS_ARG_BUFFER_KIND,
+	DS_ARG_PAYLOAD_KIND,
+	DS_ARG_SOCKLEN_KIND,
+};
+
+enum ds_len_kind {
+	DS_LEN_RVAL_KIND,
+	DS_LEN_ARG_KIND,
+	DS_LEN_FIXED_KIND,
+};
+
+struct ds_arg_desc {
+	uint8_t kind;
+	uint8_t arg;
+	uint8_t len_kind;
+	/* syscall argument index or constant, depending on len_kind */
+	uint32_t len;
+};
+
+struct ds_capture_desc {
+	uint8_t how;
+	uint8_t record;
+	uint8_t alt_record;
+	struct ds_arg_desc v[DS_MAX_ARGS];
+};
+
+# define DS_LEN_RVAL		DS_LEN_RVAL_KIND, 0
+# define DS_LEN_ARG(n)		DS_LEN_ARG_KIND, (n)
+# define DS_LEN_FIXED(size)	DS_LEN_FIXED_KIND, (size)
+
+# define DS_ARG_PATH(n)		{ DS_ARG_PATH_KIND, (n), 0, 0 }
+# define DS_ARG_NAME(n)		{ DS_ARG_NAME_KIND, (n), 0, 0 }
+# define DS_ARG_BUFFER(n, len)	{ DS_ARG_BUFFER_KIND, (n), len }
+# define DS_ARG_PAYLOAD(n, len)	{ DS_ARG_PAYLOAD_KIND, (n), len }
+# define DS_ARG_SOCKLEN(n)	{ DS_ARG_SOCKLEN_KIND, (n), 0, 0 }
+
+# include "sen.h"
+# include "ds_capture_table.h"
+
+static_assert(DS_REC_COUNT <= 256, "record type does not fit into uint8_t");
+
+static long
+arg_len(const struct tcb *const tcp, const struct ds_arg_desc *const d)
+{
+	switch (d->len_kind) {
+	case DS_LEN_RVAL_KIND:
+		return tcp->u_rval;
+	case DS_LEN_ARG_KIND:
+		return tcp->u_arg[d->len];
+	default:
+		return d->len;
+	}
+}
+
+static void *
+fetch_arg(struct tcb *const tcp, const struct ds_arg_desc *const d,
+	  const unsigned int index, void **const common_fields)
+{
+	const long addr = tcp->u_arg[d->arg];
+
+	switch (d->kind) {
+	case DS_ARG_PATH_KIND:
+		return ds_get_path(tcp, addr);
+	case DS_ARG_NAME_KIND:
+		return ds_get_name(tcp, addr);
+	case DS_ARG_BUFFER_KIND:
+		if (d->len_kind == DS_LEN_FIXED_KIND)
+			return ds_get_buffer(tcp, addr, d->len);
+		return ds_get_bounded_buffer(tcp, addr, arg_len(tcp, d), index,
+					     common_fields);
+	case DS_ARG_PAYLOAD_KIND:
+		return ds_get_payload(tcp, addr, arg_len(tcp, d), index,
+				      common_fields);
+	case DS_ARG_SOCKLEN_KIND: {
+		socklen_t *const ulen = ds_arena_alloc(tcp, sizeof(*ulen));
+
+		if (!addr || umove(tcp, addr, ulen) < 0)
+			*ulen = 0;
+		return ds_note_arg(ulen, sizeof(*ulen));
+	}
+	default:
+		return NULL;
+	}
+}
+
+bool
+ds_capture_traced(const struct_sysent *const s)
+{
+	return (unsigned int) s->sen >= ARRAY_SIZE(ds_capture_table)
+	       || ds_capture_table[s->sen].how != DS_EXIT_UNTRACED;
+}
+
+bool
+ds_capture_exiting(struct tcb *const tcp, void **const common_fields,
+		   void **const v_args)
+{
+	const unsigned int sen = tcp->s_ent->sen;
+	const struct ds_capture_desc *const d =
+		sen < ARRAY_SIZE(ds_capture_table) ? &ds_capture_table[sen]
+						   : NULL;
+
+	switch (d ? d->how : DS_EXIT_UNKNOWN) {
+	case DS_EXIT_CUSTOM:
+		return false;
+	case DS_EXIT_UNTRACED:
+		ds_submit_untraced(tcp->s_ent->sys_name, tcp->scno);
+		return true;
+	case DS_EXIT_UNKNOWN:
+		ds_submit_warning(tcp->s_ent->sys_name, tcp->scno);
+		return true;
+	}
+
+	for (unsigned int i = 0; i < DS_MAX_ARGS && d->v[i].kind; ++i)
+		v_args[i] = fetch_arg(tcp, &d->v[i], i, common_fields);
+
+	const char *name = ds_record_names[d->record];
+	if (d->alt_record && strcmp(tcp->s_ent->sys_name, name))
+		name = ds_record_names[d->alt_record];
+
+	ds_submit_record(name, tcp->u_arg, common_fields,
+			 d->how == DS_EXIT_NULL_ARGS ? NULL : v_args);
+	return true;
+}
+
+#endif /* ENABLE_DATASERIES */
@@ -0,0 +1,140 @@
+/*
+ * Timestamps of DataSeries records.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * By default every syscall stop reads both CLOCK_REALTIME, for the
+ * time_called and time_returned fields, and CLOCK_MONOTONIC, for -T
+ * and -c.  With --dataseries-clock=calibrated only CLOCK_MONOTONIC is
+ * read on each stop, and the realtime timestamp is derived from it
+ * using an offset between the two clocks.  The offset is measured at
+ * trace start and again whenever DS_CLOCK_CALIBRATION_INTERVAL has
+ * passed since the last measurement, so clock steps are picked up
+ * within that interval.
+ *
+ * CLOCK_MONOTONIC is used rather than CLOCK_MONOTONIC_RAW: it is served
+ * by the vDSO from the same TSC reading, and since it is slewed along
+ * with CLOCK_REALTIME the offset does not drift between calibrations.
+ *
+ * Every calibration is appended to DSFILE.clock, so the realtime
+ * timestamps in the records can be mapped back to the monotonic clock
+ * and the points where the offset changed can be found.  The file is
+ * a sequence of little-endian entries following an 8-byte "DSCLOCK1"
+ * magic:
+ *
+ *   'T' u64 monotonic_ns s64 realtime_ns u32 error_ns
+ *
+ * where error_ns is the width of the window the realtime clock was
+ * read in.
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# define DS_CLOCK_MAGIC			"DSCLOCK1"
+# define DS_CLOCK_CALIBRATION_INTERVAL	1000000000LL	/* nanoseconds */
+
+bool ds_clock_calibrated;
+
+static FILE *clock_store;
+
+static struct {
+	int64_t offset;			/* realtime - monotonic */
+	int64_t next;			/* monotonic time of the next calibration */
+	uint64_t count;
+} calibration;
+
+void
+ds_set_clock_mode(const char *arg)
+{
+	if (!strcmp(arg, "realtime"))
+		ds_clock_calibrated = false;
+	else if (!strcmp(arg, "calibrated"))
+		ds_clock_calibrated = true;
+	else
+		error_msg_and_help("invalid --dataseries-clock argument: '%s'",
+				   arg);
+}
+
+/*
+ * Reads CLOCK_REALTIME between two CLOCK_MONOTONIC readings and takes
+ * the midpoint of those as the matching monotonic time.
+ */
+static void
+calibrate(void)
+{
+	struct timespec m0, r, m1;
+
+	clock_gettime(CLOCK_MONOTONIC, &m0);
+	clock_gettime(CLOCK_REALTIME, &r);
+	clock_gettime(CLOCK_MONOTONIC, &m1);
+
+	const int64_t mono0 = timespec_to_ns(&m0);
+	const int64_t mono1 = timespec_to_ns(&m1);
+	const int64_t mono = mono0 + (mono1 - mono0) / 2;
+	const int64_t real = timespec_to_ns(&r);
+
+	calibration.offset = real - mono;
+	calibration.next = mono + DS_CLOCK_CALIBRATION_INTERVAL;
+	++calibration.count;
+
+	fputc('T', clock_store);
+	ds_put_u64(clock_store, mono);
+	ds_put_u64(clock_store, real);
+	ds_put_u32(clock_store, MIN(mono1 - mono0, UINT32_MAX));
+}
+
+void
+ds_clock_init(const char *ds_fname)
+{
+	if (!ds_clock_calibrated)
+		return;
+
+	clock_store = ds_open_sidecar(ds_fname, "clock", DS_CLOCK_MAGIC);
+
+	calibrate();
+}
+
+void
+ds_clock_read(struct timespec *const mono, int64_t *const real_ns)
+{
+	if (!ds_clock_calibrated) {
+		struct timespec real;
+
+		clock_gettime(CLOCK_REALTIME, &real);
+		*real_ns = timespec_to_ns(&real);
+		clock_gettime(CLOCK_MONOTONIC, mono);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, mono);
+
+	const int64_t mono_ns = timespec_to_ns(mono);
+	if (mono_ns >= calibration.next)
+		calibrate();
+	*real_ns = mono_ns + calibration.offset;
+}
+
+void
+ds_clock_finish(void)
+{
+	if (!clock_store)
+		return;
+
+	calibrate();
+
+	if (fclose(clock_store))
+		perror_msg("fclose");
+	clock_store = NULL;
+
+	debug_msg("DataSeries clock: %" PRIu64 " calibrations",
+		  calibration.count);
+}
+
+#endif /* ENABLE_DATASERIES */
@@ -0,0 +1,433 @@
+/*
+ * Content-addressed deduplication of DataSeries payloads
+ * and the payload store used by --ds-capture.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With --dataseries-dedup, read and write payloads that are at least
+ * one chunk long are not stored in the DataSeries records.  Instead,
+ * each payload is split into fixed-size chunks, every chunk is hashed,
+ * and only chunks that have not been seen before are appended to a
+ * chunk store written next to the DataSeries file (DSFILE.chunks).
+ * The record itself gets BUFFER_NOT_CAPTURED set and an explicit
+ * unique id, and the chunk store gets a reference entry mapping that
+ * unique id to the list of chunk ids the payload is made of.
+ * The records written for the elements of an iovec share the unique
+ * id of the first record of the syscall, so the id for those is
+ * claimed with ds_dedup_claim_id() before the first record is written.
+ * Records get an explicit unique id only with --dataseries-dedup, with
+ * the truncate and hash --ds-capture policies, and when a payload of
+ * theirs is streamed to the store.
+ *
+ * The chunk store is a sequence of little-endian entries following
+ * an 8-byte "DSCHUNK1" magic:
+ *
+ *   'C' u64 chunk_id u32 length  data[length]
+ *   'R' u64 unique_id u32 index u64 length u32 count u64 ids[count]
+ *
+ * Chunk ids are assigned sequentially starting with 0, so a reader can
+ * index chunks by the order they appear in.  A reference always comes
+ * after all chunks it refers to.  The index of a reference is the
+ * position of the payload in v_args, or the iov_number for the records
+ * of iovec elements.
+ *
+ * The store is not a DataSeries extent, as the extent types and their
+ * reader belong to the strace2ds library, so the readers of DataSeries
+ * files do not rebuild the payloads from it.  tests/ds-chunks.c does so,
+ * and checks the store on the way.
+ *
+ * Payloads captured with the truncate or hash --ds-capture policies
+ * are recorded in the same store, with or without --dataseries-dedup:
+ *
+ *   'P' u64 unique_id u32 index u64 length u32 size data[size]
+ *   'H' u64 unique_id u32 index u64 length u64 digest[2]
+ *
+ * where length is the size of the whole payload, data[] holds its
+ * first size bytes, and digest[] is the 128-bit digest of the whole
+ * payload as computed for the chunks.
+ *
+ * With --dataseries-buffer-limit, payloads to be captured that are
+ * larger than the limit are never held in memory as a whole.  They are
+ * copied from the tracee one piece of at most 1 MiB, or of the limit if
+ * it is smaller, at a time, and each piece is appended to the store as a
+ * continuation entry.  With --dataseries-dedup, a piece is a whole number
+ * of chunks, so that the payload is chunked as if it was not streamed.
+ * The limit applies to the iovec of a syscall as a whole: once the
+ * elements that are held add up to it, the remaining ones are streamed,
+ * however small.
+ *
+ *   'S' u64 unique_id u32 index u64 offset u32 size data[size]
+ *   'D' u64 unique_id u32 index u64 offset u32 count u64 ids[count]
+ *
+ * 'D' entries are used with --dataseries-dedup and list the chunks the
+ * piece is made of.  The pieces of a payload follow each other in
+ * offset order; the length of the payload is in the record itself.
+ * A hashed payload is streamed into its digest, so only the final 'H'
+ * entry is written for it.  If the tracee memory becomes unreadable
+ * halfway through, the pieces written so far are all that is stored.
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include "ds_digest.h"
+
+# define DS_DEDUP_DEFAULT_CHUNK_SIZE	4096
+# define DS_DEDUP_MAGIC			"DSCHUNK1"
+# define DS_STREAM_PIECE_SIZE		(1U << 20)
+
+unsigned int ds_dedup_chunk_size;
+unsigned int ds_stream_limit;
+
+static FILE *chunk_store;
+static const char *chunk_store_ds_fname;
+
+struct ds_chunk_slot {
+	struct ds_digest digest;
+	uint64_t id;	/* chunk id + 1, 0 for an empty slot */
+};
+
+static struct {
+	struct ds_chunk_slot *slots;
+	size_t mask;
+	size_t count;
+} chunk_table;
+
+/* The payload being streamed by ds_stream_begin() .. ds_stream_end(). */
+static struct {
+	void **common_fields;
+	unsigned int index;
+	bool hash;
+	uint64_t offset;
+	struct ds_digest_state digest;
+} stream;
+
+static struct {
+	uint64_t payloads;
+	uint64_t payload_bytes;
+	uint64_t chunks;
+	uint64_t stored_bytes;
+	uint64_t streamed;
+	uint64_t streamed_bytes;
+} ds_dedup_stats;
+
+void
+ds_set_dedup_chunk_size(const char *arg)
+{
+	if (!arg) {
+		ds_dedup_chunk_size = DS_DEDUP_DEFAULT_CHUNK_SIZE;
+		return;
+	}
+
+	const int size = string_to_uint_upto(arg, 1U << 24);
+	if (size < 64)
+		error_msg_and_help("invalid --dataseries-dedup argument: '%s'",
+				   arg);
+	ds_dedup_chunk_size = size;
+}
+
+void
+ds_set_stream_limit(const char *arg)
+{
+	const int size = string_to_uint_upto(arg, 1U << 30);
+
+	if (size < 0 || (size && size < 4096))
+		error_msg_and_help("invalid --dataseries-buffer-limit argument:"
+				   " '%s'", arg);
+	ds_stream_limit = size;
+}
+
+size_t
+ds_stream_piece_size(void)
+{
+	size_t size = MIN(ds_stream_limit, DS_STREAM_PIECE_SIZE);
+
+	if (ds_dedup_chunk_size)
+		size = MAX(size / ds_dedup_chunk_size, 1)
+		       * ds_dedup_chunk_size;
+	return size;
+}
+
+static void
+open_chunk_store(void)
+{
+	chunk_store = ds_open_sidecar(chunk_store_ds_fname, "chunks",
+				      DS_DEDUP_MAGIC);
+}
+
+/*
+ * The store is created right away if it is going to be needed, and on
+ * the first payload larger than ds_stream_limit otherwise.
+ */
+void
+ds_dedup_init(const char *ds_fname)
+{
+	chunk_store_ds_fname = ds_fname;
+
+	if (ds_dedup_chunk_size || ds_capture_needs_store)
+		open_chunk_store();
+
+	chunk_table.mask = 4095;
+	chunk_table.slots = xcalloc(chunk_table.mask + 1,
+				    sizeof(*chunk_table.slots));
+}
+
+static void
+grow_chunk_table(void)
+{
+	const size_t old_size = chunk_table.mask + 1;
+	struct ds_chunk_slot *const old = chunk_table.slots;
+
+	chunk_table.mask = old_size * 2 - 1;
+	chunk_table.slots = xcalloc(old_size * 2, sizeof(*chunk_table.slots));
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old[i].id)
+			continue;
+
+		size_t pos = old[i].digest.lo & chunk_table.mask;
+		while (chunk_table.slots[pos].id)
+			pos = (pos + 1) & chunk_table.mask;
+		chunk_table.slots[pos] = old[i];
+	}
+
+	free(old);
+}
+
+/*
+ * Returns the id of the chunk, appending it to the chunk store
+ * if it has not been seen before.
+ */
+static uint64_t
+intern_chunk(const void *const data, const size_t len)
+{
+	const struct ds_digest d = ds_digest(data, len);
+	size_t pos = d.lo & chunk_table.mask;
+
+	++ds_dedup_stats.chunks;
+
+	for (; chunk_table.slots[pos].id; pos = (pos + 1) & chunk_table.mask) {
+		if (chunk_table.slots[pos].digest.lo == d.lo
+		    && chunk_table.slots[pos].digest.hi == d.hi)
+			return chunk_table.slots[pos].id - 1;
+	}
+
+	const uint64_t id = chunk_table.count++;
+
+	chunk_table.slots[pos].digest = d;
+	chunk_table.slots[pos].id = id + 1;
+
+	fputc('C', chunk_store);
+	ds_put_u64(chunk_store, id);
+	ds_put_u32(chunk_store, len);
+	fwrite(data, 1, len, chunk_store);
+	ds_dedup_stats.stored_bytes += len;
+
+	/* Keep the load factor at or below 1/2. */
+	if (chunk_table.count * 2 > chunk_table.mask + 1)
+		grow_chunk_table();
+
+	return id;
+}
+
+/*
+ * Without --dataseries-dedup or a --ds-capture policy that uses the
+ * store, only the records of payloads that are split, that is,
+ * streamed, need an id.
+ */
+void
+ds_dedup_claim_id(struct tcb *const tcp, void **const common_fields,
+		  const bool split)
+{
+	if (!(split || ds_dedup_chunk_size || ds_capture_needs_store)
+	    || common_fields[DS_COMMON_FIELD_UNIQUE_ID])
+		return;
+
+	uint64_t *const unique_id = ds_arena_alloc(tcp, sizeof(*unique_id));
+	*unique_id = ds_next_id();
+	common_fields[DS_COMMON_FIELD_UNIQUE_ID] = unique_id;
+}
+
+static void
+put_ref_header(const int type, void **const common_fields,
+	       const unsigned int index, const uint64_t len)
+{
+	fputc(type, chunk_store);
+	ds_put_u64(chunk_store,
+		   *(uint64_t *) common_fields[DS_COMMON_FIELD_UNIQUE_ID]);
+	ds_put_u32(chunk_store, index);
+	ds_put_u64(chunk_store, len);
+}
+
+void *
+ds_dedup_payload(struct tcb *const tcp, void *const buf, const size_t len,
+		 const unsigned int index, void **const common_fields)
+{
+	if (!ds_dedup_chunk_size || !buf || len < ds_dedup_chunk_size)
+		return buf;
+
+	const size_t count = (len + ds_dedup_chunk_size - 1)
+			     / ds_dedup_chunk_size;
+	uint64_t *const ids = ds_arena_alloc(tcp, count * sizeof(*ids));
+	const unsigned char *const p = buf;
+
+	for (size_t i = 0; i < count; ++i) {
+		const size_t off = i * ds_dedup_chunk_size;
+
+		ids[i] = intern_chunk(p + off, MIN(len - off,
+						   ds_dedup_chunk_size));
+	}
+
+	ds_dedup_claim_id(tcp, common_fields, false);
+
+	put_ref_header('R', common_fields, index, len);
+	ds_put_u32(chunk_store, count);
+	for (size_t i = 0; i < count; ++i)
+		ds_put_u64(chunk_store, ids[i]);
+
+	++ds_dedup_stats.payloads;
+	ds_dedup_stats.payload_bytes += len;
+
+	common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] = (void *) true;
+
+	return NULL;
+}
+
+void
+ds_store_prefix(struct tcb *const tcp, const void *const buf, const size_t size,
+		const size_t len, const unsigned int index,
+		void **const common_fields)
+{
+	ds_dedup_claim_id(tcp, common_fields, false);
+
+	put_ref_header('P', common_fields, index, len);
+	ds_put_u32(chunk_store, size);
+	fwrite(buf, 1, size, chunk_store);
+
+	common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] = (void *) true;
+}
+
+void
+ds_store_digest(struct tcb *const tcp, const void *const buf, const size_t len,
+		const unsigned int index, void **const common_fields)
+{
+	const struct ds_digest d = ds_digest(buf, len);
+
+	ds_dedup_claim_id(tcp, common_fields, false);
+
+	put_ref_header('H', common_fields, index, len);
+	ds_put_u64(chunk_store, d.lo);
+	ds_put_u64(chunk_store, d.hi);
+
+	common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] = (void *) true;
+}
+
+void
+ds_stream_begin(struct tcb *const tcp, const size_t len, const bool hash,
+		const unsigned int index, void **const common_fields)
+{
+	if (!chunk_store)
+		open_chunk_store();
+
+	ds_dedup_claim_id(tcp, common_fields, true);
+
+	stream.common_fields = common_fields;
+	stream.index = index;
+	stream.hash = hash;
+	stream.offset = 0;
+	if (hash)
+		ds_digest_init(&stream.digest, len);
+
+	++ds_dedup_stats.streamed;
+
+	common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] = (void *) true;
+}
+
+void
+ds_stream_piece(struct tcb *const tcp, const void *const buf,
+		const size_t size)
+{
+	if (stream.hash) {
+		ds_digest_update(&stream.digest, buf, size);
+	} else if (ds_dedup_chunk_size) {
+		const size_t count = (size + ds_dedup_chunk_size - 1)
+				     / ds_dedup_chunk_size;
+		uint64_t *const ids = ds_arena_alloc(tcp, count * sizeof(*ids));
+		const unsigned char *const p = buf;
+
+		for (size_t i = 0; i < count; ++i) {
+			const size_t off = i * ds_dedup_chunk_size;
+
+			ids[i] = intern_chunk(p + off,
+					      MIN(size - off,
+						  ds_dedup_chunk_size));
+		}
+
+		put_ref_header('D', stream.common_fields, stream.index,
+			       stream.offset);
+		ds_put_u32(chunk_store, count);
+		for (size_t i = 0; i < count; ++i)
+			ds_put_u64(chunk_store, ids[i]);
+
+		ds_arena_trim(tcp, ids, 0);
+	} else {
+		put_ref_header('S', stream.common_fields, stream.index,
+			       stream.offset);
+		ds_put_u32(chunk_store, size);
+		fwrite(buf, 1, size, chunk_store);
+		ds_dedup_stats.stored_bytes += size;
+	}
+
+	stream.offset += size;
+	ds_dedup_stats.streamed_bytes += size;
+}
+
+void
+ds_stream_end(const bool complete)
+{
+	if (stream.hash && complete) {
+		const struct ds_digest d = ds_digest_final(&stream.digest);
+
+		put_ref_header('H', stream.common_fields, stream.index,
+			       stream.offset);
+		ds_put_u64(chunk_store, d.lo);
+		ds_put_u64(chunk_store, d.hi);
+	}
+
+	stream.common_fields = NULL;
+}
+
+void
+ds_dedup_finish(void)
+{
+	free(chunk_table.slots);
+	chunk_table.slots = NULL;
+
+	if (!chunk_store)
+		return;
+
+	if (fclose(chunk_store))
+		perror_msg("fclose");
+	chunk_store = NULL;
+
+	if (ds_dedup_chunk_size)
+		debug_msg("DataSeries dedup: %" PRIu64 " payloads, %" PRIu64
+			  " bytes in %" PRIu64 " chunks, %zu unique chunks, %"
+			  PRIu64 " bytes stored, %s digest",
+			  ds_dedup_stats.payloads, ds_dedup_stats.payload_bytes,
+			  ds_dedup_stats.chunks, (size_t) chunk_table.count,
+			  ds_dedup_stats.stored_bytes, ds_digest_name());
+	if (ds_dedup_stats.streamed)
+		debug_msg("DataSeries store: %" PRIu64 " payloads, %" PRIu64
+			  " bytes streamed in pieces of at most %u bytes",
+			  ds_dedup_stats.streamed,
+			  ds_dedup_stats.streamed_bytes, ds_stream_limit);
+}
+
+#endif /* ENABLE_DATASERIES */
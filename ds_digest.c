@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With --dataseries-dedup every payload byte is hashed, so the digest
+ * runs over all the I/O of the tracee.  It is built to be vectorised:
+ * eight 64-bit accumulators each take a 64-bit word of every 64-byte
+ * stripe, XORed with a key, and add the product of its two 32-bit halves
+ * along with the word of the neighbouring lane, as XXH3 does.  The 32x32
+ * multiplication is the one x86-64 has in vectors, with SSE2, its
+ * baseline, 2 lanes at a time, and with AVX2, where the CPU has it, 4
+ * at a time.  The keys slide by one word from a stripe to the next, and
+ * the accumulators are scrambled after every block of 16 stripes, so
+ * that the order of the stripes matters.  The last partial stripe is
+ * padded with zeroes, and the length is mixed in at the end.  The other
+ * architectures take the scalar path; the words are read as little
+ * endian everywhere, so the digests are the same on all of them.
+ *
+ * It is not cryptographic, but collisions are not a practical concern
+ * for trace payloads.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef ENABLE_DATASERIES
+
+# include <endian.h>
+# include <stdbool.h>
+# include <stdint.h>
+# include <string.h>
+
+# include "macros.h"
+# include "ds_digest.h"
+
+# if defined __x86_64__ && (defined __clang__ || __GNUC__ >= 5)
+#  define DS_DIGEST_X86 1
+#  include <immintrin.h>
+#  define ATTRIBUTE_AVX2 __attribute__((target("avx2")))
+# endif
+
+# define STRIPE_SIZE	64
+# define BLOCK_STRIPES	16
+# define PRIME32	0x9e3779b1U
+
+/*
+ * The keys of the stripes, slid by one from a stripe to the next,
+ * then those of the scramble.
+ */
+static const uint64_t keys[BLOCK_STRIPES + 8 + 8] = {
+	0x87992c21561bf027ULL, 0x55195910b45de566ULL, 0x90e8852bd93cd8c3ULL,
+	0x41f865506a9564e1ULL, 0xaacf0406ea410827ULL, 0x910b589f88228b67ULL,
+	0xaf0ff396f9fb55d2ULL, 0x2e5c765b66936a42ULL, 0x249df43db2fd04d8ULL,
+	0x218d6c9510d9cd55ULL, 0x4924c8f6cf0af4f0ULL, 0xcf2c5c24e25c5f71ULL,
+	0x169ac3d01daf81d1ULL, 0xe940eb92c8376639ULL, 0xb67389d1e1a37369ULL,
+	0x7da137ea0efe128dULL, 0x17c2eeaddafd01f0ULL, 0x51759162e4bd2f0fULL,
+	0xaaaf0333179573f5ULL, 0xddd98bf35ff3a486ULL, 0xce46d19214f92e6eULL,
+	0x2f12a3f7cf2b5ce8ULL, 0x1327deabbaa01581ULL, 0x3ca70ca067bca6d0ULL,
+	0xcecff4f9d688f66dULL, 0x446b58f2ff0aa0aaULL, 0x73b31eb88920a28bULL,
+	0x9adba63a35947891ULL, 0xea3f23a70cd9f4d0ULL, 0xfebbca2bd278e4eaULL,
+	0x387a127acbe21051ULL, 0x5d5e0ca108ded26bULL,
+};
+
+static const uint64_t *const scramble_keys = keys + BLOCK_STRIPES + 8;
+
+struct ds_digest_ops {
+	const char *name;
+	bool (*supported)(void);
+	/* Accumulates n stripes, the first one with the keys at key. */
+	void (*accumulate)(uint64_t *acc, const unsigned char *p, size_t n,
+			   const uint64_t *key);
+	void (*scramble)(uint64_t *acc);
+};
+
+static bool
+supported_always(void)
+{
+	return true;
+}
+
+/* Scalar implementation. */
+
+static void
+accumulate_scalar(uint64_t *const acc, const unsigned char *p, size_t n,
+		  const uint64_t *key)
+{
+	for (; n; --n, p += STRIPE_SIZE, ++key) {
+		for (unsigned int i = 0; i < 8; ++i) {
+			uint64_t d;
+
+			memcpy(&d, p + i * 8, sizeof(d));
+			d = le64toh(d);
+
+			const uint64_t dk = d ^ key[i];
+
+			acc[i ^ 1] += d;
+			acc[i] += (dk & 0xffffffff) * (dk >> 32);
+		}
+	}
+}
+
+static void
+scramble_scalar(uint64_t *const acc)
+{
+	for (unsigned int i = 0; i < 8; ++i) {
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= scramble_keys[i];
+		acc[i] *= PRIME32;
+	}
+}
+
+static const struct ds_digest_ops digest_scalar = {
+	.name = "scalar",
+	.supported = supported_always,
+	.accumulate = accumulate_scalar,
+	.scramble = scramble_scalar,
+};
+
+# ifdef DS_DIGEST_X86
+
+/* SSE2 implementation, 2 lanes per vector. */
+
+static void
+accumulate_sse2(uint64_t *const acc, const unsigned char *p, size_t n,
+		const uint64_t *key)
+{
+	__m128i a[4];
+
+	for (unsigned int j = 0; j < 4; ++j)
+		a[j] = _mm_loadu_si128((const void *) (acc + j * 2));
+
+	for (; n; --n, p += STRIPE_SIZE, ++key) {
+		for (unsigned int j = 0; j < 4; ++j) {
+			const __m128i d =
+				_mm_loadu_si128((const void *) (p + j * 16));
+			const __m128i dk =
+				_mm_xor_si128(d, _mm_loadu_si128((const void *)
+								 (key + j * 2)));
+			/* The high half of each word in its low half. */
+			const __m128i dk_hi =
+				_mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+			/* The words of the neighbouring lanes. */
+			const __m128i d_swap =
+				_mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+
+			a[j] = _mm_add_epi64(a[j],
+					     _mm_add_epi64(_mm_mul_epu32(dk,
+									 dk_hi),
+							   d_swap));
+		}
+	}
+
+	for (unsigned int j = 0; j < 4; ++j)
+		_mm_storeu_si128((void *) (acc + j * 2), a[j]);
+}
+
+static void
+scramble_sse2(uint64_t *const acc)
+{
+	const __m128i prime = _mm_set1_epi32(PRIME32);
+
+	for (unsigned int j = 0; j < 4; ++j) {
+		__m128i a = _mm_loadu_si128((const void *) (acc + j * 2));
+
+		a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+		a = _mm_xor_si128(a, _mm_loadu_si128((const void *)
+						     (scramble_keys + j * 2)));
+
+		/* The 64x32 multiplication from two 32x32 ones. */
+		const __m128i lo = _mm_mul_epu32(a, prime);
+		const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+
+		_mm_storeu_si128((void *) (acc + j * 2),
+				 _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+	}
+}
+
+static const struct ds_digest_ops digest_sse2 = {
+	.name = "sse2",
+	.supported = supported_always,
+	.accumulate = accumulate_sse2,
+	.scramble = scramble_sse2,
+};
+
+/* AVX2 implementation, 4 lanes per vector. */
+
+static bool
+avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+ATTRIBUTE_AVX2 static void
+accumulate_avx2(uint64_t *const acc, const unsigned char *p, size_t n,
+		const uint64_t *key)
+{
+	__m256i a[2];
+
+	for (unsigned int j = 0; j < 2; ++j)
+		a[j] = _mm256_loadu_si256((const void *) (acc + j * 4));
+
+	for (; n; --n, p += STRIPE_SIZE, ++key) {
+		for (unsigned int j = 0; j < 2; ++j) {
+			const __m256i d =
+				_mm256_loadu_si256((const void *) (p + j * 32));
+			const __m256i dk =
+				_mm256_xor_si256(d, _mm256_loadu_si256(
+					(const void *) (key + j * 4)));
+			const __m256i dk_hi =
+				_mm256_shuffle_epi32(dk,
+						     _MM_SHUFFLE(0, 3, 0, 1));
+			const __m256i d_swap =
+				_mm256_shuffle_epi32(d,
+						     _MM_SHUFFLE(1, 0, 3, 2));
+
+			a[j] = _mm256_add_epi64(a[j],
+				_mm256_add_epi64(_mm256_mul_epu32(dk, dk_hi),
+						 d_swap));
+		}
+	}
+
+	for (unsigned int j = 0; j < 2; ++j)
+		_mm256_storeu_si256((void *) (acc + j * 4), a[j]);
+}
+
+ATTRIBUTE_AVX2 static void
+scramble_avx2(uint64_t *const acc)
+{
+	const __m256i prime = _mm256_set1_epi32(PRIME32);
+
+	for (unsigned int j = 0; j < 2; ++j) {
+		__m256i a = _mm256_loadu_si256((const void *) (acc + j * 4));
+
+		a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+		a = _mm256_xor_si256(a, _mm256_loadu_si256(
+			(const void *) (scramble_keys + j * 4)));
+
+		const __m256i lo = _mm256_mul_epu32(a, prime);
+		const __m256i hi =
+			_mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+
+		_mm256_storeu_si256((void *) (acc + j * 4),
+				    _mm256_add_epi64(lo,
+						     _mm256_slli_epi64(hi, 32)));
+	}
+}
+
+static const struct ds_digest_ops digest_avx2 = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.accumulate = accumulate_avx2,
+	.scramble = scramble_avx2,
+};
+
+# endif /* DS_DIGEST_X86 */
+
+/* The implementations, the best first. */
+static const struct ds_digest_ops *const digest_impls[] = {
+# ifdef DS_DIGEST_X86
+	&digest_avx2,
+	&digest_sse2,
+# endif
+	&digest_scalar,
+};
+
+static const struct ds_digest_ops *digest_ops;
+
+static const struct ds_digest_ops *
+get_digest_ops(void)
+{
+	if (!digest_ops) {
+		for (size_t i = 0; !digest_ops; ++i) {
+			if (digest_impls[i]->supported())
+				digest_ops = digest_impls[i];
+		}
+	}
+	return digest_ops;
+}
+
+int
+ds_digest_select(const char *const name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(digest_impls); ++i) {
+		if (!strcmp(digest_impls[i]->name, name)) {
+			if (!digest_impls[i]->supported())
+				return -1;
+			digest_ops = digest_impls[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *
+ds_digest_name(void)
+{
+	return get_digest_ops()->name;
+}
+
+static inline uint64_t
+rotl64(const uint64_t v, const unsigned int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void
+ds_digest_init(struct ds_digest_state *const st, const uint64_t len)
+{
+	static const uint64_t init[8] = {
+		0x00000000c2b2ae3dULL, 0x9e3779b185ebca87ULL,
+		0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL,
+		0x85ebca77c2b2ae63ULL, 0x0000000085ebca77ULL,
+		0x27d4eb2f165667c5ULL, 0x000000009e3779b1ULL,
+	};
+
+	memcpy(st->acc, init, sizeof(st->acc));
+	st->len = len;
+	st->stripe = 0;
+	st->carry_len = 0;
+}
+
+static void
+consume_stripes(struct ds_digest_state *const st, const unsigned char *p,
+		size_t n)
+{
+	const struct ds_digest_ops *const ops = get_digest_ops();
+
+	while (n) {
+		const size_t k = MIN(n, BLOCK_STRIPES - st->stripe);
+
+		ops->accumulate(st->acc, p, k, keys + st->stripe);
+		st->stripe += k;
+		p += k * STRIPE_SIZE;
+		n -= k;
+
+		if (st->stripe == BLOCK_STRIPES) {
+			ops->scramble(st->acc);
+			st->stripe = 0;
+		}
+	}
+}
+
+void
+ds_digest_update(struct ds_digest_state *const st, const void *const buf,
+		 size_t len)
+{
+	const unsigned char *p = buf;
+
+	if (st->carry_len) {
+		const size_t n = MIN(len, sizeof(st->carry) - st->carry_len);
+
+		memcpy(st->carry + st->carry_len, p, n);
+		st->carry_len += n;
+		p += n;
+		len -= n;
+		if (st->carry_len < sizeof(st->carry))
+			return;
+		consume_stripes(st, st->carry, 1);
+		st->carry_len = 0;
+	}
+
+	consume_stripes(st, p, len / STRIPE_SIZE);
+	p += len / STRIPE_SIZE * STRIPE_SIZE;
+
+	memcpy(st->carry, p, len % STRIPE_SIZE);
+	st->carry_len = len % STRIPE_SIZE;
+}
+
+struct ds_digest
+ds_digest_final(struct ds_digest_state *const st)
+{
+	if (st->carry_len) {
+		memset(st->carry + st->carry_len, 0,
+		       sizeof(st->carry) - st->carry_len);
+		consume_stripes(st, st->carry, 1);
+	}
+
+	uint64_t h1 = st->len * 0x9e3779b185ebca87ULL;
+	uint64_t h2 = ~st->len;
+
+	for (unsigned int i = 0; i < 8; ++i) {
+		h1 = rotl64(h1 ^ fmix64(st->acc[i] ^ keys[i]), 27) * 5
+		     + 0x52dce729;
+		h2 = rotl64(h2 ^ fmix64(st->acc[i] + keys[8 + i]), 31) * 5
+		     + 0x38495ab5;
+	}
+
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	return (struct ds_digest) { .lo = h1, .hi = h2 };
+}
+
+struct ds_digest
+ds_digest(const void *const p, const size_t len)
+{
+	struct ds_digest_state st;
+
+	ds_digest_init(&st, len);
+	ds_digest_update(&st, p, len);
+	return ds_digest_final(&st);
+}
+
+#endif /* ENABLE_DATASERIES */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_DS_DIGEST_H
+# define STRACE_DS_DIGEST_H
+
+# include <stddef.h>
+# include <stdint.h>
+
+/*
+ * The 128-bit digest of DataSeries payloads and chunks, vectorised where
+ * the CPU allows it.  All the implementations produce the same digest.
+ */
+
+struct ds_digest {
+	uint64_t lo;
+	uint64_t hi;
+};
+
+/* The bytes are consumed 64 at a time, in blocks of 16 such stripes. */
+struct ds_digest_state {
+	uint64_t acc[8];
+	uint64_t len;
+	unsigned int stripe;		/* in the current block */
+	unsigned int carry_len;
+	unsigned char carry[64];
+};
+
+/*
+ * Starts the digest of len bytes.  The length is known up front, so that
+ * a streamed payload can be fed to ds_digest_update piece by piece.
+ */
+extern void ds_digest_init(struct ds_digest_state *, uint64_t len);
+extern void ds_digest_update(struct ds_digest_state *, const void *, size_t);
+extern struct ds_digest ds_digest_final(struct ds_digest_state *);
+
+/* The digest of the len bytes at p. */
+extern struct ds_digest ds_digest(const void *p, size_t len);
+
+/*
+ * Selects the implementation called "scalar", "sse2" or "avx2",
+ * returns 0 on success, -1 if it is not supported by the CPU or build.
+ * The best supported one is used by default.
+ */
+extern int ds_digest_select(const char *name);
+
+/* Returns the name of the implementation in use. */
+extern const char *ds_digest_name(void);
+
+#endif /* !STRACE_DS_DIGEST_H */
@@ -0,0 +1,178 @@
+/*
+ * Descriptors of DataSeries records.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * The records of the syscalls that create descriptors carry the
+ * descriptor numbers but not what they refer to.  With --dataseries-fds,
+ * what the arguments of open, openat and creat, and of dup, dup2, dup3
+ * and fcntl F_DUPFD, tell about each new descriptor is written to a
+ * descriptor store next to the DataSeries file (DSFILE.fds), a sequence
+ * of little-endian entries following an 8-byte "DSFDTAB1" magic:
+ *
+ *   'F' u64 unique_id s32 fd u32 path_len path[path_len]
+ *
+ * where unique_id is that of the record of the syscall that created the
+ * descriptor.  Such records always have an explicit unique id.
+ *
+ * The path of an opened file is the one it was opened by, joined to
+ * that of the directory descriptor for openat, and a duplicate gets the
+ * path of the descriptor it duplicates.  /proc is never consulted: the
+ * absolute paths learnt are kept in the descriptor table of the tracer,
+ * apart from the canonical ones -y prints, and are found there for the
+ * directory and duplicated descriptors.
+ * A path relative to the working directory is recorded as is.
+ * Descriptors whose path the arguments do not tell, like those of
+ * sockets, pipes, or duplicates of descriptors created before the trace
+ * started, are not recorded, nor are those that depend on another
+ * descriptor with --tracer-shards, where the table is not kept.
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include <fcntl.h>
+# include <limits.h>
+# include "sen.h"
+
+# define DS_FDS_MAGIC	"DSFDTAB1"
+
+bool ds_fds_enabled;
+
+static FILE *fd_store;
+
+static struct {
+	uint64_t fds;
+	uint64_t unknown;
+} ds_fds_stats;
+
+void
+ds_fds_init(const char *const ds_fname)
+{
+	if (!ds_fds_enabled)
+		return;
+
+	fd_store = ds_open_sidecar(ds_fname, "fds", DS_FDS_MAGIC);
+}
+
+/* Whether the arguments of the syscall tell what its descriptors are. */
+static bool
+told_by_args(const struct tcb *const tcp)
+{
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_creat:
+	case SEN_dup:
+	case SEN_dup2:
+	case SEN_dup3:
+	case SEN_fcntl:
+	case SEN_fcntl64:
+	case SEN_open:
+	case SEN_openat:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void
+ds_fds_claim_id(struct tcb *const tcp, void **const common_fields)
+{
+	int fds[2];
+
+	if (!fd_store || common_fields[DS_COMMON_FIELD_UNIQUE_ID]
+	    || !told_by_args(tcp) || !fdtable_new_fds(tcp, fds))
+		return;
+
+	uint64_t *const unique_id = ds_arena_alloc(tcp, sizeof(*unique_id));
+	*unique_id = ds_next_id();
+	common_fields[DS_COMMON_FIELD_UNIQUE_ID] = unique_id;
+}
+
+/*
+ * Returns the path of the descriptor created by the syscall tcp is
+ * exiting from, as far as its arguments tell, or NULL.  The path
+ * argument of the open syscalls is v_args[0].
+ */
+static const char *
+new_fd_path(struct tcb *const tcp, void **const v_args,
+	    char buf[PATH_MAX])
+{
+	int dirfd = AT_FDCWD;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_openat:
+		dirfd = tcp->u_arg[0];
+		ATTRIBUTE_FALLTHROUGH;
+	case SEN_creat:
+	case SEN_open: {
+		const char *const name = v_args[0];
+
+		if (!name || name[0] == '/' || dirfd == AT_FDCWD)
+			return name;
+
+		const char *const dir = fdtable_lookup_ds_path(tcp, dirfd);
+
+		if (!dir || (size_t) snprintf(buf, PATH_MAX, "%s/%s", dir, name)
+			    >= PATH_MAX)
+			return NULL;
+		return buf;
+	}
+	default:
+		/* dup, dup2, dup3, and fcntl F_DUPFD */
+		return fdtable_lookup_ds_path(tcp, tcp->u_arg[0]);
+	}
+}
+
+void
+ds_fds_record(struct tcb *const tcp, void **const common_fields,
+	      void **const v_args)
+{
+	int fds[2];
+
+	if (!fd_store || !common_fields[DS_COMMON_FIELD_UNIQUE_ID]
+	    || !told_by_args(tcp) || !fdtable_new_fds(tcp, fds))
+		return;
+
+	char buf[PATH_MAX];
+	const char *const path = new_fd_path(tcp, v_args, buf);
+
+	if (!path) {
+		ds_fds_stats.unknown++;
+		return;
+	}
+
+	const size_t path_len = strlen(path);
+
+	fputc('F', fd_store);
+	ds_put_u64(fd_store,
+		   *(uint64_t *) common_fields[DS_COMMON_FIELD_UNIQUE_ID]);
+	ds_put_u32(fd_store, fds[0]);
+	ds_put_u32(fd_store, path_len);
+	fwrite(path, 1, path_len, fd_store);
+	ds_fds_stats.fds++;
+
+	if (path[0] == '/')
+		fdtable_store_ds_path(tcp, fds[0], path);
+}
+
+void
+ds_fds_finish(void)
+{
+	if (!fd_store)
+		return;
+
+	if (fclose(fd_store))
+		perror_msg("fclose");
+	fd_store = NULL;
+
+	debug_msg("DataSeries descriptors: %" PRIu64 " recorded, %" PRIu64
+		  " of unknown path", ds_fds_stats.fds, ds_fds_stats.unknown);
+}
+
+#endif /* ENABLE_DATASERIES */
@@ -0,0 +1,56 @@
+/*
+ * Sidecar files of DataSeries output.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * The chunk store, the clock, stack and descriptor stores are all
+ * written next to the DataSeries file, as DSFILE.SUFFIX, and are all
+ * sequences of little-endian entries following an 8-byte magic.
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include <endian.h>
+# include <limits.h>
+
+FILE *
+ds_open_sidecar(const char *const ds_fname, const char *const suffix,
+		const char *const magic)
+{
+	char path[PATH_MAX];
+
+	if ((size_t) snprintf(path, sizeof(path), "%s.%s", ds_fname, suffix)
+	    >= sizeof(path))
+		error_msg_and_die("DataSeries file name is too long: %s",
+				  ds_fname);
+
+	FILE *const fp = strace_fopen(path, "w");
+
+	fwrite(magic, 1, strlen(magic), fp);
+	return fp;
+}
+
+void
+ds_put_u32(FILE *const fp, const uint32_t v)
+{
+	const uint32_t le = htole32(v);
+
+	fwrite(&le, sizeof(le), 1, fp);
+}
+
+void
+ds_put_u64(FILE *const fp, const uint64_t v)
+{
+	const uint64_t le = htole64(v);
+
+	fwrite(&le, sizeof(le), 1, fp);
+}
+
+#endif /* ENABLE_DATASERIES */
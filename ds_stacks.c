@@ -0,0 +1,319 @@
+/*
+ * Call stacks of DataSeries records.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With -k, the DataSeries output records the call stack of every traced
+ * syscall, or of the syscalls given by --ds-stacks=SET, instead of
+ * printing it.  The frames are not resolved to symbols while tracing:
+ * each one is recorded as a binary and an offset in it, so that the
+ * symbols can be looked up offline, once per unique stack.  The stacks
+ * are deduplicated by a hash of their frames and written to a stack
+ * store next to the DataSeries file (DSFILE.stacks), a sequence of
+ * little-endian entries following an 8-byte "DSSTACK1" magic:
+ *
+ *   'M' u32 module_id u32 build_id_len build_id[build_id_len]
+ *       u32 name_len name[name_len]
+ *   'K' u64 stack_id u32 depth { u32 module_id u64 offset }[depth]
+ *   'U' u64 unique_id u64 stack_id
+ *
+ * A module is a binary, with its GNU build-id, if it has one, and the
+ * path it was first found at.  The frames of a stack are innermost
+ * first, and their offsets are those printed by -k: file offsets with
+ * libunwind, addresses in the binary with libdw.  Stack ids are
+ * assigned sequentially starting with 1.  A 'U' entry gives the stack
+ * of the records of a syscall; records whose stack is recorded always
+ * have an explicit unique id.  An entry always comes after the entries
+ * it refers to.
+ */
+
+#include "defs.h"
+
+#if defined ENABLE_DATASERIES && defined ENABLE_STACKTRACE
+
+# include "filter.h"
+# include "number_set.h"
+# include "unwind.h"
+
+# define DS_STACKS_MAGIC	"DSSTACK1"
+# define DS_STACKS_MAX_DEPTH	256
+
+struct ds_frame {
+	const struct unwind_symcache_module *module;
+	unsigned long offset;
+};
+
+struct ds_stack_slot {
+	uint64_t hash;
+	uint64_t id;	/* 0 for an empty slot */
+	unsigned int depth;
+	struct ds_frame *frames;
+};
+
+/* The syscalls whose stacks are recorded, all of them if NULL. */
+static struct number_set *ds_stacks_set;
+
+static FILE *stack_store;
+
+static struct {
+	struct ds_stack_slot *slots;
+	size_t mask;
+	size_t count;
+} stack_table;
+
+/* Whether the 'M' entry of each module id has been written. */
+static bool *module_written;
+static size_t module_written_size;
+
+/* The frames of the stack being walked. */
+static struct ds_frame walk_frames[DS_STACKS_MAX_DEPTH];
+static unsigned int walk_depth;
+
+static struct {
+	uint64_t walks;
+	uint64_t frames;
+} ds_stacks_stats;
+
+void
+qualify_ds_stacks(const char *const str)
+{
+	if (!ds_stacks_set)
+		ds_stacks_set = alloc_number_set_array(SUPPORTED_PERSONALITIES);
+	qualify_syscall_tokens(str, ds_stacks_set);
+}
+
+void
+ds_stacks_init(const char *const ds_fname)
+{
+	if (!stack_trace_enabled)
+		return;
+
+	stack_store = ds_open_sidecar(ds_fname, "stacks", DS_STACKS_MAGIC);
+
+	stack_table.mask = 1023;
+	stack_table.slots = xcalloc(stack_table.mask + 1,
+				    sizeof(*stack_table.slots));
+}
+
+static bool
+selected(const struct tcb *const tcp)
+{
+	return stack_store
+	       && (!ds_stacks_set
+		   || is_number_in_set_array(tcp->scno, ds_stacks_set,
+					     current_personality));
+}
+
+static void
+put_frame(void *data, const struct unwind_symcache_module *const module,
+	  const unsigned long true_offset)
+{
+	if (walk_depth < DS_STACKS_MAX_DEPTH) {
+		walk_frames[walk_depth].module = module;
+		walk_frames[walk_depth].offset = true_offset;
+		++walk_depth;
+	}
+}
+
+static void
+put_error(void *data, const char *const error, const unsigned long ip)
+{
+	debug_func_msg("%s [%#lx] after %u frames", error, ip, walk_depth);
+}
+
+static uint64_t
+hash_frames(const struct ds_frame *const frames, const unsigned int depth)
+{
+	uint64_t h = depth;
+
+	for (unsigned int i = 0; i < depth; ++i) {
+		h = (h ^ frames[i].module->id) * 0x100000001b3ULL;
+		h = (h ^ frames[i].offset) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+static void
+write_module(const struct unwind_symcache_module *const module)
+{
+	if (module->id < module_written_size && module_written[module->id])
+		return;
+
+	while (module->id >= module_written_size) {
+		const size_t old_size = module_written_size;
+
+		module_written = xgrowarray(module_written,
+					    &module_written_size,
+					    sizeof(*module_written));
+		memset(module_written + old_size, 0,
+		       module_written_size - old_size);
+	}
+	module_written[module->id] = true;
+
+	const char *const name = module->filename ? module->filename : "";
+	const size_t name_len = strlen(name);
+
+	fputc('M', stack_store);
+	ds_put_u32(stack_store, module->id);
+	ds_put_u32(stack_store, module->build_id_len);
+	fwrite(module->build_id, 1, module->build_id_len, stack_store);
+	ds_put_u32(stack_store, name_len);
+	fwrite(name, 1, name_len, stack_store);
+}
+
+static void
+grow_stack_table(void)
+{
+	const size_t old_size = stack_table.mask + 1;
+	struct ds_stack_slot *const old = stack_table.slots;
+
+	stack_table.mask = old_size * 2 - 1;
+	stack_table.slots = xcalloc(old_size * 2, sizeof(*stack_table.slots));
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old[i].id)
+			continue;
+
+		size_t pos = old[i].hash & stack_table.mask;
+		while (stack_table.slots[pos].id)
+			pos = (pos + 1) & stack_table.mask;
+		stack_table.slots[pos] = old[i];
+	}
+
+	free(old);
+}
+
+/*
+ * Returns the id of the stack made of the walked frames,
+ * appending it to the stack store if it has not been seen before.
+ */
+static uint64_t
+intern_stack(void)
+{
+	const uint64_t hash = hash_frames(walk_frames, walk_depth);
+	const size_t size = walk_depth * sizeof(*walk_frames);
+	size_t pos = hash & stack_table.mask;
+
+	for (; stack_table.slots[pos].id; pos = (pos + 1) & stack_table.mask) {
+		const struct ds_stack_slot *const slot =
+			&stack_table.slots[pos];
+
+		if (slot->hash == hash && slot->depth == walk_depth
+		    && !memcmp(slot->frames, walk_frames, size))
+			return slot->id;
+	}
+
+	struct ds_stack_slot *const slot = &stack_table.slots[pos];
+
+	slot->hash = hash;
+	slot->id = ++stack_table.count;
+	slot->depth = walk_depth;
+	slot->frames = xmalloc(size);
+	memcpy(slot->frames, walk_frames, size);
+
+	for (unsigned int i = 0; i < walk_depth; ++i)
+		write_module(walk_frames[i].module);
+
+	fputc('K', stack_store);
+	ds_put_u64(stack_store, slot->id);
+	ds_put_u32(stack_store, walk_depth);
+	for (unsigned int i = 0; i < walk_depth; ++i) {
+		ds_put_u32(stack_store, walk_frames[i].module->id);
+		ds_put_u64(stack_store, walk_frames[i].offset);
+	}
+
+	const uint64_t id = slot->id;
+
+	/* Keep the load factor at or below 1/2. */
+	if (stack_table.count * 2 > stack_table.mask + 1)
+		grow_stack_table();
+
+	return id;
+}
+
+/* Returns the id of the current stack of tcp, 0 if it has no frames. */
+static uint64_t
+walk_stack(struct tcb *const tcp)
+{
+	walk_depth = 0;
+	unwind_tcb_walk_frames(tcp, put_frame, put_error, NULL);
+
+	++ds_stacks_stats.walks;
+	ds_stacks_stats.frames += walk_depth;
+
+	return walk_depth ? intern_stack() : 0;
+}
+
+/*
+ * The stack of a syscall that replaces or ends the process, execve and
+ * the like, is gone on exit, so it is walked on entry.
+ */
+void
+ds_stacks_capture(struct tcb *const tcp)
+{
+	if (selected(tcp) && !tcp->ds_stack_id)
+		tcp->ds_stack_id = walk_stack(tcp);
+}
+
+void
+ds_stacks_claim_id(struct tcb *const tcp, void **const common_fields)
+{
+	if (!selected(tcp) || common_fields[DS_COMMON_FIELD_UNIQUE_ID])
+		return;
+
+	uint64_t *const unique_id = ds_arena_alloc(tcp, sizeof(*unique_id));
+	*unique_id = ds_next_id();
+	common_fields[DS_COMMON_FIELD_UNIQUE_ID] = unique_id;
+}
+
+/*
+ * The unique id in common_fields is the one the records ended up with,
+ * e.g. clone records use an id of their own.  The stack is walked once
+ * per syscall, and tcp->ds_stack_id is reset when the syscall is done.
+ */
+void
+ds_stacks_record(struct tcb *const tcp, void **const common_fields)
+{
+	if (!selected(tcp) || !common_fields[DS_COMMON_FIELD_UNIQUE_ID])
+		return;
+
+	ds_stacks_capture(tcp);
+	if (!tcp->ds_stack_id)
+		return;
+
+	fputc('U', stack_store);
+	ds_put_u64(stack_store,
+		   *(uint64_t *) common_fields[DS_COMMON_FIELD_UNIQUE_ID]);
+	ds_put_u64(stack_store, tcp->ds_stack_id);
+}
+
+void
+ds_stacks_finish(void)
+{
+	if (!stack_store)
+		return;
+
+	if (fclose(stack_store))
+		perror_msg("fclose");
+	stack_store = NULL;
+
+	debug_msg("DataSeries stacks: %" PRIu64 " stacks walked, %" PRIu64
+		  " frames, %zu unique stacks",
+		  ds_stacks_stats.walks, ds_stacks_stats.frames,
+		  stack_table.count);
+
+	for (size_t i = 0; i <= stack_table.mask; ++i)
+		free(stack_table.slots[i].frames);
+	free(stack_table.slots);
+	stack_table.slots = NULL;
+	free(module_written);
+	module_written = NULL;
+}
+
+#endif /* ENABLE_DATASERIES && ENABLE_STACKTRACE */
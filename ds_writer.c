@@ -0,0 +1,573 @@
+/*
+ * Asynchronous DataSeries record writer.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * By default every DataSeries record is handed to ds_write_record()
+ * while the tracee is still stopped, so the extent building and
+ * compression done by the strace2ds library add directly to the
+ * latency of each traced syscall.
+ *
+ * With --dataseries-async, the tracer only serializes the record
+ * (syscall arguments, common fields and the captured v_args buffers)
+ * into a self-contained heap block and pushes it into a bounded
+ * single-producer/single-consumer ring.  A dedicated writer thread
+ * drains the ring into ds_module.  When the ring is full, or the records
+ * in it hold DS_ASYNC_MAX_QUEUED_BYTES already, the tracer waits for the
+ * writer (backpressure), so memory usage stays bounded whatever the size
+ * of the captured buffers.
+ *
+ * The size of each v_args element is not known to the library
+ * interface, so every pointer stored in v_args has to be registered
+ * with ds_note_arg() first.  The capture helpers in util.c do that
+ * for the buffers they return, scalars use DS_SCALAR_ARG().
+ */
+
+#include "defs.h"
+
+#ifdef ENABLE_DATASERIES
+
+# include <pthread.h>
+# include <signal.h>
+# include <stdatomic.h>
+# include <stdalign.h>
+
+/* Default number of records the ring can hold. */
+# define DS_ASYNC_DEFAULT_QUEUE_DEPTH 4096
+/* Size of the records the ring can hold, unless it holds a single one. */
+# define DS_ASYNC_MAX_QUEUED_BYTES (64U << 20)
+
+enum ds_record_kind {
+	DS_RECORD_WRITE,
+	DS_RECORD_WRITE_SAME,
+	DS_RECORD_UNTRACED,
+	DS_RECORD_WARNING,
+};
+
+union ds_common_value {
+	int64_t i64;
+	uint64_t u64;
+	kernel_long_t kl;
+	kernel_ulong_t kul;
+	unsigned long ul;
+	int i;
+	void *ptr;
+};
+
+struct ds_record {
+	enum ds_record_kind kind;
+	size_t size;		/* of the whole record */
+	const char *extent_name;
+	kernel_ulong_t scno;
+	int ioctl_size;
+	unsigned int clone_ctid_index;
+	bool has_v_args;
+	kernel_ulong_t args[MAX_ARGS];
+	bool common_set[DS_NUM_COMMON_FIELDS];
+	union ds_common_value common[DS_NUM_COMMON_FIELDS];
+	/* Offsets of v_args payloads in data[], -1 for NULL. */
+	ssize_t v_off[DS_MAX_ARGS];
+	alignas(max_align_t) char data[];
+};
+
+/*
+ * Size of the value each common field points to.
+ * Zero means that the pointer itself is the value
+ * (DS_COMMON_FIELD_BUFFER_NOT_CAPTURED).
+ */
+static const uint8_t ds_common_field_size[DS_NUM_COMMON_FIELDS] = {
+	[DS_COMMON_FIELD_TIME_CALLED]	= sizeof(int64_t),
+	[DS_COMMON_FIELD_TIME_RETURNED]	= sizeof(int64_t),
+	[DS_COMMON_FIELD_RETURN_VALUE]	= sizeof(kernel_long_t),
+	[DS_COMMON_FIELD_ERRNO_NUMBER]	= sizeof(unsigned long),
+	[DS_COMMON_FIELD_EXECUTING_PID]	= sizeof(int),
+	[DS_COMMON_FIELD_EXECUTING_TID]	= sizeof(int),
+	[DS_COMMON_FIELD_UNIQUE_ID]	= sizeof(uint64_t),
+	[DS_COMMON_FIELD_SYSCALL_NUM]	= sizeof(kernel_ulong_t),
+};
+
+unsigned int ds_async_queue_depth;
+
+static struct {
+	struct ds_record **slots;
+	size_t mask;
+	atomic_size_t head;	/* next slot to be consumed by the writer */
+	atomic_size_t tail;	/* next slot to be filled by the tracer */
+	atomic_size_t bytes;	/* held by the records in the ring */
+	atomic_bool writer_sleeping;
+	atomic_bool tracer_sleeping;
+	atomic_bool stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t nonempty;
+	pthread_cond_t nonfull;
+} ds_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.nonempty = PTHREAD_COND_INITIALIZER,
+	.nonfull = PTHREAD_COND_INITIALIZER,
+};
+
+static struct {
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t stalls;
+	size_t max_depth;
+} ds_queue_stats;
+
+static bool ds_writer_running;
+static pthread_t ds_writer_thread;
+
+/* Serializes calls into ds_module made by the tracer and by the writer. */
+static pthread_mutex_t ds_module_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Tracer-side copies of the module state consumed by ds_write_record(). */
+static int staged_ioctl_size;
+static unsigned int staged_clone_ctid_index;
+
+/*
+ * The unique ids of tracer shard K start at K << DS_SHARD_ID_SHIFT, so
+ * that those of the DataSeries files of the shards do not collide.
+ */
+# define DS_SHARD_ID_SHIFT 48
+static uint64_t ds_id_base;
+
+static struct ds_noted_arg {
+	const void *ptr;
+	size_t len;
+} *noted_args;
+static size_t noted_args_count;
+static size_t noted_args_size;
+
+void *
+ds_note_arg(void *ptr, const size_t len)
+{
+	if (!ds_async_queue_depth || !ptr)
+		return ptr;
+
+	if (noted_args_count >= noted_args_size)
+		noted_args = xgrowarray(noted_args, &noted_args_size,
+					sizeof(*noted_args));
+	noted_args[noted_args_count].ptr = ptr;
+	noted_args[noted_args_count].len = len;
+	++noted_args_count;
+
+	return ptr;
+}
+
+void
+ds_forget_args(void)
+{
+	noted_args_count = 0;
+}
+
+static size_t
+lookup_noted_arg(const void *ptr)
+{
+	for (size_t i = noted_args_count; i > 0; --i) {
+		if (noted_args[i - 1].ptr == ptr)
+			return noted_args[i - 1].len;
+	}
+
+	error_func_msg_and_die("v_args pointer %p has not been noted", ptr);
+}
+
+static size_t
+align_up(const size_t size)
+{
+	return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+static struct ds_record *
+alloc_record(const enum ds_record_kind kind, const char *extent_name,
+	     const size_t data_size)
+{
+	struct ds_record *rec = xmalloc(sizeof(*rec) + data_size);
+
+	rec->kind = kind;
+	rec->size = sizeof(*rec) + data_size;
+	rec->extent_name = extent_name;
+	rec->ioctl_size = staged_ioctl_size;
+	rec->clone_ctid_index = staged_clone_ctid_index;
+	rec->has_v_args = false;
+	memset(rec->common_set, 0, sizeof(rec->common_set));
+	for (unsigned int i = 0; i < DS_MAX_ARGS; ++i)
+		rec->v_off[i] = -1;
+
+	return rec;
+}
+
+static void
+writer_write_record(struct ds_record *const rec)
+{
+	void *common_fields[DS_NUM_COMMON_FIELDS];
+	void *v_args[DS_MAX_ARGS];
+
+	for (unsigned int i = 0; i < DS_NUM_COMMON_FIELDS; ++i) {
+		if (!rec->common_set[i])
+			common_fields[i] = NULL;
+		else if (ds_common_field_size[i])
+			common_fields[i] = &rec->common[i];
+		else
+			common_fields[i] = rec->common[i].ptr;
+	}
+	for (unsigned int i = 0; i < DS_MAX_ARGS; ++i)
+		v_args[i] = rec->v_off[i] < 0 ? NULL : rec->data + rec->v_off[i];
+
+	ds_set_ioctl_size(ds_module, rec->ioctl_size);
+	ds_set_clone_ctid_index(ds_module, rec->clone_ctid_index);
+
+	if (rec->kind == DS_RECORD_WRITE_SAME)
+		ds_write_into_same_record(ds_module, rec->extent_name,
+					  rec->args, common_fields,
+					  rec->has_v_args ? v_args : NULL);
+	else
+		ds_write_record(ds_module, rec->extent_name, rec->args,
+				common_fields,
+				rec->has_v_args ? v_args : NULL);
+}
+
+static void
+writer_process_record(struct ds_record *const rec)
+{
+	pthread_mutex_lock(&ds_module_lock);
+	switch (rec->kind) {
+	case DS_RECORD_WRITE:
+	case DS_RECORD_WRITE_SAME:
+		writer_write_record(rec);
+		break;
+	case DS_RECORD_UNTRACED:
+		ds_add_to_untraced_set(ds_module, rec->extent_name, rec->scno);
+		break;
+	case DS_RECORD_WARNING:
+		ds_print_warning(ds_module, rec->extent_name, rec->scno);
+		break;
+	}
+	pthread_mutex_unlock(&ds_module_lock);
+}
+
+static void *
+writer_thread_main(void *arg)
+{
+	for (;;) {
+		const size_t head = atomic_load_explicit(&ds_queue.head,
+							 memory_order_relaxed);
+
+		if (head == atomic_load(&ds_queue.tail)) {
+			pthread_mutex_lock(&ds_queue.lock);
+			atomic_store(&ds_queue.writer_sleeping, true);
+			while (head == atomic_load(&ds_queue.tail)
+			       && !atomic_load(&ds_queue.stopping))
+				pthread_cond_wait(&ds_queue.nonempty,
+						  &ds_queue.lock);
+			atomic_store(&ds_queue.writer_sleeping, false);
+			pthread_mutex_unlock(&ds_queue.lock);
+
+			if (head == atomic_load(&ds_queue.tail))
+				break; /* stopping and drained */
+			continue;
+		}
+
+		struct ds_record *const rec = ds_queue.slots[head & ds_queue.mask];
+		const size_t size = rec->size;
+
+		writer_process_record(rec);
+		free(rec);
+		atomic_fetch_sub(&ds_queue.bytes, size);
+		atomic_store(&ds_queue.head, head + 1);
+
+		if (atomic_load(&ds_queue.tracer_sleeping)) {
+			pthread_mutex_lock(&ds_queue.lock);
+			pthread_cond_signal(&ds_queue.nonfull);
+			pthread_mutex_unlock(&ds_queue.lock);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Whether the ring has no room for a record of the given size: a record
+ * larger than DS_ASYNC_MAX_QUEUED_BYTES waits for the ring to be empty.
+ */
+static bool
+queue_full(const size_t tail, const size_t size)
+{
+	const size_t bytes = atomic_load(&ds_queue.bytes);
+
+	return tail - atomic_load(&ds_queue.head) > ds_queue.mask
+	       || (bytes && bytes + size > DS_ASYNC_MAX_QUEUED_BYTES);
+}
+
+static void
+queue_push(struct ds_record *const rec)
+{
+	const size_t tail = atomic_load_explicit(&ds_queue.tail,
+						 memory_order_relaxed);
+
+	if (queue_full(tail, rec->size)) {
+		++ds_queue_stats.stalls;
+		pthread_mutex_lock(&ds_queue.lock);
+		atomic_store(&ds_queue.tracer_sleeping, true);
+		while (queue_full(tail, rec->size))
+			pthread_cond_wait(&ds_queue.nonfull, &ds_queue.lock);
+		atomic_store(&ds_queue.tracer_sleeping, false);
+		pthread_mutex_unlock(&ds_queue.lock);
+	}
+
+	atomic_fetch_add(&ds_queue.bytes, rec->size);
+	ds_queue.slots[tail & ds_queue.mask] = rec;
+	atomic_store(&ds_queue.tail, tail + 1);
+
+	const size_t depth = tail + 1 - atomic_load(&ds_queue.head);
+	if (depth > ds_queue_stats.max_depth)
+		ds_queue_stats.max_depth = depth;
+	++ds_queue_stats.records;
+
+	if (atomic_load(&ds_queue.writer_sleeping)) {
+		pthread_mutex_lock(&ds_queue.lock);
+		pthread_cond_signal(&ds_queue.nonempty);
+		pthread_mutex_unlock(&ds_queue.lock);
+	}
+}
+
+static void
+submit_record(const enum ds_record_kind kind, const char *extent_name,
+	      kernel_ulong_t *args, void **common_fields, void **v_args)
+{
+	size_t v_len[DS_MAX_ARGS];
+	size_t data_size = 0;
+
+	for (unsigned int i = 0; i < DS_MAX_ARGS; ++i) {
+		v_len[i] = (v_args && v_args[i]) ? lookup_noted_arg(v_args[i]) : 0;
+		data_size += align_up(v_len[i]);
+	}
+
+	struct ds_record *const rec = alloc_record(kind, extent_name,
+						   data_size);
+
+	memcpy(rec->args, args, sizeof(rec->args));
+
+	for (unsigned int i = 0; i < DS_NUM_COMMON_FIELDS; ++i) {
+		if (!common_fields[i])
+			continue;
+		rec->common_set[i] = true;
+		if (ds_common_field_size[i])
+			memcpy(&rec->common[i], common_fields[i],
+			       ds_common_field_size[i]);
+		else
+			rec->common[i].ptr = common_fields[i];
+	}
+
+	if (v_args) {
+		size_t off = 0;
+
+		rec->has_v_args = true;
+		for (unsigned int i = 0; i < DS_MAX_ARGS; ++i) {
+			if (!v_args[i])
+				continue;
+			memcpy(rec->data + off, v_args[i], v_len[i]);
+			rec->v_off[i] = off;
+			off += align_up(v_len[i]);
+		}
+	}
+
+	ds_queue_stats.bytes += rec->size;
+	queue_push(rec);
+}
+
+void
+ds_submit_record(const char *extent_name, kernel_ulong_t *args,
+		 void **common_fields, void **v_args)
+{
+	uint64_t unique_id;
+	const bool own_id = ds_id_base
+			    && !common_fields[DS_COMMON_FIELD_UNIQUE_ID];
+
+	/* The library would number the record from 0. */
+	if (own_id) {
+		unique_id = ds_next_id();
+		common_fields[DS_COMMON_FIELD_UNIQUE_ID] = &unique_id;
+	}
+
+	if (ds_writer_running)
+		submit_record(DS_RECORD_WRITE, extent_name, args,
+			      common_fields, v_args);
+	else
+		ds_write_record(ds_module, extent_name, args,
+				common_fields, v_args);
+
+	if (own_id)
+		common_fields[DS_COMMON_FIELD_UNIQUE_ID] = NULL;
+}
+
+void
+ds_submit_into_same_record(const char *extent_name, kernel_ulong_t *args,
+			   void **common_fields, void **v_args)
+{
+	if (ds_writer_running)
+		submit_record(DS_RECORD_WRITE_SAME, extent_name, args,
+			      common_fields, v_args);
+	else
+		ds_write_into_same_record(ds_module, extent_name, args,
+					  common_fields, v_args);
+}
+
+void
+ds_submit_untraced(const char *sys_name, const kernel_ulong_t scno)
+{
+	if (ds_writer_running) {
+		struct ds_record *const rec =
+			alloc_record(DS_RECORD_UNTRACED, sys_name, 0);
+		rec->scno = scno;
+		queue_push(rec);
+	} else {
+		ds_add_to_untraced_set(ds_module, sys_name, scno);
+	}
+}
+
+void
+ds_submit_warning(const char *sys_name, const kernel_ulong_t scno)
+{
+	if (ds_writer_running) {
+		struct ds_record *const rec =
+			alloc_record(DS_RECORD_WARNING, sys_name, 0);
+		rec->scno = scno;
+		queue_push(rec);
+	} else {
+		ds_print_warning(ds_module, sys_name, scno);
+	}
+}
+
+void
+ds_stage_ioctl_size(const int size)
+{
+	if (ds_writer_running)
+		staged_ioctl_size = size;
+	else
+		ds_set_ioctl_size(ds_module, size);
+}
+
+int
+ds_staged_ioctl_size(void)
+{
+	return ds_writer_running ? staged_ioctl_size
+				 : (int) ds_get_ioctl_size(ds_module);
+}
+
+void
+ds_stage_clone_ctid_index(const unsigned int index)
+{
+	if (ds_writer_running)
+		staged_clone_ctid_index = index;
+	else
+		ds_set_clone_ctid_index(ds_module, index);
+}
+
+unsigned int
+ds_staged_clone_ctid_index(void)
+{
+	return ds_writer_running ? staged_clone_ctid_index
+				 : ds_get_clone_ctid_index(ds_module);
+}
+
+void
+ds_set_shard(const unsigned int shard)
+{
+	ds_id_base = (uint64_t) shard << DS_SHARD_ID_SHIFT;
+}
+
+uint64_t
+ds_next_id(void)
+{
+	if (!ds_writer_running)
+		return ds_id_base + ds_get_next_id(ds_module);
+
+	pthread_mutex_lock(&ds_module_lock);
+	const uint64_t id = ds_get_next_id(ds_module);
+	pthread_mutex_unlock(&ds_module_lock);
+
+	return ds_id_base + id;
+}
+
+void
+ds_writer_start(void)
+{
+	if (!ds_module || !ds_async_queue_depth)
+		return;
+
+	size_t size = 1;
+	while (size < ds_async_queue_depth)
+		size <<= 1;
+	ds_queue.slots = xcalloc(size, sizeof(*ds_queue.slots));
+	ds_queue.mask = size - 1;
+
+	staged_ioctl_size = ds_get_ioctl_size(ds_module);
+	staged_clone_ctid_index = ds_get_clone_ctid_index(ds_module);
+
+	/* The writer thread must not receive any of the tracer signals. */
+	sigset_t all, orig;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &orig);
+	const int rc = pthread_create(&ds_writer_thread, NULL,
+				      writer_thread_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &orig, NULL);
+	if (rc) {
+		errno = rc;
+		perror_msg_and_die("pthread_create");
+	}
+
+	ds_writer_running = true;
+	debug_msg("DataSeries writer thread started, queue depth %zu", size);
+}
+
+void
+ds_writer_finish(void)
+{
+	if (!ds_writer_running)
+		return;
+
+	pthread_mutex_lock(&ds_queue.lock);
+	atomic_store(&ds_queue.stopping, true);
+	pthread_cond_signal(&ds_queue.nonempty);
+	pthread_mutex_unlock(&ds_queue.lock);
+
+	pthread_join(ds_writer_thread, NULL);
+	ds_writer_running = false;
+
+	/* Leave the module in the state the tracer expects. */
+	ds_set_ioctl_size(ds_module, staged_ioctl_size);
+	ds_set_clone_ctid_index(ds_module, staged_clone_ctid_index);
+
+	free(ds_queue.slots);
+	ds_queue.slots = NULL;
+	free(noted_args);
+	noted_args = NULL;
+	noted_args_count = noted_args_size = 0;
+
+	debug_msg("DataSeries writer: %" PRIu64 " records, %" PRIu64
+		  " bytes queued, max queue depth %zu, %" PRIu64
+		  " backpressure stalls",
+		  ds_queue_stats.records, ds_queue_stats.bytes,
+		  ds_queue_stats.max_depth, ds_queue_stats.stalls);
+}
+
+void
+ds_set_async_queue_depth(const char *arg)
+{
+	if (!arg) {
+		ds_async_queue_depth = DS_ASYNC_DEFAULT_QUEUE_DEPTH;
+		return;
+	}
+
+	const int depth = string_to_uint_upto(arg, 1U << 24);
+	if (depth <= 0)
+		error_msg_and_help("invalid --dataseries-async argument: '%s'",
+				   arg);
+	ds_async_queue_depth = depth;
+}
+
+#endif /* ENABLE_DATASERIES */
@@ -19,6 +19,8 @@ dyxlat_alloc(const size_t nmemb)
 
 	dyxlat->xlat.type = XT_NORMAL;
 	dyxlat->xlat.size = 0;
+	/* The table grows, it cannot have a lookup index. */
+	dyxlat->xlat.index = NULL;
 	dyxlat->allocated = nmemb;
 	dyxlat->xlat.data = dyxlat->data = xgrowarray(NULL, &dyxlat->allocated,
 						      sizeof(struct xlat_data));
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * What the descriptors of the tracees refer to, as printed by -y and -yy
+ * and matched by -P: the link in /proc/PID/fd/FD, the protocol of a
+ * socket, and the type of the file.  Each of them is looked up in /proc
+ * once and kept in a table shared by the threads of a process until the
+ * descriptor is closed.
+ *
+ * A new descriptor always takes a free number, so only the syscalls that
+ * close descriptors can make an entry stale: close, dup2 and dup3, which
+ * close their target, and execve, which closes the close-on-exec ones.
+ * Syscalls that are not decoded, close_range among them, may close any
+ * descriptor, so they forget the whole table of their process, as do
+ * those that change the root or the mounts the links in /proc are
+ * relative to.  The kernel frees a number before the exit of the syscall
+ * closing it is seen, and another thread may take it and stop first, so
+ * the table is updated on both the entry and the exit of these syscalls,
+ * whether they are traced or not, and nothing is added to it in between.
+ * Renaming or unlinking a file changes the links in /proc
+ * of every process that has it open, so those syscalls forget all the
+ * tables.  A rename by a process that is not traced goes unnoticed,
+ * though, and the old path stays in the table until the descriptor is
+ * closed.
+ *
+ * This requires a stop at every syscall, so the table is not used for
+ * the processes traced with --seccomp-bpf or --seccomp-notify, nor at
+ * all with --tracer-shards, each of which sees the syscalls of only some
+ * of the threads of a process.  Neither is it used for a process that
+ * sets up an io_uring, whose requests may close descriptors without a
+ * syscall, or whose threads stop sharing their descriptors, by clone
+ * with CLONE_THREAD but not CLONE_FILES or by unshare with CLONE_FILES,
+ * nor at all once a process shares its descriptors with another one, by
+ * clone with CLONE_FILES but not CLONE_THREAD.
+ */
+
+#include "defs.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include "sen.h"
+
+/* The descriptors above this are looked up in /proc every time. */
+#define FDTABLE_MAX_FD		(1 << 20)
+#define FDTABLE_HASH_SIZE	256
+
+#if defined S390 || defined S390X
+# define CLONE_ARG_FLAGS	1
+#else
+# define CLONE_ARG_FLAGS	0
+#endif
+
+struct fdtable_entry {
+	char *path;		/* NULL if not known */
+	char *ds_path;		/* as told by syscall arguments, see ds_fds.c */
+	enum sock_proto proto;	/* SOCK_PROTO_UNKNOWN if not known */
+	unsigned int type;	/* S_IFMT bits of the file, 0 if not known */
+	dev_t rdev;
+};
+
+struct fdtable {
+	struct fdtable_entry *entry;
+	size_t size;
+	unsigned int refcount;	/* tcbs sharing the table */
+	unsigned int closing;	/* syscalls in progress that may close fds */
+	bool bypass;		/* the descriptors may change unseen */
+	int tgid;
+	struct fdtable *next;	/* in the hash chain */
+};
+
+static bool fdtable_enabled;
+static struct fdtable *fdtables[FDTABLE_HASH_SIZE];
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+} fdtable_stats;
+
+static struct fdtable **
+fdtable_bucket(const int tgid)
+{
+	return &fdtables[(unsigned int) tgid % FDTABLE_HASH_SIZE];
+}
+
+void
+fdtable_enable(void)
+{
+	fdtable_enabled = true;
+}
+
+static bool
+fdtable_usable(const struct tcb *const tcp)
+{
+	return fdtable_enabled && !(tcp->flags & TCB_SECCOMP_FILTER);
+}
+
+/* Attaches tcp to the table of its process. */
+static struct fdtable *
+get_fdtable(struct tcb *const tcp)
+{
+	if (tcp->fdtable)
+		return tcp->fdtable;
+
+	const int tgid = get_tgid(tcp->pid);
+	struct fdtable **const bucket = fdtable_bucket(tgid);
+	struct fdtable *table;
+
+	for (table = *bucket; table; table = table->next) {
+		if (table->tgid == tgid)
+			break;
+	}
+
+	if (!table) {
+		table = xcalloc(1, sizeof(*table));
+		table->tgid = tgid;
+		table->next = *bucket;
+		*bucket = table;
+	}
+
+	table->refcount++;
+	tcp->fdtable = table;
+	return table;
+}
+
+static void
+clear_entry(struct fdtable_entry *const e)
+{
+	free(e->path);
+	free(e->ds_path);
+	memset(e, 0, sizeof(*e));
+}
+
+static void
+clear_table(struct fdtable *const table)
+{
+	for (size_t i = 0; i < table->size; ++i)
+		clear_entry(&table->entry[i]);
+}
+
+static void
+end_closing(struct tcb *const tcp)
+{
+	if (!(tcp->flags & TCB_FDTABLE_CLOSING))
+		return;
+
+	tcp->flags &= ~TCB_FDTABLE_CLOSING;
+	tcp->fdtable->closing--;
+}
+
+/* Detaches tcp from its table, deleting it if it was the last user. */
+void
+fdtable_release(struct tcb *const tcp)
+{
+	struct fdtable *const table = tcp->fdtable;
+
+	if (!table)
+		return;
+
+	end_closing(tcp);
+	tcp->fdtable = NULL;
+	if (--table->refcount)
+		return;
+
+	for (struct fdtable **p = fdtable_bucket(table->tgid);
+	     *p; p = &(*p)->next) {
+		if (*p == table) {
+			*p = table->next;
+			break;
+		}
+	}
+
+	clear_table(table);
+	free(table->entry);
+	free(table);
+}
+
+/* Returns the entry of fd, or NULL if fd is not to be cached. */
+static struct fdtable_entry *
+get_entry(struct tcb *const tcp, const int fd, const bool create)
+{
+	if (!fdtable_usable(tcp) || fd < 0 || fd >= FDTABLE_MAX_FD)
+		return NULL;
+
+	struct fdtable *const table = get_fdtable(tcp);
+
+	if (table->bypass)
+		return NULL;
+
+	/* What is looked up now may be a descriptor being closed. */
+	if (create && table->closing)
+		return NULL;
+
+	if ((size_t) fd >= table->size) {
+		if (!create)
+			return NULL;
+
+		const size_t old_size = table->size;
+
+		while ((size_t) fd >= table->size)
+			table->entry = xgrowarray(table->entry, &table->size,
+						  sizeof(*table->entry));
+		memset(table->entry + old_size, 0,
+		       (table->size - old_size) * sizeof(*table->entry));
+	}
+
+	return &table->entry[fd];
+}
+
+const char *
+fdtable_lookup_path(struct tcb *const tcp, const int fd)
+{
+	const struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	if (e && e->path) {
+		fdtable_stats.hits++;
+		return e->path;
+	}
+	if (fdtable_usable(tcp))
+		fdtable_stats.misses++;
+	return NULL;
+}
+
+void
+fdtable_store_path(struct tcb *const tcp, const int fd, const char *const path)
+{
+	struct fdtable_entry *const e = get_entry(tcp, fd, true);
+
+	if (e) {
+		clear_entry(e);
+		e->path = xstrdup(path);
+	}
+}
+
+/*
+ * The paths of the descriptors of DataSeries records are kept apart
+ * from those looked up in /proc, which are the only ones -y prints
+ * and -P matches.
+ */
+const char *
+fdtable_lookup_ds_path(struct tcb *const tcp, const int fd)
+{
+	const struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	if (!e)
+		return NULL;
+	return e->ds_path ? e->ds_path : e->path;
+}
+
+void
+fdtable_store_ds_path(struct tcb *const tcp, const int fd,
+		      const char *const path)
+{
+	struct fdtable_entry *const e = get_entry(tcp, fd, true);
+
+	if (e) {
+		free(e->ds_path);
+		e->ds_path = xstrdup(path);
+	}
+}
+
+enum sock_proto
+fdtable_lookup_proto(struct tcb *const tcp, const int fd)
+{
+	const struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	return e && e->path ? e->proto : SOCK_PROTO_UNKNOWN;
+}
+
+void
+fdtable_store_proto(struct tcb *const tcp, const int fd,
+		    const enum sock_proto proto)
+{
+	struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	/* Only along with the path, which tells when it is stale. */
+	if (e && e->path)
+		e->proto = proto;
+}
+
+bool
+fdtable_lookup_type(struct tcb *const tcp, const int fd,
+		    unsigned int *const type, dev_t *const rdev)
+{
+	const struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	if (!e || !e->path || !e->type)
+		return false;
+
+	*type = e->type;
+	*rdev = e->rdev;
+	return true;
+}
+
+void
+fdtable_store_type(struct tcb *const tcp, const int fd,
+		   const unsigned int type, const dev_t rdev)
+{
+	struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	if (e && e->path) {
+		e->type = type;
+		e->rdev = rdev;
+	}
+}
+
+void
+fdtable_forget(struct tcb *const tcp, const int fd)
+{
+	struct fdtable_entry *const e = get_entry(tcp, fd, false);
+
+	if (e)
+		clear_entry(e);
+}
+
+static void
+forget_all(struct tcb *const tcp)
+{
+	clear_table(get_fdtable(tcp));
+}
+
+static void
+forget_all_tables(void)
+{
+	for (size_t i = 0; i < FDTABLE_HASH_SIZE; ++i) {
+		for (struct fdtable *t = fdtables[i]; t; t = t->next)
+			clear_table(t);
+	}
+}
+
+/* Returns the CLONE_FILES and CLONE_THREAD flags of a clone. */
+static kernel_ulong_t
+clone_fd_flags(struct tcb *const tcp)
+{
+	kernel_ulong_t flags = tcp->u_arg[CLONE_ARG_FLAGS];
+
+	if (tcp_sysent(tcp)->sen == SEN_clone3) {
+		uint64_t flags64;
+
+		/* The flags are the first field of struct clone_args. */
+		if (umove(tcp, tcp->u_arg[0], &flags64))
+			return 0;
+		flags = flags64;
+	}
+
+	return flags & (CLONE_FILES | CLONE_THREAD);
+}
+
+/* The table of tcp no longer tells the descriptors of all its threads. */
+static void
+bypass_process(struct tcb *const tcp, const char *const why)
+{
+	debug_func_msg("pid %d: %s, not caching descriptors", tcp->pid, why);
+	forget_all(tcp);
+	get_fdtable(tcp)->bypass = true;
+}
+
+/*
+ * Forgets the descriptors that the syscall tcp is in may close,
+ * returns whether there are any.
+ */
+static bool
+forget_closed(struct tcb *const tcp)
+{
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_close:
+		fdtable_forget(tcp, (int) tcp->u_arg[0]);
+		return true;
+	case SEN_dup2:
+	case SEN_dup3:
+		fdtable_forget(tcp, (int) tcp->u_arg[1]);
+		return true;
+	case SEN_chroot:
+	case SEN_execv:
+	case SEN_execve:
+	case SEN_execveat:
+	case SEN_io_uring_enter:
+	case SEN_mount:
+	case SEN_move_mount:
+	case SEN_pivotroot:
+	case SEN_printargs:
+	case SEN_setns:
+	case SEN_umount:
+	case SEN_umount2:
+		forget_all(tcp);
+		return true;
+	}
+
+	return false;
+}
+
+/* Updates the table of tcp on the entry of any syscall. */
+void
+fdtable_syscall_entering(struct tcb *const tcp)
+{
+	if (!fdtable_usable(tcp) || !forget_closed(tcp))
+		return;
+
+	get_fdtable(tcp)->closing++;
+	tcp->flags |= TCB_FDTABLE_CLOSING;
+}
+
+/* Updates the table of tcp on the exit of any syscall. */
+void
+fdtable_syscall_exiting(struct tcb *const tcp)
+{
+	if (!fdtable_usable(tcp)) {
+		end_closing(tcp);
+		return;
+	}
+
+	if (forget_closed(tcp)) {
+		end_closing(tcp);
+		return;
+	}
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_rename:
+	case SEN_renameat:
+	case SEN_renameat2:
+	case SEN_rmdir:
+	case SEN_unlink:
+	case SEN_unlinkat:
+		forget_all_tables();
+		break;
+	case SEN_io_uring_setup:
+		bypass_process(tcp, "io_uring");
+		break;
+	case SEN_unshare:
+		if (!syserror(tcp) && (tcp->u_arg[0] & CLONE_FILES))
+			bypass_process(tcp, "unshared descriptors");
+		break;
+	case SEN_clone:
+	case SEN_clone3:
+		switch (clone_fd_flags(tcp)) {
+		case CLONE_THREAD:
+			bypass_process(tcp, "thread with its own descriptors");
+			break;
+		case CLONE_FILES:
+			debug_func_msg("pid %d: shared descriptors,"
+				       " not caching descriptors", tcp->pid);
+			forget_all_tables();
+			fdtable_enabled = false;
+			break;
+		}
+		break;
+	}
+}
+
+/*
+ * Stores the descriptors created by the syscall tcp is exiting from
+ * in fds, and returns their number.
+ */
+unsigned int
+fdtable_new_fds(struct tcb *const tcp, int fds[2])
+{
+	if (syserror(tcp))
+		return 0;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_fcntl:
+	case SEN_fcntl64:
+		if (tcp->u_arg[1] != F_DUPFD
+		    && tcp->u_arg[1] != F_DUPFD_CLOEXEC)
+			return 0;
+		ATTRIBUTE_FALLTHROUGH;
+	case SEN_accept:
+	case SEN_accept4:
+	case SEN_creat:
+	case SEN_dup:
+	case SEN_dup2:
+	case SEN_dup3:
+	case SEN_epoll_create:
+	case SEN_epoll_create1:
+	case SEN_eventfd:
+	case SEN_eventfd2:
+	case SEN_fanotify_init:
+	case SEN_inotify_init:
+	case SEN_inotify_init1:
+	case SEN_memfd_create:
+	case SEN_open:
+	case SEN_open_by_handle_at:
+	case SEN_openat:
+	case SEN_perf_event_open:
+	case SEN_pidfd_open:
+	case SEN_signalfd:
+	case SEN_signalfd4:
+	case SEN_socket:
+	case SEN_timerfd_create:
+	case SEN_userfaultfd:
+		fds[0] = tcp->u_rval;
+		return 1;
+	case SEN_pipe:
+#if HAVE_ARCH_GETRVAL2
+		fds[0] = tcp->u_rval;
+		fds[1] = getrval2(tcp);
+		return 2;
+#else
+		ATTRIBUTE_FALLTHROUGH;
+#endif
+	case SEN_pipe2:
+		return umoven(tcp, tcp->u_arg[0], 2 * sizeof(*fds), fds)
+		       ? 0 : 2;
+	case SEN_socketpair:
+		return umoven(tcp, tcp->u_arg[3], 2 * sizeof(*fds), fds)
+		       ? 0 : 2;
+	}
+
+	return 0;
+}
+
+void
+print_fdtable_stats(void)
+{
+	debug_msg("descriptor table: %" PRIu64 " hits, %" PRIu64 " misses",
+		  fdtable_stats.hits, fdtable_stats.misses);
+}
@@ -24,6 +24,11 @@ static struct number_set *abbrev_set;
 static struct number_set *inject_set;
 static struct number_set *raw_set;
 static struct number_set *verbose_set;
+#ifdef ENABLE_DATASERIES
+static struct number_set *ds_capture_set;
+static struct ds_capture_policy *ds_capture_vec[SUPPORTED_PERSONALITIES];
+bool ds_capture_needs_store;
+#endif
 
 /* Only syscall numbers are personality-specific so far.  */
 struct inject_personality_data {
@@ -440,6 +445,98 @@ qualify_kvm(const char *const str)
 	}
 }
 
+#ifdef ENABLE_DATASERIES
+static bool
+parse_ds_capture_mode(const char *const token,
+		      struct ds_capture_policy *const policy)
+{
+	const char *val;
+
+	if (strcmp(token, "full") == 0) {
+		policy->mode = DS_CAPTURE_FULL;
+	} else if (strcmp(token, "none") == 0) {
+		policy->mode = DS_CAPTURE_NONE;
+	} else if (strcmp(token, "hash") == 0) {
+		policy->mode = DS_CAPTURE_HASH;
+	} else if ((val = STR_STRIP_PREFIX(token, "truncate=")) != token) {
+		const int limit = string_to_uint(val);
+		if (limit < 0)
+			return false;
+		policy->mode = DS_CAPTURE_TRUNCATE;
+		policy->limit = limit;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * SET:MODE, where MODE is one of full, none, hash, or truncate=N.
+ * Later arguments override earlier ones for the syscalls they share.
+ */
+void
+qualify_ds_capture(const char *const str)
+{
+	struct ds_capture_policy policy = { .mode = DS_CAPTURE_FULL };
+	char *copy = xstrdup(str);
+	char *saveptr = NULL;
+	const char *name = strtok_r(copy, ":", &saveptr);
+	const char *mode = name ? strtok_r(NULL, ":", &saveptr) : NULL;
+
+	if (!mode || strtok_r(NULL, ":", &saveptr)
+	    || !parse_ds_capture_mode(mode, &policy))
+		error_msg_and_die("invalid ds-capture argument '%s'", str);
+
+	struct number_set *tmp_set =
+		alloc_number_set_array(SUPPORTED_PERSONALITIES);
+	qualify_syscall_tokens(name, tmp_set);
+
+	free(copy);
+
+	if (policy.mode == DS_CAPTURE_TRUNCATE
+	    || policy.mode == DS_CAPTURE_HASH)
+		ds_capture_needs_store = true;
+
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		if (number_set_array_is_empty(tmp_set, p))
+			continue;
+
+		if (!ds_capture_set) {
+			ds_capture_set =
+				alloc_number_set_array(SUPPORTED_PERSONALITIES);
+		}
+		if (!ds_capture_vec[p]) {
+			ds_capture_vec[p] = xcalloc(nsyscall_vec[p],
+						    sizeof(*ds_capture_vec[p]));
+		}
+
+		for (unsigned int i = 0; i < nsyscall_vec[p]; ++i) {
+			if (is_number_in_set_array(i, tmp_set, p)) {
+				add_number_to_set_array(i, ds_capture_set, p);
+				ds_capture_vec[p][i] = policy;
+			}
+		}
+	}
+
+	free_number_set_array(tmp_set, SUPPORTED_PERSONALITIES);
+}
+
+const struct ds_capture_policy *
+ds_capture_policy(const struct tcb *const tcp)
+{
+	static const struct ds_capture_policy full = {
+		.mode = DS_CAPTURE_FULL
+	};
+
+	if (!is_number_in_set_array(tcp->scno, ds_capture_set,
+				    current_personality))
+		return &full;
+
+	return &ds_capture_vec[current_personality][tcp->scno];
+}
+#endif /* ENABLE_DATASERIES */
+
 static const struct qual_options {
 	const char *name;
 	void (*qualify)(const char *);
@@ -465,6 +562,9 @@ static const struct qual_options {
 	{ "fault",	qualify_fault	},
 	{ "inject",	qualify_inject	},
 	{ "kvm",	qualify_kvm	},
+#ifdef ENABLE_DATASERIES
+	{ "ds-capture",	qualify_ds_capture },
+#endif
 };
 
 void
@@ -92,6 +92,9 @@ static struct sock_fprog bpf_prog = {
 	.filter = NULL,
 };
 
+/* What the generated filters return for the traced syscalls. */
+static unsigned int seccomp_trace_action = SECCOMP_RET_TRACE;
+
 static void ATTRIBUTE_NORETURN
 check_seccomp_order_do_child(void)
 {
@@ -284,11 +287,20 @@ check_seccomp_order(void)
 static bool
 traced_by_seccomp(unsigned int scno, unsigned int p)
 {
-	if (is_number_in_set_array(scno, trace_set, p)
-	    || sysent_vec[p][scno].sys_flags
+	if (sysent_vec[p][scno].sys_flags
 	    & (TRACE_INDIRECT_SUBCALL | TRACE_SECCOMP_DEFAULT))
 		return true;
-	return false;
+	if (!is_number_in_set_array(scno, trace_set, p))
+		return false;
+# ifdef ENABLE_DATASERIES
+	/*
+	 * Stops for syscalls the DataSeries output does not record
+	 * would be thrown away, so leave them in the kernel.
+	 */
+	if (ds_module && !ds_capture_traced(&sysent_vec[p][scno]))
+		return false;
+# endif
+	return true;
 }
 
 static void
@@ -416,7 +428,7 @@ linear_filter_generator(struct sock_filter *filter, bool *overflow)
 		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
 			     SECCOMP_RET_ALLOW);
 		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
-			     SECCOMP_RET_TRACE);
+			     seccomp_trace_action);
 
 		/*
 		 * Within generated BPF programs, the origin and destination of
@@ -452,7 +464,7 @@ linear_filter_generator(struct sock_filter *filter, bool *overflow)
 
 # if SUPPORTED_PERSONALITIES > 1
 	/* Jumps conditioned on .arch default to this RET_TRACE. */
-	SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+	SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K, seccomp_trace_action);
 # endif
 
 	return pos;
@@ -566,7 +578,7 @@ binary_match_filter_generator(struct sock_filter *filter, bool *overflow)
 		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
 			     SECCOMP_RET_ALLOW);
 		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
-			     SECCOMP_RET_TRACE);
+			     seccomp_trace_action);
 
 		if (pos - start > UCHAR_MAX) {
 			*overflow = true;
@@ -589,22 +601,16 @@ binary_match_filter_generator(struct sock_filter *filter, bool *overflow)
 	}
 
 # if SUPPORTED_PERSONALITIES > 1
-	SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+	SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K, seccomp_trace_action);
 # endif
 
 	return pos;
 }
 
-static void
-check_seccomp_filter_properties(void)
+/* Picks the shortest of the generated filters, returns false if none fits. */
+static bool
+generate_seccomp_filter(void)
 {
-	int rc = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, NULL, 0, 0);
-	seccomp_filtering = rc < 0 && errno != EINVAL;
-	if (!seccomp_filtering) {
-		debug_func_perror_msg("prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER)");
-		return;
-	}
-
 	for (unsigned int i = 0; i < ARRAY_SIZE(filter_generators); ++i) {
 		bool overflow = false;
 		unsigned short len = filter_generators[i](filters[i],
@@ -617,14 +623,29 @@ check_seccomp_filter_properties(void)
 	if (bpf_prog.len == USHRT_MAX) {
 		debug_msg("seccomp filter disabled due to jump offset "
 			  "overflow");
-		seccomp_filtering = false;
+		return false;
 	} else if (bpf_prog.len > BPF_MAXINSNS) {
 		debug_msg("seccomp filter disabled due to BPF program "
 			  "being oversized (%u > %d)", bpf_prog.len,
 			  BPF_MAXINSNS);
-		seccomp_filtering = false;
+		return false;
 	}
 
+	return true;
+}
+
+static void
+check_seccomp_filter_properties(void)
+{
+	int rc = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, NULL, 0, 0);
+	seccomp_filtering = rc < 0 && errno != EINVAL;
+	if (!seccomp_filtering) {
+		debug_func_perror_msg("prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER)");
+		return;
+	}
+
+	seccomp_filtering = generate_seccomp_filter();
+
 	if (seccomp_filtering)
 		check_seccomp_order();
 }
@@ -659,6 +680,11 @@ dump_seccomp_bpf(void)
 			case SECCOMP_RET_ALLOW:
 				error_msg("STMT(BPF_RET, SECCOMP_RET_ALLOW)");
 				break;
+# ifdef SECCOMP_RET_USER_NOTIF
+			case SECCOMP_RET_USER_NOTIF:
+				error_msg("STMT(BPF_RET, SECCOMP_RET_USER_NOTIF)");
+				break;
+# endif
 			default:
 				error_msg("STMT(BPF_RET, 0x%x)", filter[i].k);
 			}
@@ -725,6 +751,49 @@ seccomp_filter_restart_operator(const struct tcb *tcp)
 	return PTRACE_CONT;
 }
 
+# ifdef HAVE_SECCOMP_NOTIFY
+
+bool
+check_seccomp_notify_filter(void)
+{
+	seccomp_trace_action = SECCOMP_RET_USER_NOTIF;
+	return generate_seccomp_filter();
+}
+
+int
+init_seccomp_notify_filter(void)
+{
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+		perror_func_msg_and_die("prctl(PR_SET_NO_NEW_PRIVS)");
+
+	if (debug_flag)
+		dump_seccomp_bpf();
+
+	/* The listener is close-on-exec, the tracer takes its own copy. */
+	int fd = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+			 SECCOMP_FILTER_FLAG_NEW_LISTENER, &bpf_prog);
+	if (fd < 0)
+		perror_func_msg_and_die("seccomp(SECCOMP_SET_MODE_FILTER, "
+					"SECCOMP_FILTER_FLAG_NEW_LISTENER)");
+	return fd;
+}
+
+int
+seccomp_arch_personality(const unsigned int arch)
+{
+#  if SUPPORTED_PERSONALITIES > 1
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		if (audit_arch_vec[p].arch == arch)
+			return p;
+	}
+	return -1;
+#  else
+	return 0;
+#  endif
+}
+
+# endif /* HAVE_SECCOMP_NOTIFY */
+
 #else /* !HAVE_LINUX_SECCOMP_H */
 
 # warning <linux/seccomp.h> is not available, seccomp filtering is not supported
@@ -751,9 +820,19 @@ seccomp_filter_restart_operator(const struct tcb *tcp)
 void
 check_seccomp_filter(void)
 {
-	/* Let's avoid enabling seccomp if all syscalls are traced. */
+	/*
+	 * Let's avoid enabling seccomp if all syscalls are traced.
+	 * DataSeries output never records all of them.
+	 */
 	seccomp_filtering = !is_complete_set_array(trace_set, nsyscall_vec,
 						   SUPPORTED_PERSONALITIES);
+#ifdef ENABLE_DATASERIES
+	if (ds_module) {
+		debug_msg("seccomp filter is derived from the DataSeries"
+			  " traced set");
+		seccomp_filtering = true;
+	}
+#endif
 	if (!seccomp_filtering) {
 		error_msg("Seccomp filter is requested "
 			  "but there are no syscalls to filter.  "
@@ -18,4 +18,38 @@ extern void check_seccomp_filter(void);
 extern void init_seccomp_filter(void);
 extern int seccomp_filter_restart_operator(const struct tcb *);
 
+# ifdef HAVE_LINUX_SECCOMP_H
+#  include <linux/seccomp.h>
+#  if defined SECCOMP_RET_USER_NOTIF \
+   && defined SECCOMP_FILTER_FLAG_NEW_LISTENER \
+   && defined SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#   define HAVE_SECCOMP_NOTIFY 1
+#  endif
+# endif
+
+extern bool seccomp_notify;
+
+# ifdef HAVE_SECCOMP_NOTIFY
+/* A syscall entry reported through the seccomp listener. */
+struct seccomp_notify_event {
+	uint64_t id;
+	int pid;
+	unsigned int arch;
+	int nr;
+	uint64_t args[6];
+};
+
+extern bool check_seccomp_notify_filter(void);
+extern int init_seccomp_notify_filter(void);
+extern int seccomp_arch_personality(unsigned int arch);
+
+extern void check_seccomp_notify(void);
+extern void seccomp_notify_attach(int pid);
+extern int seccomp_notify_receive(struct seccomp_notify_event *);
+extern void seccomp_notify_continue(uint64_t id);
+
+extern void syscall_entering_notify(struct tcb *, unsigned int personality,
+				    const struct seccomp_notify_event *);
+# endif
+
 #endif /* !STRACE_SECCOMP_FILTER_H */
@@ -0,0 +1,86 @@
+#!/bin/sh -e
+#
+# Generate the DataSeries capture table used by ds_capture.c
+# from ds_capture.in read from stdin.
+#
+# Copyright (c) 2020 The strace developers.
+# All rights reserved.
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+
+[ "x${D:-0}" != x1 ] || set -x
+
+LC_ALL=C awk '
+/^[[:space:]]*(#|$)/ { next }
+{
+	sen = $1
+	rec = $2
+	args = $0
+	sub(/^[[:space:]]*[^[:space:]]+[[:space:]]+[^[:space:]]+[[:space:]]*/, "", args)
+	sub(/[[:space:]]+$/, "", args)
+
+	alt = ""
+	if (split(rec, r, "/") == 2) {
+		rec = r[1]
+		alt = r[2]
+	}
+
+	line = "\t[SEN_" sen "] = { "
+	if (args == "untraced") {
+		line = line ".how = DS_EXIT_UNTRACED"
+	} else {
+		add_record(rec)
+		if (alt != "")
+			add_record(alt)
+
+		if (args == "custom")
+			line = line ".how = DS_EXIT_CUSTOM"
+		else if (args == "null")
+			line = line ".how = DS_EXIT_NULL_ARGS"
+		else
+			line = line ".how = DS_EXIT_ARGS"
+		line = line ", .record = DS_REC_" rec
+		if (alt != "")
+			line = line ", .alt_record = DS_REC_" alt
+
+		if (args != "custom" && args != "null" && args != "-") {
+			gsub(/path\(/, "DS_ARG_PATH(", args)
+			gsub(/name\(/, "DS_ARG_NAME(", args)
+			gsub(/buffer\(/, "DS_ARG_BUFFER(", args)
+			gsub(/payload\(/, "DS_ARG_PAYLOAD(", args)
+			gsub(/socklen\(/, "DS_ARG_SOCKLEN(", args)
+			gsub(/rval/, "DS_LEN_RVAL", args)
+			gsub(/arg\(/, "DS_LEN_ARG(", args)
+			gsub(/fixed\(/, "DS_LEN_FIXED(", args)
+			line = line ",\n\t\t.v = { " args " }"
+		}
+	}
+	table[++ntable] = line " },"
+}
+function add_record(name) {
+	if (!(name in seen)) {
+		seen[name] = 1
+		records[++nrecords] = name
+	}
+}
+END {
+	print "/* Generated by generate_ds_capture.sh from ds_capture.in; do not edit. */"
+	print ""
+	print "enum ds_record_type {"
+	print "\tDS_REC_NONE,"
+	for (i = 1; i <= nrecords; ++i)
+		print "\tDS_REC_" records[i] ","
+	print "\tDS_REC_COUNT"
+	print "};"
+	print ""
+	print "static const char *const ds_record_names[DS_REC_COUNT] = {"
+	for (i = 1; i <= nrecords; ++i)
+		print "\t[DS_REC_" records[i] "] = \"" records[i] "\","
+	print "};"
+	print ""
+	print "static const struct ds_capture_desc ds_capture_table[] = {"
+	for (i = 1; i <= ntable; ++i)
+		print table[i]
+	print "};"
+}
+'
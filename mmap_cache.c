@@ -13,7 +13,55 @@
 #include "mmap_notify.h"
 #include "xstring.h"
 
-static unsigned int mmap_cache_generation;
+/*
+ * The caches, hashed by the thread group id.  All the threads of a
+ * process share its address space, so they share a cache, and a change
+ * of the mappings made by one of them invalidates the cache of its
+ * process only.  Tracer shards see the changes made by some of the
+ * threads of a process only, so they do not keep the caches.
+ */
+#define MMAP_CACHE_HASH_SIZE	256
+static struct mmap_cache_t *mmap_caches[MMAP_CACHE_HASH_SIZE];
+static bool mmap_cache_disabled;
+
+static struct mmap_cache_t **
+mmap_cache_bucket(const int tgid)
+{
+	return &mmap_caches[(unsigned int) tgid % MMAP_CACHE_HASH_SIZE];
+}
+
+static void release_mmap_cache(struct tcb *, const char *caller);
+
+/* Attaches tcp to the cache of its address space. */
+static struct mmap_cache_t *
+get_mmap_cache(struct tcb *tcp)
+{
+	if (tcp->mmap_cache)
+		return tcp->mmap_cache;
+
+	const int tgid = get_tgid(tcp->pid);
+	struct mmap_cache_t **const bucket = mmap_cache_bucket(tgid);
+	struct mmap_cache_t *cache;
+
+	for (cache = *bucket; cache; cache = cache->next) {
+		if (cache->tgid == tgid)
+			break;
+	}
+
+	if (!cache) {
+		cache = xcalloc(1, sizeof(*cache));
+		cache->free_fn = release_mmap_cache;
+		cache->tgid = tgid;
+		/* Not built yet. */
+		cache->mm_generation = 1;
+		cache->next = *bucket;
+		*bucket = cache;
+	}
+
+	cache->refcount++;
+	tcp->mmap_cache = cache;
+	return cache;
+}
 
 static void
 mmap_cache_invalidate(struct tcb *tcp, void *unused)
@@ -24,11 +72,12 @@ mmap_cache_invalidate(struct tcb *tcp, void *unused)
 		return;
 	}
 #endif
-	mmap_cache_generation++;
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p",
-		       tcp->mmap_cache ? tcp->mmap_cache->generation : 0,
-		       mmap_cache_generation, tcp,
-		       tcp->mmap_cache ? tcp->mmap_cache->entry : 0);
+	struct mmap_cache_t *const cache = get_mmap_cache(tcp);
+
+	cache->mm_generation++;
+	debug_func_msg("tgid=%d, gen=%u, mmgen=%u, tcp=%p, cache=%p",
+		       cache->tgid, cache->generation, cache->mm_generation,
+		       tcp, cache->entry);
 }
 
 void
@@ -42,29 +91,133 @@ mmap_cache_enable(void)
 	}
 }
 
-/* deleting the cache */
+void
+mmap_cache_disable(void)
+{
+	mmap_cache_disabled = true;
+}
+
+static void
+delete_mmap_cache_entries(struct mmap_cache_t *cache)
+{
+	while (cache->size) {
+		unsigned int i = --cache->size;
+		free(cache->entry[i].binary_filename);
+		cache->entry[i].binary_filename = NULL;
+	}
+
+	free(cache->entry);
+	cache->entry = NULL;
+}
+
+/* detaching tcp from the cache, deleting it if it was the last user */
 static void
-delete_mmap_cache(struct tcb *tcp, const char *caller)
+release_mmap_cache(struct tcb *tcp, const char *caller)
 {
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, caller=%s",
-		       tcp->mmap_cache ? tcp->mmap_cache->generation : 0,
-		       mmap_cache_generation, tcp,
-		       tcp->mmap_cache ? tcp->mmap_cache->entry : 0, caller);
+	struct mmap_cache_t *const cache = tcp->mmap_cache;
 
-	if (!tcp->mmap_cache)
+	if (!cache)
 		return;
 
-	while (tcp->mmap_cache->size) {
-		unsigned int i = --tcp->mmap_cache->size;
-		free(tcp->mmap_cache->entry[i].binary_filename);
-		tcp->mmap_cache->entry[i].binary_filename = NULL;
+	debug_func_msg("tgid=%d, refcount=%u, tcp=%p, cache=%p, caller=%s",
+		       cache->tgid, cache->refcount, tcp, cache->entry, caller);
+
+	tcp->mmap_cache = NULL;
+	if (--cache->refcount)
+		return;
+
+	for (struct mmap_cache_t **p = mmap_cache_bucket(cache->tgid);
+	     *p; p = &(*p)->next) {
+		if (*p == cache) {
+			*p = cache->next;
+			break;
+		}
 	}
 
-	free(tcp->mmap_cache->entry);
-	tcp->mmap_cache->entry = NULL;
+	delete_mmap_cache_entries(cache);
+	free(cache);
+}
 
-	free(tcp->mmap_cache);
-	tcp->mmap_cache = NULL;
+struct maps_line {
+	unsigned long start_addr, end_addr, mmap_offset;
+	unsigned long major, minor, inode;
+	char read_bit, write_bit, exec_bit, shared_bit;
+	const char *binary_path;
+};
+
+static const char *
+parse_hex(const char *p, unsigned long *const val)
+{
+	const char *const start = p;
+	unsigned long v = 0;
+
+	for (;; ++p) {
+		unsigned int digit;
+
+		if (*p >= '0' && *p <= '9')
+			digit = *p - '0';
+		else if ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'f')
+			digit = (*p | 0x20) - 'a' + 10;
+		else
+			break;
+		v = v * 16 + digit;
+	}
+
+	*val = v;
+	return p > start ? p : NULL;
+}
+
+static const char *
+skip_spaces(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		++p;
+	return p;
+}
+
+/*
+ * Parses a line of /proc/PID/maps,
+ * "start-end perms offset major:minor inode pathname",
+ * stripping its newline.  Lines without a pathname are not accepted.
+ */
+static bool
+parse_maps_line(char *const line, struct maps_line *const m)
+{
+	const char *p = line;
+
+	if (!(p = parse_hex(p, &m->start_addr)) || *p++ != '-'
+	    || !(p = parse_hex(p, &m->end_addr)))
+		return false;
+
+	p = skip_spaces(p);
+	if (!p[0] || !p[1] || !p[2] || !p[3])
+		return false;
+	m->read_bit = p[0];
+	m->write_bit = p[1];
+	m->exec_bit = p[2];
+	m->shared_bit = p[3];
+	p += 4;
+
+	if (!(p = parse_hex(skip_spaces(p), &m->mmap_offset))
+	    || !(p = parse_hex(skip_spaces(p), &m->major)) || *p++ != ':'
+	    || !(p = parse_hex(p, &m->minor)))
+		return false;
+
+	p = skip_spaces(p);
+	if (*p < '0' || *p > '9')
+		return false;
+	for (m->inode = 0; *p >= '0' && *p <= '9'; ++p)
+		m->inode = m->inode * 10 + (*p - '0');
+
+	p = skip_spaces(p);
+	char *const end = strchr(p, '\n');
+	if (end)
+		*end = '\0';
+	if (!*p)
+		return false;
+	m->binary_path = p;
+
+	return true;
 }
 
 /*
@@ -76,13 +229,17 @@ delete_mmap_cache(struct tcb *tcp, const char *caller)
 extern enum mmap_cache_rebuild_result
 mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
 {
-	if (tcp->mmap_cache
-	    && tcp->mmap_cache->generation != mmap_cache_generation)
-		delete_mmap_cache(tcp, caller);
+	struct mmap_cache_t *const cache = get_mmap_cache(tcp);
 
-	if (tcp->mmap_cache)
+	if (cache->generation == cache->mm_generation && !mmap_cache_disabled)
 		return MMAP_CACHE_REBUILD_READY;
 
+	debug_func_msg("tgid=%d, gen=%u, mmgen=%u, tcp=%p, cache=%p, caller=%s",
+		       cache->tgid, cache->generation, cache->mm_generation,
+		       tcp, cache->entry, caller);
+
+	delete_mmap_cache_entries(cache);
+
 	char filename[sizeof("/proc/4294967296/maps")];
 	xsprintf(filename, "/proc/%u/maps", tcp->pid);
 
@@ -92,43 +249,27 @@ mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
 		return MMAP_CACHE_REBUILD_NOCACHE;
 	}
 
-	struct mmap_cache_t cache = {
-		.free_fn = delete_mmap_cache,
-		.generation = mmap_cache_generation
-	};
-
 	/* start with a small dynamically-allocated array and then expand it */
 	size_t allocated = 0;
 	char buffer[PATH_MAX + 80];
 
 	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		unsigned long start_addr, end_addr, mmap_offset;
-		char read_bit;
-		char write_bit;
-		char exec_bit;
-		char shared_bit;
-		unsigned long major, minor;
-		char binary_path[sizeof(buffer)];
-
-		if (sscanf(buffer, "%lx-%lx %c%c%c%c %lx %lx:%lx %*d %[^\n]",
-			   &start_addr, &end_addr,
-			   &read_bit, &write_bit, &exec_bit, &shared_bit,
-			   &mmap_offset,
-			   &major, &minor,
-			   binary_path) != 10)
+		struct maps_line m;
+
+		if (!parse_maps_line(buffer, &m))
 			continue;
 
 		/* skip mappings that have unknown protection */
-		if (!(read_bit == '-' || read_bit == 'r'))
+		if (!(m.read_bit == '-' || m.read_bit == 'r'))
 			continue;
-		if (!(write_bit == '-' || write_bit == 'w'))
+		if (!(m.write_bit == '-' || m.write_bit == 'w'))
 			continue;
-		if (!(exec_bit == '-' || exec_bit == 'x'))
+		if (!(m.exec_bit == '-' || m.exec_bit == 'x'))
 			continue;
-		if (!(shared_bit == 'p' || shared_bit == 's'))
+		if (!(m.shared_bit == 'p' || m.shared_bit == 's'))
 			continue;
 
-		if (end_addr < start_addr) {
+		if (m.end_addr < m.start_addr) {
 			error_msg("%s: unrecognized file format", filename);
 			break;
 		}
@@ -138,56 +279,57 @@ mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
 		 * sanity check to make sure that we're storing
 		 * non-overlapping regions in ascending order
 		 */
-		if (cache.size > 0) {
-			entry = &cache.entry[cache.size - 1];
-			if (entry->start_addr == start_addr &&
-			    entry->end_addr == end_addr) {
+		if (cache->size > 0) {
+			entry = &cache->entry[cache->size - 1];
+			if (entry->start_addr == m.start_addr &&
+			    entry->end_addr == m.end_addr) {
 				/* duplicate entry, e.g. [vsyscall] */
 				continue;
 			}
-			if (start_addr <= entry->start_addr ||
-			    start_addr < entry->end_addr) {
+			if (m.start_addr <= entry->start_addr ||
+			    m.start_addr < entry->end_addr) {
 				debug_msg("%s: overlapping memory region: "
 					  "\"%s\" [%08lx-%08lx] overlaps with "
 					  "\"%s\" [%08lx-%08lx]",
-					  filename, binary_path, start_addr,
-					  end_addr, entry->binary_filename,
+					  filename, m.binary_path,
+					  m.start_addr, m.end_addr,
+					  entry->binary_filename,
 					  entry->start_addr, entry->end_addr);
 				continue;
 			}
 		}
 
-		if (cache.size >= allocated)
-			cache.entry = xgrowarray(cache.entry, &allocated,
-						 sizeof(*cache.entry));
+		if (cache->size >= allocated)
+			cache->entry = xgrowarray(cache->entry, &allocated,
+						  sizeof(*cache->entry));
 
-		entry = &cache.entry[cache.size];
-		entry->start_addr = start_addr;
-		entry->end_addr = end_addr;
-		entry->mmap_offset = mmap_offset;
+		entry = &cache->entry[cache->size];
+		entry->start_addr = m.start_addr;
+		entry->end_addr = m.end_addr;
+		entry->mmap_offset = m.mmap_offset;
 		entry->protections = (
 			0
-			| ((read_bit   == 'r')? MMAP_CACHE_PROT_READABLE  : 0)
-			| ((write_bit  == 'w')? MMAP_CACHE_PROT_WRITABLE  : 0)
-			| ((exec_bit   == 'x')? MMAP_CACHE_PROT_EXECUTABLE: 0)
-			| ((shared_bit == 's')? MMAP_CACHE_PROT_SHARED    : 0)
+			| ((m.read_bit   == 'r')? MMAP_CACHE_PROT_READABLE  : 0)
+			| ((m.write_bit  == 'w')? MMAP_CACHE_PROT_WRITABLE  : 0)
+			| ((m.exec_bit   == 'x')? MMAP_CACHE_PROT_EXECUTABLE: 0)
+			| ((m.shared_bit == 's')? MMAP_CACHE_PROT_SHARED    : 0)
 			);
-		entry->major = major;
-		entry->minor = minor;
-		entry->binary_filename = xstrdup(binary_path);
-		cache.size++;
+		entry->major = m.major;
+		entry->minor = m.minor;
+		entry->inode = m.inode;
+		entry->binary_filename = xstrdup(m.binary_path);
+		cache->size++;
 	}
 	fclose(fp);
 
-	if (!cache.size)
+	if (!cache->size)
 		return MMAP_CACHE_REBUILD_NOCACHE;
 
-	tcp->mmap_cache = xmalloc(sizeof(*tcp->mmap_cache));
-	memcpy(tcp->mmap_cache, &cache, sizeof(cache));
+	cache->generation = cache->mm_generation;
 
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, caller=%s",
-		       tcp->mmap_cache->generation, mmap_cache_generation,
-		       tcp, tcp->mmap_cache->entry, caller);
+	debug_func_msg("tgid=%d, gen=%u, tcp=%p, cache=%p, size=%u, caller=%s",
+		       cache->tgid, cache->generation, tcp, cache->entry,
+		       cache->size, caller);
 
 	return MMAP_CACHE_REBUILD_RENEWED;
 }
@@ -10,13 +10,20 @@
 /*
  * Keep a sorted array of cache entries,
  * so that we can binary search through it.
+ *
+ * There is one cache for each address space, shared by the tcbs of
+ * the threads of a process.
  */
 
 struct mmap_cache_t {
 	struct mmap_cache_entry_t *entry;
 	void (*free_fn)(struct tcb *, const char *caller);
 	unsigned int size;
-	unsigned int generation;
+	unsigned int generation;	/* of the mappings in entry */
+	unsigned int mm_generation;	/* bumped on every mapping change */
+	unsigned int refcount;		/* tcbs sharing the cache */
+	int tgid;
+	struct mmap_cache_t *next;	/* in the hash chain */
 };
 
 struct mmap_cache_entry_t {
@@ -30,6 +37,7 @@ struct mmap_cache_entry_t {
 	 * protections is MMAP_CACHE_PROT_READABLE|MMAP_CACHE_PROT_EXECUTABLE
 	 * major       is 0xfc
 	 * minor       is 0x00
+	 * inode       is 1180246
 	 * binary_filename is "/lib/libc-2.11.1.so"
 	 */
 	unsigned long start_addr;
@@ -37,6 +45,7 @@ struct mmap_cache_entry_t {
 	unsigned long mmap_offset;
 	unsigned char protections;
 	unsigned long major, minor;
+	unsigned long inode;
 	char *binary_filename;
 };
 
@@ -58,6 +67,13 @@ typedef bool (*mmap_cache_search_fn)(struct mmap_cache_entry_t *, void *);
 extern void
 mmap_cache_enable(void);
 
+/*
+ * Makes the maps be read again every time they are looked up,
+ * for the tracers that do not see every change of them.
+ */
+extern void
+mmap_cache_disable(void);
+
 extern enum mmap_cache_rebuild_result
 mmap_cache_rebuild_if_invalid(struct tcb *, const char *caller);
 
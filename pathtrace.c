@@ -86,14 +86,27 @@ getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
 	if (fd < 0)
 		return -1;
 
+	const char *cached = fdtable_lookup_path(tcp, fd);
+	if (cached) {
+		n = strlen(cached);
+		if ((size_t) n >= bufsize)
+			n = bufsize - 1;
+		memcpy(buf, cached, n);
+		buf[n] = '\0';
+		return n;
+	}
+
 	xsprintf(linkpath, "/proc/%u/fd/%u", tcp->pid, fd);
 	n = readlink(linkpath, buf, bufsize - 1);
 	/*
 	 * NB: if buf is too small, readlink doesn't fail,
 	 * it returns truncated result (IOW: n == bufsize - 1).
 	 */
-	if (n >= 0)
+	if (n >= 0) {
 		buf[n] = '\0';
+		if ((size_t) n < bufsize - 1)
+			fdtable_store_path(tcp, fd, buf);
+	}
 	return n;
 }
 
@@ -0,0 +1,244 @@
+/*
+ * Where the tracer spends its time.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With --profile-tracer, the time of the tracer is split into phases:
+ * waiting for the tracees, fetching the syscall registers, decoding,
+ * reading tracee memory, formatting and writing the output, DataSeries
+ * capture, and restarting the tracee.  The code entering a phase calls
+ * profile_enter() and restores the previous one with profile_leave(),
+ * so nested phases, e.g. the memory reads of a decoder, are accounted
+ * for exclusively.  The time of a stop, from the end of one wait4 to
+ * the beginning of the next, is charged to the syscall the stop was for,
+ * and a table like that of -c is printed on exit.  When the option is
+ * not given, every hook is a single test of profile_tracer.
+ */
+
+#include "defs.h"
+
+struct profile_counts {
+	uint64_t stops;
+	uint64_t ns[PROFILE_PHASES];
+};
+
+bool profile_tracer;
+
+static const char *const phase_names[PROFILE_PHASES] = {
+	[PROFILE_OTHER]		= "other",
+	[PROFILE_WAIT]		= "wait",
+	[PROFILE_REGS]		= "regs",
+	[PROFILE_DECODE]	= "decode",
+	[PROFILE_UMOVE]		= "umove",
+	[PROFILE_OUTPUT]	= "output",
+	[PROFILE_DATASERIES]	= "ds",
+	[PROFILE_RESTART]	= "restart",
+};
+
+/* Per-syscall counts for each personality, allocated on demand. */
+static struct profile_counts *countv[SUPPORTED_PERSONALITIES];
+/* Stops that are not syscall stops: signals, exits, and the like. */
+static struct profile_counts other_stops;
+/* Time spent waiting for the tracees, which belongs to no stop. */
+static uint64_t wait_ns, wait_calls;
+
+/* The phase being timed, since when, and the time of the current stop. */
+static enum profile_phase cur_phase = PROFILE_OTHER;
+static int64_t cur_since;
+static uint64_t pending_ns[PROFILE_PHASES];
+static struct profile_counts *pending_counts;
+
+static int64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+enum profile_phase
+profile_switch(const enum profile_phase phase)
+{
+	const enum profile_phase prev = cur_phase;
+	const int saved_errno = errno;
+	const int64_t now = now_ns();
+
+	if (cur_since && now > cur_since) {
+		if (prev == PROFILE_WAIT)
+			wait_ns += now - cur_since;
+		else
+			pending_ns[prev] += now - cur_since;
+	}
+	if (phase == PROFILE_WAIT && prev != PROFILE_WAIT)
+		++wait_calls;
+
+	cur_phase = phase;
+	cur_since = now;
+	errno = saved_errno;
+	return prev;
+}
+
+void
+profile_syscall_stop(struct tcb *tcp)
+{
+	if (!scno_in_range(tcp->scno))
+		return;
+
+	if (!countv[current_personality])
+		countv[current_personality] =
+			xcalloc(nsyscalls, sizeof(struct profile_counts));
+	pending_counts = &countv[current_personality][tcp->scno];
+}
+
+void
+profile_stop_done(void)
+{
+	uint64_t sum = 0;
+
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i)
+		sum += pending_ns[i];
+	if (!sum && !pending_counts)
+		return;
+
+	struct profile_counts *const pc =
+		pending_counts ? pending_counts : &other_stops;
+
+	++pc->stops;
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i)
+		pc->ns[i] += pending_ns[i];
+
+	memset(pending_ns, 0, sizeof(pending_ns));
+	pending_counts = NULL;
+}
+
+static uint64_t
+counts_total(const struct profile_counts *const pc)
+{
+	uint64_t sum = 0;
+
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i)
+		sum += pc->ns[i];
+	return sum;
+}
+
+static const struct profile_counts *sort_counts;
+
+static int
+total_cmp(const void *a, const void *b)
+{
+	const uint64_t ta = counts_total(&sort_counts[*(const unsigned int *) a]);
+	const uint64_t tb = counts_total(&sort_counts[*(const unsigned int *) b]);
+
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static void
+print_row(FILE *outf, const struct profile_counts *const pc,
+	  const double total_ns, const char *const name)
+{
+	const uint64_t ns = counts_total(pc);
+
+	fprintf(outf, "%6.2f %11.6f %9" PRIu64,
+		total_ns ? 100.0 * ns / total_ns : 0.0, ns / 1e9, pc->stops);
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i) {
+		if (i == PROFILE_WAIT)
+			continue;
+		fprintf(outf, " %7.2f",
+			pc->stops ? pc->ns[i] / 1e3 / pc->stops : 0.0);
+	}
+	fprintf(outf, " %s\n", name);
+}
+
+static void
+print_dashes(FILE *outf)
+{
+	static const char dashes[] = "----------------";
+
+	fprintf(outf, "%6.6s %11.11s %9.9s", dashes, dashes, dashes);
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i) {
+		if (i != PROFILE_WAIT)
+			fprintf(outf, " %7.7s", dashes);
+	}
+	fprintf(outf, " %s\n", dashes);
+}
+
+static void
+profile_summary_pers(FILE *outf, const struct profile_counts *const counts,
+		     const bool with_other)
+{
+	struct profile_counts total = { .stops = 0 };
+	unsigned int *const sorted = xcalloc(nsyscalls, sizeof(*sorted));
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; counts && i < nsyscalls; ++i) {
+		if (!counts[i].stops)
+			continue;
+		sorted[n++] = i;
+		total.stops += counts[i].stops;
+		for (unsigned int p = 0; p < PROFILE_PHASES; ++p)
+			total.ns[p] += counts[i].ns[p];
+	}
+	if (with_other) {
+		total.stops += other_stops.stops;
+		for (unsigned int p = 0; p < PROFILE_PHASES; ++p)
+			total.ns[p] += other_stops.ns[p];
+	}
+	sort_counts = counts;
+	qsort(sorted, n, sizeof(*sorted), total_cmp);
+
+	const double total_ns = counts_total(&total);
+
+	fprintf(outf, "%6.6s %11.11s %9.9s", "% time", "seconds", "stops");
+	for (unsigned int i = 0; i < PROFILE_PHASES; ++i) {
+		if (i != PROFILE_WAIT)
+			fprintf(outf, " %7.7s", phase_names[i]);
+	}
+	fprintf(outf, " %s\n", "syscall");
+	print_dashes(outf);
+	for (unsigned int i = 0; i < n; ++i)
+		print_row(outf, &counts[sorted[i]], total_ns,
+			  sysent[sorted[i]].sys_name);
+	if (with_other && other_stops.stops)
+		print_row(outf, &other_stops, total_ns, "(other stops)");
+	print_dashes(outf);
+	print_row(outf, &total, total_ns, "total");
+
+	free(sorted);
+}
+
+void
+profile_summary(FILE *outf)
+{
+	const unsigned int old_pers = current_personality;
+	bool with_other = true;
+
+	profile_switch(PROFILE_OTHER);
+	profile_stop_done();
+
+	fprintf(outf, "Tracer time per stop (usecs) by phase:\n");
+	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!countv[i])
+			continue;
+
+		if (current_personality != i)
+			set_personality(i);
+		if (i)
+			fprintf(outf, "Tracer time for %s mode:\n",
+				personality_names[i]);
+		profile_summary_pers(outf, countv[i], with_other);
+		with_other = false;
+	}
+	if (with_other && other_stops.stops)
+		profile_summary_pers(outf, NULL, with_other);
+	fprintf(outf, "Waiting for tracees: %.6f s in %" PRIu64 " waits\n",
+		wait_ns / 1e9, wait_calls);
+
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+}
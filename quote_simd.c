@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With -s 65536 -xx or -e write=all, quoting and dumping the strings
+ * takes more of the time of the tracer than anything else.  The work is
+ * a few byte classifications and the hexadecimal encoding, which x86-64
+ * does 16 bytes at a time with SSE2, its baseline, and 32 at a time with
+ * AVX2 where the CPU has it.  The tails shorter than a vector, and the
+ * other architectures, take the scalar path.
+ *
+ * Bytes are compared as signed: those above 0x7f are negative, so that
+ * "greater than 0x1f and less than 0x7f" leaves them out as it should.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "macros.h"
+#include "print_utils.h"
+#include "quote_simd.h"
+
+#if defined __x86_64__ && (defined __clang__ || __GNUC__ >= 5)
+# define QUOTE_SIMD_X86 1
+# include <immintrin.h>
+# define ATTRIBUTE_AVX2 __attribute__((target("avx2")))
+#endif
+
+struct quote_simd_ops {
+	const char *name;
+	bool (*supported)(void);
+	size_t (*span_plain)(const unsigned char *, size_t);
+	size_t (*span_verbatim)(const unsigned char *, size_t);
+	char *(*hex_escape)(char *, const unsigned char *, size_t);
+	char *(*hex_pairs)(char *, const unsigned char *, size_t);
+	char *(*print_or_dot)(char *, const unsigned char *, size_t);
+};
+
+static bool
+supported_always(void)
+{
+	return true;
+}
+
+/* Scalar implementation. */
+
+static inline bool
+is_plain(const uint8_t c)
+{
+	/* In ASCII isspace is only these chars: "\t\n\v\f\r". */
+	return is_print(c) || (unsigned int) (c - '\t') <= '\r' - '\t';
+}
+
+static inline bool
+is_verbatim(const uint8_t c)
+{
+	return is_print(c) && c != '\"' && c != '\\';
+}
+
+static size_t
+span_plain_scalar(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size && is_plain(str[i]); ++i)
+		;
+	return i;
+}
+
+static size_t
+span_verbatim_scalar(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size && is_verbatim(str[i]); ++i)
+		;
+	return i;
+}
+
+static char *
+hex_escape_scalar(char *dst, const unsigned char *const str, const size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		*dst++ = '\\';
+		*dst++ = 'x';
+		dst = sprint_byte_hex(dst, str[i]);
+	}
+	return dst;
+}
+
+static char *
+hex_pairs_scalar(char *dst, const unsigned char *const str, const size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		dst = sprint_byte_hex(dst, str[i]);
+	return dst;
+}
+
+static char *
+print_or_dot_scalar(char *dst, const unsigned char *const str,
+		    const size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		*dst++ = is_print(str[i]) ? str[i] : '.';
+	return dst;
+}
+
+static const struct quote_simd_ops quote_scalar = {
+	.name = "scalar",
+	.supported = supported_always,
+	.span_plain = span_plain_scalar,
+	.span_verbatim = span_verbatim_scalar,
+	.hex_escape = hex_escape_scalar,
+	.hex_pairs = hex_pairs_scalar,
+	.print_or_dot = print_or_dot_scalar,
+};
+
+#ifdef QUOTE_SIMD_X86
+
+/* SSE2 implementation. */
+
+static inline __m128i
+printable_sse2(const __m128i v)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ' - 1)),
+			     _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+}
+
+/* The hexadecimal digits of the nibbles in v. */
+static inline __m128i
+hex_digits_sse2(const __m128i v)
+{
+	const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)),
+					     _mm_set1_epi8('a' - '0' - 10));
+
+	return _mm_add_epi8(_mm_add_epi8(v, _mm_set1_epi8('0')), letter);
+}
+
+/* The digit pairs of the bytes 0..7 of v in lo, of the bytes 8..15 in hi. */
+static inline void
+hex_pairs_sse2_vec(const __m128i v, __m128i *const lo, __m128i *const hi)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i high = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(v, 4),
+							   nibble));
+	const __m128i low = hex_digits_sse2(_mm_and_si128(v, nibble));
+
+	*lo = _mm_unpacklo_epi8(high, low);
+	*hi = _mm_unpackhi_epi8(high, low);
+}
+
+static size_t
+span_plain_sse2(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		const __m128i v = _mm_loadu_si128((const void *) (str + i));
+		const __m128i space =
+			_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+				      _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+		const unsigned int mask =
+			_mm_movemask_epi8(_mm_or_si128(printable_sse2(v),
+						       space));
+
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + span_plain_scalar(str + i, size - i);
+}
+
+static size_t
+span_verbatim_sse2(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		const __m128i v = _mm_loadu_si128((const void *) (str + i));
+		const __m128i special =
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		const unsigned int mask =
+			_mm_movemask_epi8(_mm_andnot_si128(special,
+							   printable_sse2(v)));
+
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + span_verbatim_scalar(str + i, size - i);
+}
+
+static char *
+hex_escape_sse2(char *dst, const unsigned char *const str, const size_t size)
+{
+	/* "\x" as the first two bytes of each 32-bit lane. */
+	const __m128i prefix = _mm_set1_epi16('\\' | ('x' << 8));
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i lo, hi;
+
+		hex_pairs_sse2_vec(_mm_loadu_si128((const void *) (str + i)),
+				   &lo, &hi);
+		_mm_storeu_si128((void *) dst, _mm_unpacklo_epi16(prefix, lo));
+		_mm_storeu_si128((void *) (dst + 16),
+				 _mm_unpackhi_epi16(prefix, lo));
+		_mm_storeu_si128((void *) (dst + 32),
+				 _mm_unpacklo_epi16(prefix, hi));
+		_mm_storeu_si128((void *) (dst + 48),
+				 _mm_unpackhi_epi16(prefix, hi));
+		dst += 64;
+	}
+	return hex_escape_scalar(dst, str + i, size - i);
+}
+
+static char *
+hex_pairs_sse2(char *dst, const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		__m128i lo, hi;
+
+		hex_pairs_sse2_vec(_mm_loadu_si128((const void *) (str + i)),
+				   &lo, &hi);
+		_mm_storeu_si128((void *) dst, lo);
+		_mm_storeu_si128((void *) (dst + 16), hi);
+		dst += 32;
+	}
+	return hex_pairs_scalar(dst, str + i, size - i);
+}
+
+static char *
+print_or_dot_sse2(char *dst, const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16) {
+		const __m128i v = _mm_loadu_si128((const void *) (str + i));
+		const __m128i printable = printable_sse2(v);
+
+		_mm_storeu_si128((void *) dst,
+				 _mm_or_si128(_mm_and_si128(printable, v),
+					      _mm_andnot_si128(printable,
+							_mm_set1_epi8('.'))));
+		dst += 16;
+	}
+	return print_or_dot_scalar(dst, str + i, size - i);
+}
+
+static const struct quote_simd_ops quote_sse2 = {
+	.name = "sse2",
+	.supported = supported_always,
+	.span_plain = span_plain_sse2,
+	.span_verbatim = span_verbatim_sse2,
+	.hex_escape = hex_escape_sse2,
+	.hex_pairs = hex_pairs_sse2,
+	.print_or_dot = print_or_dot_sse2,
+};
+
+/*
+ * AVX2 implementation.  Only the long runs benefit from the wider vectors:
+ * dumpstr works a line of 16 bytes at a time, so the SSE2 functions are
+ * kept for it.
+ */
+
+static bool
+avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+ATTRIBUTE_AVX2 static inline __m256i
+printable_avx2(const __m256i v)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(' ' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), v));
+}
+
+ATTRIBUTE_AVX2 static inline __m256i
+hex_digits_avx2(const __m256i v)
+{
+	const __m256i letter =
+		_mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(9)),
+				 _mm256_set1_epi8('a' - '0' - 10));
+
+	return _mm256_add_epi8(_mm256_add_epi8(v, _mm256_set1_epi8('0')),
+			       letter);
+}
+
+ATTRIBUTE_AVX2 static size_t
+span_plain_avx2(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const void *) (str + i));
+		const __m256i space =
+			_mm256_and_si256(_mm256_cmpgt_epi8(v,
+						_mm256_set1_epi8('\t' - 1)),
+					 _mm256_cmpgt_epi8(
+						_mm256_set1_epi8('\r' + 1), v));
+		const uint32_t mask =
+			_mm256_movemask_epi8(_mm256_or_si256(printable_avx2(v),
+							     space));
+
+		if (mask != 0xffffffff)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + span_plain_sse2(str + i, size - i);
+}
+
+ATTRIBUTE_AVX2 static size_t
+span_verbatim_avx2(const unsigned char *const str, const size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const void *) (str + i));
+		const __m256i special =
+			_mm256_or_si256(_mm256_cmpeq_epi8(v,
+						_mm256_set1_epi8('\"')),
+					_mm256_cmpeq_epi8(v,
+						_mm256_set1_epi8('\\')));
+		const uint32_t mask =
+			_mm256_movemask_epi8(_mm256_andnot_si256(special,
+							printable_avx2(v)));
+
+		if (mask != 0xffffffff)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + span_verbatim_sse2(str + i, size - i);
+}
+
+ATTRIBUTE_AVX2 static char *
+hex_escape_avx2(char *dst, const unsigned char *const str, const size_t size)
+{
+	const __m256i prefix = _mm256_set1_epi16('\\' | ('x' << 8));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const void *) (str + i));
+		const __m256i high =
+			hex_digits_avx2(_mm256_and_si256(_mm256_srli_epi16(v, 4),
+							 nibble));
+		const __m256i low = hex_digits_avx2(_mm256_and_si256(v, nibble));
+		/*
+		 * The unpacks work within the 128-bit lanes, so the results
+		 * hold the bytes 0..7 and 16..23, and 8..15 and 24..31.
+		 */
+		const __m256i lo = _mm256_unpacklo_epi8(high, low);
+		const __m256i hi = _mm256_unpackhi_epi8(high, low);
+		/* Bytes 0..3 and 16..19, 4..7 and 20..23, and so on. */
+		const __m256i q0 = _mm256_unpacklo_epi16(prefix, lo);
+		const __m256i q1 = _mm256_unpackhi_epi16(prefix, lo);
+		const __m256i q2 = _mm256_unpacklo_epi16(prefix, hi);
+		const __m256i q3 = _mm256_unpackhi_epi16(prefix, hi);
+
+		_mm256_storeu_si256((void *) dst,
+				    _mm256_permute2x128_si256(q0, q1, 0x20));
+		_mm256_storeu_si256((void *) (dst + 32),
+				    _mm256_permute2x128_si256(q2, q3, 0x20));
+		_mm256_storeu_si256((void *) (dst + 64),
+				    _mm256_permute2x128_si256(q0, q1, 0x31));
+		_mm256_storeu_si256((void *) (dst + 96),
+				    _mm256_permute2x128_si256(q2, q3, 0x31));
+		dst += 128;
+	}
+	return hex_escape_sse2(dst, str + i, size - i);
+}
+
+static const struct quote_simd_ops quote_avx2 = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.span_plain = span_plain_avx2,
+	.span_verbatim = span_verbatim_avx2,
+	.hex_escape = hex_escape_avx2,
+	.hex_pairs = hex_pairs_sse2,
+	.print_or_dot = print_or_dot_sse2,
+};
+
+#endif /* QUOTE_SIMD_X86 */
+
+/* The implementations, the best first. */
+static const struct quote_simd_ops *const quote_impls[] = {
+#ifdef QUOTE_SIMD_X86
+	&quote_avx2,
+	&quote_sse2,
+#endif
+	&quote_scalar,
+};
+
+static const struct quote_simd_ops *quote_ops;
+
+static const struct quote_simd_ops *
+get_quote_ops(void)
+{
+	if (!quote_ops) {
+		for (size_t i = 0; !quote_ops; ++i) {
+			if (quote_impls[i]->supported())
+				quote_ops = quote_impls[i];
+		}
+	}
+	return quote_ops;
+}
+
+int
+quote_simd_select(const char *const name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(quote_impls); ++i) {
+		if (!strcmp(quote_impls[i]->name, name)) {
+			if (!quote_impls[i]->supported())
+				return -1;
+			quote_ops = quote_impls[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *
+quote_simd_name(void)
+{
+	return get_quote_ops()->name;
+}
+
+size_t
+quote_span_plain(const unsigned char *const str, const size_t size)
+{
+	return get_quote_ops()->span_plain(str, size);
+}
+
+size_t
+quote_span_verbatim(const unsigned char *const str, const size_t size)
+{
+	return get_quote_ops()->span_verbatim(str, size);
+}
+
+char *
+quote_hex_escape(char *const dst, const unsigned char *const str,
+		 const size_t size)
+{
+	return get_quote_ops()->hex_escape(dst, str, size);
+}
+
+char *
+quote_hex_pairs(char *const dst, const unsigned char *const str,
+		const size_t size)
+{
+	return get_quote_ops()->hex_pairs(dst, str, size);
+}
+
+char *
+quote_print_or_dot(char *const dst, const unsigned char *const str,
+		   const size_t size)
+{
+	return get_quote_ops()->print_or_dot(dst, str, size);
+}
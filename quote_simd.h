@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_QUOTE_SIMD_H
+# define STRACE_QUOTE_SIMD_H
+
+# include <stddef.h>
+
+/*
+ * The byte loops of string_quote and dumpstr, vectorised where the CPU
+ * allows it.  All the implementations produce the same output.
+ */
+
+/*
+ * Returns the length of the leading run of str[0..size) that -x prints
+ * as is: printable ASCII characters and whitespace.
+ */
+extern size_t quote_span_plain(const unsigned char *str, size_t size);
+
+/*
+ * Returns the length of the leading run of str[0..size) that
+ * string_quote copies verbatim: printable ASCII characters other than
+ * the double quote and the backslash.
+ */
+extern size_t quote_span_verbatim(const unsigned char *str, size_t size);
+
+/* Writes "\xHH" for each byte of str[0..size), returns the end of dst. */
+extern char *quote_hex_escape(char *dst, const unsigned char *str, size_t size);
+
+/* Writes "HH" for each byte of str[0..size), returns the end of dst. */
+extern char *quote_hex_pairs(char *dst, const unsigned char *str, size_t size);
+
+/*
+ * Writes each byte of str[0..size) that is printable ASCII as is,
+ * and '.' for each other one, returns the end of dst.
+ */
+extern char *quote_print_or_dot(char *dst, const unsigned char *str,
+				size_t size);
+
+/*
+ * Selects the implementation called "scalar", "sse2" or "avx2",
+ * returns 0 on success, -1 if it is not supported by the CPU or build.
+ * The best supported one is used by default.
+ */
+extern int quote_simd_select(const char *name);
+
+/* Returns the name of the implementation in use. */
+extern const char *quote_simd_name(void);
+
+#endif /* !STRACE_QUOTE_SIMD_H */
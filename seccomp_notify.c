@@ -0,0 +1,216 @@
+/*
+ * Tracing through seccomp user notifications.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With --seccomp-notify the tracee is not ptraced at all.  Right before
+ * executing PROG it installs the filter built by filter_seccomp.c, with
+ * SECCOMP_RET_USER_NOTIF for the traced syscalls, and the tracer takes
+ * its own copy of the listener with pidfd_getfd.  Every traced syscall
+ * of the tracee and its descendants then waits until the tracer has
+ * received it from the listener, decoded it, and let it proceed with
+ * SECCOMP_USER_NOTIF_FLAG_CONTINUE: one round trip through the
+ * listener instead of two ptrace stops, each with a wait4 and register
+ * reads.
+ *
+ * Only syscall entries are seen this way: there are no return values,
+ * no signals, and arguments decoded on exit are not available.  Tracee
+ * memory is read with process_vm_readv.
+ */
+
+#include "defs.h"
+#include "filter_seccomp.h"
+
+bool seccomp_notify;
+
+#ifdef HAVE_SECCOMP_NOTIFY
+
+# include <dirent.h>
+# include <poll.h>
+# include <signal.h>
+# include <sys/ioctl.h>
+# include <sys/wait.h>
+# include "kill_save_errno.h"
+# include "scno.h"
+# include "xstring.h"
+
+# ifndef __NR_pidfd_getfd
+/* pidfd_getfd follows pidfd_open by 4 in every syscall table. */
+#  define __NR_pidfd_getfd (__NR_pidfd_open + 4)
+# endif
+
+/* How long to wait for the tracee to install its filter, in ms. */
+# define SECCOMP_NOTIFY_ATTACH_TIMEOUT	10000
+
+static int listener = -1;
+static struct seccomp_notif *notif;
+static size_t notif_size;
+static struct seccomp_notif_resp *resp;
+static size_t resp_size;
+
+void
+check_seccomp_notify(void)
+{
+	struct seccomp_notif_sizes sizes;
+
+	if (syscall(__NR_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) < 0)
+		perror_msg_and_die("--seccomp-notify is not supported:"
+				   " seccomp(SECCOMP_GET_NOTIF_SIZES)");
+
+	/* The kernel may use larger structures than we know of. */
+	notif_size = MAX(sizes.seccomp_notif, sizeof(*notif));
+	resp_size = MAX(sizes.seccomp_notif_resp, sizeof(*resp));
+	notif = xzalloc(notif_size);
+	resp = xzalloc(resp_size);
+
+	if (!check_seccomp_notify_filter())
+		error_msg_and_die("--seccomp-notify: too many system calls"
+				  " to filter");
+}
+
+static int
+find_listener_fd(const int pid)
+{
+	static const char fd_path[] = "/proc/%d/fd";
+	char path[sizeof(fd_path) + sizeof(int) * 3];
+	DIR *dir;
+	struct dirent *de;
+	int ret = -1;
+
+	xsprintf(path, fd_path, pid);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while (ret < 0 && (de = readdir(dir)) != NULL) {
+		static const char listener_link[] = "anon_inode:seccomp notify";
+		char link[sizeof(fd_path) + sizeof(int) * 6];
+		char target[sizeof(listener_link) + 1];
+
+		const int fd = string_to_uint(de->d_name);
+		if (fd < 0)
+			continue;
+
+		xsprintf(link, "%s/%d", path, fd);
+		const ssize_t n = readlink(link, target, sizeof(target) - 1);
+		if (n < 0)
+			continue;
+		target[n] = '\0';
+		if (!strcmp(target, listener_link))
+			ret = fd;
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/*
+ * Takes a copy of the listener of the filter that the child installs
+ * in exec_or_die().  The child does not wait for us before that, but
+ * its execve is a traced syscall, so it cannot get any further.
+ */
+void
+seccomp_notify_attach(const int pid)
+{
+	const int pidfd = syscall(__NR_pidfd_open, pid, 0);
+	int fd = -1;
+
+	if (pidfd < 0) {
+		kill_save_errno(pid, SIGKILL);
+		perror_msg_and_die("pidfd_open");
+	}
+
+	for (unsigned int ms = 0; (fd = find_listener_fd(pid)) < 0; ++ms) {
+		int status;
+
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			error_msg_and_die("--seccomp-notify: the tracee exited"
+					  " before installing the filter");
+		if (ms >= SECCOMP_NOTIFY_ATTACH_TIMEOUT) {
+			kill(pid, SIGKILL);
+			error_msg_and_die("--seccomp-notify: timed out waiting"
+					  " for the tracee to install the"
+					  " filter");
+		}
+		usleep(1000);
+	}
+
+	listener = syscall(__NR_pidfd_getfd, pidfd, fd, 0);
+	if (listener < 0) {
+		kill_save_errno(pid, SIGKILL);
+		perror_msg_and_die("pidfd_getfd");
+	}
+	close(pidfd);
+
+	debug_msg("seccomp listener of pid %d is fd %d, ours is %d",
+		  pid, fd, listener);
+}
+
+/*
+ * Returns 1 with the next syscall entry in ev, 0 when no process is left
+ * that uses the filter, or -1 if interrupted by a signal.
+ */
+int
+seccomp_notify_receive(struct seccomp_notify_event *const ev)
+{
+	struct pollfd pfd = { .fd = listener, .events = POLLIN };
+
+	for (;;) {
+		const enum profile_phase prev = profile_enter(PROFILE_WAIT);
+		const int rc = poll(&pfd, 1, -1);
+		profile_leave(prev);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				return -1;
+			perror_msg_and_die("poll");
+		}
+
+		if (!(pfd.revents & POLLIN)) {
+			if (pfd.revents & (POLLHUP | POLLERR))
+				return 0;
+			continue;
+		}
+
+		memset(notif, 0, notif_size);
+		if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, notif) < 0) {
+			if (errno == EINTR)
+				return -1;
+			/* The syscall was interrupted before we got to it. */
+			if (errno == ENOENT)
+				continue;
+			perror_msg_and_die("ioctl(SECCOMP_IOCTL_NOTIF_RECV)");
+		}
+
+		ev->id = notif->id;
+		ev->pid = notif->pid;
+		ev->arch = notif->data.arch;
+		ev->nr = notif->data.nr;
+		for (unsigned int i = 0; i < ARRAY_SIZE(ev->args); ++i)
+			ev->args[i] = notif->data.args[i];
+		return 1;
+	}
+}
+
+void
+seccomp_notify_continue(const uint64_t id)
+{
+	memset(resp, 0, resp_size);
+	resp->id = id;
+	resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+
+	const enum profile_phase prev = profile_enter(PROFILE_RESTART);
+	const int rc = ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+	profile_leave(prev);
+
+	/* ENOENT: the syscall has been interrupted in the meantime. */
+	if (rc < 0 && errno != ENOENT)
+		perror_msg_and_die("ioctl(SECCOMP_IOCTL_NOTIF_SEND)");
+}
+
+#endif /* HAVE_SECCOMP_NOTIFY */
@@ -254,7 +254,7 @@ MPERS_PRINTER_DECL(int, sock_ioctl,
 			char *str = xmalloc(max_strlen + 1);
 			umovestr(tcp, arg, max_strlen + 1, str);
 			u_int len = strlen(str) + 1;
-			ds_set_ioctl_size(ds_module, len);
+			ds_stage_ioctl_size(len);
 			free(str);
 		}
 #endif /* ENABLE_DATASERIES */
@@ -9,36 +9,52 @@
 /*
  * open_memstream returns a FILE stream that allows writing to a
  * dynamically growing buffer, that can be either copied to
- * tcp->outf (syscall successful) or dropped (syscall failed)
+ * tcp->outf (syscall successful) or dropped (syscall failed).
+ *
+ * The stream is opened on the first syscall of a tcb and rewound
+ * for each of the next ones, so that staging the output of a syscall
+ * costs no allocation once the buffer has grown to fit.
  */
 
 #include "defs.h"
 
 struct staged_output_data {
+	FILE *memf;
 	char *memfptr;
 	size_t memfloc;
 	FILE *real_outf;	/* Backup for real outf while staging */
 };
 
+bool
+strace_output_staged(const struct tcb *tcp)
+{
+	return tcp->staged_output_data && tcp->staged_output_data->real_outf;
+}
+
 FILE *
 strace_open_memstream(struct tcb *tcp)
 {
 	FILE *fp = NULL;
 
 #if HAVE_OPEN_MEMSTREAM
-	tcp->staged_output_data = xmalloc(sizeof(*tcp->staged_output_data));
-	fp = open_memstream(&tcp->staged_output_data->memfptr,
-			    &tcp->staged_output_data->memfloc);
-	if (!fp)
-		perror_msg_and_die("open_memstream");
-	/*
-	 * Call to fflush required to update tcp->memfptr,
-	 * see open_memstream man page.
-	 */
-	fflush(fp);
+	struct staged_output_data *sod = tcp->staged_output_data;
+
+	if (!sod) {
+		sod = xcalloc(1, sizeof(*sod));
+		sod->memf = open_memstream(&sod->memfptr, &sod->memfloc);
+		if (!sod->memf)
+			perror_msg_and_die("open_memstream");
+		tcp->staged_output_data = sod;
+	} else if (sod->real_outf) {
+		debug_msg("memstream already open");
+		return sod->memf;
+	} else {
+		rewind(sod->memf);
+	}
+	fp = sod->memf;
 
 	/* Store the FILE pointer for later restoration. */
-	tcp->staged_output_data->real_outf = tcp->outf;
+	sod->real_outf = tcp->outf;
 	tcp->outf = fp;
 #endif
 
@@ -49,27 +65,48 @@ void
 strace_close_memstream(struct tcb *tcp, bool publish)
 {
 #if HAVE_OPEN_MEMSTREAM
-	if (!tcp->staged_output_data) {
+	struct staged_output_data *const sod = tcp->staged_output_data;
+
+	if (!sod || !sod->real_outf) {
 		debug_msg("memstream already closed");
 		return;
 	}
 
-	if (fclose(tcp->outf))
-		perror_msg("fclose(tcp->outf)");
+	/* Call to fflush required to update memfptr and memfloc. */
+	if (fflush(sod->memf))
+		perror_msg("fflush(tcp->outf)");
 
-	tcp->outf = tcp->staged_output_data->real_outf;
-	if (tcp->staged_output_data->memfptr) {
-		if (publish)
-			fputs_unlocked(tcp->staged_output_data->memfptr,
-				       tcp->outf);
-		else
-			debug_msg("syscall output dropped: %s",
-				  tcp->staged_output_data->memfptr);
+	tcp->outf = sod->real_outf;
+	sod->real_outf = NULL;
+	if (publish)
+		fwrite(sod->memfptr, 1, sod->memfloc, tcp->outf);
+	else
+		debug_msg("syscall output dropped: %.*s",
+			  (int) sod->memfloc, sod->memfptr);
+#endif
+}
 
-		free(tcp->staged_output_data->memfptr);
-		tcp->staged_output_data->memfptr = NULL;
-	}
-	free(tcp->staged_output_data);
+void
+strace_free_memstream(struct tcb *tcp)
+{
+	struct staged_output_data *const sod = tcp->staged_output_data;
+
+	if (!sod)
+		return;
+
+	if (sod->real_outf)
+		tcp->outf = sod->real_outf;
+	if (fclose(sod->memf))
+		perror_msg("fclose(memstream)");
+	free(sod->memfptr);
+	free(sod);
 	tcp->staged_output_data = NULL;
-#endif
+}
+
+/* Returns the stream the output of tcp is published to. */
+FILE *
+strace_unstaged_outf(const struct tcb *tcp)
+{
+	return strace_output_staged(tcp) ? tcp->staged_output_data->real_outf
+					 : tcp->outf;
 }
@@ -0,0 +1,207 @@
+/*
+ * Stop-to-restart latency of tracees.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * With --stop-latency, the time from the moment a stop of a tracee is
+ * collected by wait4 to the moment the tracee is restarted is put into
+ * a per-tcb log2 histogram.  This is the time the tracee spends stopped
+ * because of the tracer: decoding, printing, and waiting for the other
+ * tracees that stopped at the same time to be handled first.  A summary
+ * for each tracee and a histogram for all of them are printed on exit.
+ */
+
+#include "defs.h"
+
+/* Bucket N counts latencies of [2^N, 2^(N+1)) nanoseconds. */
+#define STOP_LATENCY_BUCKETS	48
+
+struct stop_latency {
+	int64_t stop_ns;	/* time of the pending stop, 0 if none */
+	uint64_t max_ns;
+	uint64_t count;
+	uint64_t buckets[STOP_LATENCY_BUCKETS];
+};
+
+struct stop_latency_entry {
+	int pid;
+	uint64_t p50, p90, p99;
+	struct stop_latency *sl;
+};
+
+bool stop_latency_enabled;
+
+/* Histograms of the tcbs that have been dropped. */
+static struct stop_latency_entry *finished;
+static size_t finished_size, nfinished;
+
+static int64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+stop_latency_stopped(struct tcb *const tcp)
+{
+	if (!tcp->stop_latency)
+		tcp->stop_latency = xcalloc(1, sizeof(*tcp->stop_latency));
+	tcp->stop_latency->stop_ns = now_ns();
+}
+
+void
+stop_latency_restarted(struct tcb *const tcp)
+{
+	struct stop_latency *const sl = tcp->stop_latency;
+
+	if (!sl || !sl->stop_ns)
+		return;
+
+	const int64_t d = now_ns() - sl->stop_ns;
+	const uint64_t ns = d > 0 ? d : 0;
+	unsigned int b = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	if (b >= STOP_LATENCY_BUCKETS)
+		b = STOP_LATENCY_BUCKETS - 1;
+	++sl->buckets[b];
+	++sl->count;
+	if (ns > sl->max_ns)
+		sl->max_ns = ns;
+	sl->stop_ns = 0;
+}
+
+void
+stop_latency_drop(struct tcb *const tcp)
+{
+	if (!tcp->stop_latency)
+		return;
+
+	if (tcp->stop_latency->count) {
+		if (nfinished >= finished_size)
+			finished = xgrowarray(finished, &finished_size,
+					      sizeof(*finished));
+		finished[nfinished].pid = tcp->pid;
+		finished[nfinished].sl = tcp->stop_latency;
+		++nfinished;
+	} else {
+		free(tcp->stop_latency);
+	}
+	tcp->stop_latency = NULL;
+}
+
+/*
+ * Returns the upper bound of the bucket the given percentile falls in,
+ * or the maximum if that is lower.
+ */
+static uint64_t
+percentile(const struct stop_latency *const sl, const unsigned int pct)
+{
+	const uint64_t rank = (sl->count * pct + 99) / 100;
+	uint64_t cum = 0;
+
+	for (unsigned int b = 0; b < STOP_LATENCY_BUCKETS; ++b) {
+		cum += sl->buckets[b];
+		if (cum >= rank && cum) {
+			const uint64_t bound = 2ULL << b;
+			return bound < sl->max_ns ? bound : sl->max_ns;
+		}
+	}
+	return sl->max_ns;
+}
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+	const struct stop_latency_entry *const ea = a;
+	const struct stop_latency_entry *const eb = b;
+
+	if (ea->p99 != eb->p99)
+		return ea->p99 < eb->p99 ? 1 : -1;
+	if (ea->sl->max_ns != eb->sl->max_ns)
+		return ea->sl->max_ns < eb->sl->max_ns ? 1 : -1;
+	return ea->pid - eb->pid;
+}
+
+static void
+print_histogram(FILE *outf, const struct stop_latency *const sl)
+{
+	unsigned int first = STOP_LATENCY_BUCKETS, last = 0;
+	uint64_t peak = 0;
+
+	for (unsigned int b = 0; b < STOP_LATENCY_BUCKETS; ++b) {
+		if (!sl->buckets[b])
+			continue;
+		if (first == STOP_LATENCY_BUCKETS)
+			first = b;
+		last = b;
+		if (sl->buckets[b] > peak)
+			peak = sl->buckets[b];
+	}
+
+	fprintf(outf, "%23s : %-11s\n", "nsecs", "stops");
+	for (unsigned int b = first; b <= last && peak; ++b) {
+		char bar[41];
+		const unsigned int len = sl->buckets[b] * 40 / peak;
+
+		memset(bar, '*', len);
+		bar[len] = '\0';
+		fprintf(outf, "%10llu -> %-10llu : %-11" PRIu64 " |%-40s|\n",
+			b ? 1ULL << b : 0ULL, (2ULL << b) - 1,
+			sl->buckets[b], bar);
+	}
+}
+
+void
+stop_latency_summary(FILE *outf)
+{
+	static const char dashes[]  = "----------------";
+	static const char header[]  = "%11.11s %11.11s %11.11s %11.11s %11.11s %s\n";
+	static const char data[]    = "%11" PRIu64 " %11.3f %11.3f %11.3f %11.3f %d\n";
+	static const char summary[] = "%11" PRIu64 " %11.3f %11.3f %11.3f %11.3f %s\n";
+
+	if (!nfinished)
+		return;
+
+	struct stop_latency total = { .count = 0 };
+
+	for (size_t i = 0; i < nfinished; ++i) {
+		struct stop_latency_entry *const e = &finished[i];
+
+		e->p50 = percentile(e->sl, 50);
+		e->p90 = percentile(e->sl, 90);
+		e->p99 = percentile(e->sl, 99);
+
+		for (unsigned int b = 0; b < STOP_LATENCY_BUCKETS; ++b)
+			total.buckets[b] += e->sl->buckets[b];
+		total.count += e->sl->count;
+		if (e->sl->max_ns > total.max_ns)
+			total.max_ns = e->sl->max_ns;
+	}
+
+	qsort(finished, nfinished, sizeof(*finished), entry_cmp);
+
+	fprintf(outf, "Stop-to-restart latency (usecs):\n");
+	fprintf(outf, header, "stops", "p50", "p90", "p99", "max", "pid");
+	fprintf(outf, header, dashes, dashes, dashes, dashes, dashes, dashes);
+	for (size_t i = 0; i < nfinished; ++i) {
+		const struct stop_latency_entry *const e = &finished[i];
+
+		fprintf(outf, data, e->sl->count,
+			e->p50 / 1e3, e->p90 / 1e3, e->p99 / 1e3,
+			e->sl->max_ns / 1e3, e->pid);
+	}
+	fprintf(outf, header, dashes, dashes, dashes, dashes, dashes, dashes);
+	fprintf(outf, summary, total.count,
+		percentile(&total, 50) / 1e3, percentile(&total, 90) / 1e3,
+		percentile(&total, 99) / 1e3, total.max_ns / 1e3, "total");
+	fputc('\n', outf);
+	print_histogram(outf, &total);
+}
@@ -42,6 +42,7 @@
 #include "number_set.h"
 #include "ptrace_syscall_info.h"
 #include "scno.h"
+#include "sen.h"
 #include "printsiginfo.h"
 #include "trace_event.h"
 #include "xstring.h"
@@ -129,6 +130,20 @@ unsigned int show_fd_path;
 
 static bool detach_on_execve;
 
+/*
+ * With --tracer-shards=N, the threads attached with -p are split between
+ * N tracer processes, and tracer_shard is the index of this one.
+ */
+#define MAX_TRACER_SHARDS 1024
+static unsigned int tracer_shards;
+static unsigned int tracer_shard;
+
+/* The order the stops collected by one next_event() harvest are handled in. */
+static enum {
+	EVENT_ORDER_FIFO,		/* as wait4 returned them */
+	EVENT_ORDER_ROUND_ROBIN,	/* least recently dispatched first */
+} event_order;
+
 static int exit_code;
 static int strace_child;
 static int strace_tracer_pid;
@@ -147,6 +162,15 @@ enum xlat_style xlat_verbosity = XLAT_STYLE_ABBREV;
 static const char *outfname;
 /* If -ff, points to stderr. Else, it's our common output log */
 static FILE *shared_log;
+/* Size of the output buffers if --output-buffer is given, 0 otherwise */
+static unsigned int output_buffer_size;
+/* Buffered output is flushed at most this long after it is written */
+#define OUTPUT_FLUSH_INTERVAL_MS 200
+/* Whether there is buffered output, and since when */
+static bool output_pending;
+static struct timespec output_pending_since;
+/* With -ff, the tcbs with buffered output, linked through output_list */
+static EMPTY_LIST(pending_output_tcps);
 #ifdef ENABLE_DATASERIES
 DataSeriesOutputModule *ds_module = NULL;
 #endif /* ENABLE_DATASERIES */
@@ -165,6 +189,18 @@ struct tcb_wait_data {
 static struct tcb **tcbtab;
 static unsigned int nprocs;
 static size_t tcbtabsize;
+/* Free tcbs, linked through next_free. */
+static struct tcb *free_tcbs;
+
+/*
+ * Open addressing pid -> tcb hash table with linear probing,
+ * kept at most half full.
+ */
+static struct {
+	struct tcb **slots;
+	size_t mask;
+	size_t count;
+} pid_tab;
 
 static struct tcb_wait_data *tcb_wait_tab;
 static size_t tcb_wait_tab_size;
@@ -187,6 +223,8 @@ static volatile int interrupted, restart_failed;
 #endif
 
 static sigset_t timer_set;
+/* SIGCHLD, blocked with --output-buffer for wait_for_stop to wait for */
+static sigset_t chld_set;
 static void timer_sighandler(int);
 
 #ifndef HAVE_STRERROR
@@ -271,10 +309,16 @@ Output format:\n\
 #ifdef ENABLE_STACKTRACE
 "\
   -k             obtain stack trace between each syscall\n\
+  --stack-trace-cache=FILE\n\
+                 keep the symbols of the -k stack traces in FILE\n\
+                 across runs\n\
 "
 #endif
 "\
   -o file        send trace output to FILE instead of stderr\n\
+  --output-buffer=SIZE\n\
+                 buffer up to SIZE bytes of the output to FILE, writing it\n\
+                 when full or 0.2 seconds after it is produced\n\
   -q             suppress messages about attaching, detaching, etc.\n\
   -qq            suppress messages about process exit status as well.\n\
   -r             print relative timestamp\n\
@@ -298,6 +342,9 @@ Statistics:\n\
   -S sortby      sort syscall counts by: time, calls, errors, name, nothing\n\
                  (default %s)\n\
   -w             summarise syscall latency (default is system time)\n\
+  --stop-latency summarise how long tracees stay stopped by the tracer\n\
+  --profile-tracer\n\
+                 summarise where the tracer spends its time, per syscall\n\
 \n\
 Filtering:\n\
   -e expr        a qualifying expression: option=[!]all or option=[!]val1[,val2]...\n\
@@ -320,22 +367,60 @@ Tracing:\n\
      3:          fatal signals are always blocked (default if '-o FILE PROG')\n\
      4:          fatal signals and SIGTSTP (^Z) are always blocked\n\
                  (useful to make 'strace -o FILE PROG' not stop on ^Z)\n\
+  --event-order=ORDER\n\
+                 order to handle simultaneous stops in: fifo (the order\n\
+                 wait4 reports them, default) or round-robin\n\
 \n\
 Startup:\n\
   -E var         remove var from the environment for command\n\
   -E var=val     put var=val in the environment for command\n\
   -p pid         trace process with process id PID, may be repeated\n\
+  --tracer-shards=N\n\
+                 split the threads of processes attached with -p between\n\
+                 N tracer processes, implies -f, merging their outputs\n\
+                 into -o FILE (DataSeries output: shard K to DSFILE.K,\n\
+                 with unique ids from K * 2^48)\n\
   -u username    run command as username handling setuid and/or setgid\n\
 \n\
 Miscellaneous:\n\
   --seccomp-bpf  enable seccomp-bpf filtering\n\
+  --seccomp-notify\n\
+                 trace syscall entries of PROG through seccomp user\n\
+                 notifications instead of ptrace (experimental)\n\
   -d             enable debug output to stderr\n\
   -h, --help     print help message\n\
   -V, --version  print version\n\
 "
 #ifdef ENABLE_DATASERIES
 "  --dataseries DSFILE      write DataSeries output to DSFILE instead of human readable to stderr (experimental)\n\
+  --dataseries-async[=DEPTH]\n\
+                 write DataSeries records from a separate thread, queueing\n\
+                 up to DEPTH records (default 4096) and 64MiB\n\
+  --dataseries-dedup[=SIZE]\n\
+                 store read and write payloads as SIZE-byte chunks, each\n\
+                 unique chunk once, in DSFILE.chunks (default 4096)\n\
+  --dataseries-buffer-limit=SIZE\n\
+                 capture at most SIZE bytes of the buffers of a syscall\n\
+                 in memory, stream the rest to DSFILE.chunks in pieces\n\
+                 of at most 1MiB (default: no limit)\n\
+  --dataseries-fds\n\
+                 record the paths the descriptors created by open, openat,\n\
+                 creat, dup* and fcntl F_DUPFD refer to, in DSFILE.fds\n\
+  --dataseries-clock=MODE\n\
+                 how to timestamp records: realtime (read CLOCK_REALTIME\n\
+                 on every stop, the default), or calibrated (derive it\n\
+                 from CLOCK_MONOTONIC, calibrations go to DSFILE.clock)\n\
+  --ds-capture=SET:MODE\n\
+                 how much of the data buffers of syscalls in SET to capture:\n\
+                 full, truncate=N, hash, or none\n\
 "
+# ifdef ENABLE_STACKTRACE
+"\
+  --ds-stacks=SET\n\
+                 record the stack traces of the syscalls in SET, in\n\
+                 DSFILE.stacks (implies -k, which records them all)\n\
+"
+# endif
 #endif /* ENABLE_DATASERIES */
 /* ancient, no one should use it
 -F -- attempt to follow vforks (deprecated, use -f)\n\
@@ -403,9 +488,14 @@ ptrace_restart(const unsigned int op, struct tcb *const tcp, unsigned int sig)
 {
 	int err;
 
+	if (stop_latency_enabled)
+		stop_latency_restarted(tcp);
+
+	const enum profile_phase prev = profile_enter(PROFILE_RESTART);
 	errno = 0;
 	ptrace(op, tcp->pid, 0L, (unsigned long) sig);
 	err = errno;
+	profile_leave(prev);
 	if (!err || err == ESRCH)
 		return 0;
 
@@ -466,13 +556,13 @@ swap_uid(void)
 	}
 }
 
-static FILE *
-strace_fopen(const char *path)
+FILE *
+strace_fopen(const char *path, const char *mode)
 {
 	FILE *fp;
 
 	swap_uid();
-	fp = fopen_stream(path, open_append ? "a" : "w");
+	fp = fopen_stream(path, mode);
 	if (!fp)
 		perror_msg_and_die("Can't fopen '%s'", path);
 	swap_uid();
@@ -556,7 +646,9 @@ tvprintf(const char *const fmt, va_list args)
 		return;
 #endif /* ENABLE_DATASERIES */
 	if (current_tcp) {
+		const enum profile_phase prev = profile_enter(PROFILE_OUTPUT);
 		int n = vfprintf(current_tcp->outf, fmt, args);
+		profile_leave(prev);
 		if (n < 0) {
 			/* very unlikely due to vfprintf buffering */
 			outf_perror(current_tcp);
@@ -598,7 +690,9 @@ tprints(const char *str)
 		return;
 #endif /* ENABLE_DATASERIES */
 	if (current_tcp) {
+		const enum profile_phase prev = profile_enter(PROFILE_OUTPUT);
 		int n = fputs_unlocked(str, current_tcp->outf);
+		profile_leave(prev);
 		if (n >= 0) {
 			current_tcp->curcol += strlen(str);
 			return;
@@ -629,10 +723,58 @@ tprintf_comment(const char *fmt, ...)
 	va_end(args);
 }
 
+/*
+ * With --output-buffer, output is flushed when the stdio buffer fills,
+ * or, by next_event, OUTPUT_FLUSH_INTERVAL_MS after it is first written
+ * or when the tracer is about to block, whichever comes first.
+ */
+static void
+defer_tcp_output(struct tcb *const tcp)
+{
+	if (!output_pending) {
+		output_pending = true;
+		clock_gettime(CLOCK_MONOTONIC, &output_pending_since);
+	}
+	if (followfork >= 2 && list_is_empty(&tcp->output_list))
+		list_append(&pending_output_tcps, &tcp->output_list);
+}
+
 static void
-flush_tcp_output(const struct tcb *const tcp)
+flush_pending_output(void)
+{
+	if (!output_pending)
+		return;
+
+	const enum profile_phase prev = profile_enter(PROFILE_OUTPUT);
+	struct list_item *elem;
+
+	output_pending = false;
+	if (followfork >= 2) {
+		while ((elem = list_remove_head(&pending_output_tcps))) {
+			struct tcb *const tcp =
+				list_elem(elem, struct tcb, output_list);
+
+			if (fflush(strace_unstaged_outf(tcp)))
+				outf_perror(tcp);
+		}
+	} else if (fflush(shared_log) && shared_log != stderr) {
+		perror_msg("%s", outfname);
+	}
+	profile_leave(prev);
+}
+
+void
+flush_tcp_output(struct tcb *const tcp)
 {
-	if (fflush(tcp->outf))
+	if (output_buffer_size) {
+		defer_tcp_output(tcp);
+		return;
+	}
+
+	const enum profile_phase prev = profile_enter(PROFILE_OUTPUT);
+	const int rc = fflush(tcp->outf);
+	profile_leave(prev);
+	if (rc)
 		outf_perror(tcp);
 }
 
@@ -670,7 +812,7 @@ printleader(struct tcb *tcp)
 
 	if (printing_tcp) {
 		set_current_tcp(printing_tcp);
-		if (!tcp->staged_output_data && printing_tcp->curcol != 0 &&
+		if (!strace_output_staged(tcp) && printing_tcp->curcol != 0 &&
 		    (followfork < 2 || printing_tcp == tcp)) {
 			/*
 			 * case 1: we have a shared log (i.e. not -ff), and last line
@@ -750,15 +892,23 @@ tabto(void)
  * may create bogus empty FILE.<nonexistant_pid>, and then die.
  */
 static void
-after_successful_attach(struct tcb *tcp, const unsigned int flags)
+init_tcb_output(struct tcb *tcp)
 {
-	tcp->flags |= TCB_ATTACHED | TCB_STARTUP | flags;
 	tcp->outf = shared_log; /* if not -ff mode, the same file is for all */
 	if (followfork >= 2) {
 		char name[PATH_MAX];
 		xsprintf(name, "%s.%u", outfname, tcp->pid);
-		tcp->outf = strace_fopen(name);
+		tcp->outf = strace_fopen(name, open_append ? "a" : "w");
+		if (output_buffer_size)
+			setvbuf(tcp->outf, NULL, _IOFBF, output_buffer_size);
 	}
+}
+
+static void
+after_successful_attach(struct tcb *tcp, const unsigned int flags)
+{
+	tcp->flags |= TCB_ATTACHED | TCB_STARTUP | flags;
+	init_tcb_output(tcp);
 
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_enabled)
@@ -786,33 +936,101 @@ expand_tcbtab(void)
 	for (tcb_ptr = tcbtab + old_tcbtabsize;
 	    tcb_ptr < tcbtab + tcbtabsize; tcb_ptr++, newtcbs++)
 		*tcb_ptr = newtcbs;
+
+	/* Push them in reverse, so that they are handed out in order. */
+	for (tcb_ptr = tcbtab + tcbtabsize;
+	     tcb_ptr > tcbtab + old_tcbtabsize; ) {
+		--tcb_ptr;
+		(*tcb_ptr)->next_free = free_tcbs;
+		free_tcbs = *tcb_ptr;
+	}
+}
+
+static size_t
+pid_tab_pos(const int pid)
+{
+	/* Fibonacci hashing, consecutive pids land far apart. */
+	return ((unsigned int) pid * 0x9e3779b1U) & pid_tab.mask;
+}
+
+static void
+pid_tab_insert(struct tcb *const tcp)
+{
+	if ((pid_tab.count + 1) * 2 > pid_tab.mask + 1) {
+		struct tcb **const old = pid_tab.slots;
+		const size_t old_size = old ? pid_tab.mask + 1 : 0;
+		const size_t size = old_size ? old_size * 2 : 256;
+
+		pid_tab.slots = xcalloc(size, sizeof(*pid_tab.slots));
+		pid_tab.mask = size - 1;
+		pid_tab.count = 0;
+		for (size_t i = 0; i < old_size; ++i) {
+			if (old[i])
+				pid_tab_insert(old[i]);
+		}
+		free(old);
+	}
+
+	size_t pos = pid_tab_pos(tcp->pid);
+	while (pid_tab.slots[pos])
+		pos = (pos + 1) & pid_tab.mask;
+	pid_tab.slots[pos] = tcp;
+	++pid_tab.count;
+}
+
+static void
+pid_tab_remove(const struct tcb *const tcp)
+{
+	if (!pid_tab.slots)
+		return;
+
+	size_t pos = pid_tab_pos(tcp->pid);
+	for (; pid_tab.slots[pos] != tcp; pos = (pos + 1) & pid_tab.mask) {
+		if (!pid_tab.slots[pos])
+			return;
+	}
+
+	/*
+	 * Backward shift deletion: move later entries of the probe
+	 * sequence into the hole, so that no tombstones are needed.
+	 */
+	for (size_t next = (pos + 1) & pid_tab.mask; pid_tab.slots[next];
+	     next = (next + 1) & pid_tab.mask) {
+		const size_t home = pid_tab_pos(pid_tab.slots[next]->pid);
+
+		if (((next - home) & pid_tab.mask)
+		    >= ((next - pos) & pid_tab.mask)) {
+			pid_tab.slots[pos] = pid_tab.slots[next];
+			pos = next;
+		}
+	}
+	pid_tab.slots[pos] = NULL;
+	--pid_tab.count;
 }
 
 static struct tcb *
 alloctcb(int pid)
 {
-	unsigned int i;
 	struct tcb *tcp;
 
-	if (nprocs == tcbtabsize)
+	if (!free_tcbs)
 		expand_tcbtab();
 
-	for (i = 0; i < tcbtabsize; i++) {
-		tcp = tcbtab[i];
-		if (!tcp->pid) {
-			memset(tcp, 0, sizeof(*tcp));
-			list_init(&tcp->wait_list);
-			tcp->pid = pid;
+	tcp = free_tcbs;
+	free_tcbs = tcp->next_free;
+
+	memset(tcp, 0, sizeof(*tcp));
+	list_init(&tcp->wait_list);
+	list_init(&tcp->output_list);
+	tcp->pid = pid;
 #if SUPPORTED_PERSONALITIES > 1
-			tcp->currpers = current_personality;
+	tcp->currpers = current_personality;
 #endif
-			nprocs++;
-			debug_msg("new tcb for pid %d, active tcbs:%d",
-				  tcp->pid, nprocs);
-			return tcp;
-		}
-	}
-	error_msg_and_die("bug in alloctcb");
+	pid_tab_insert(tcp);
+	nprocs++;
+	debug_msg("new tcb for pid %d, active tcbs:%d",
+		  tcp->pid, nprocs);
+	return tcp;
 }
 
 void *
@@ -866,6 +1084,10 @@ droptcb(struct tcb *tcp)
 
 	free_tcb_priv_data(tcp);
 
+#ifdef ENABLE_DATASERIES
+	ds_arena_free(tcp);
+#endif
+
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_enabled)
 		unwind_tcb_fin(tcp);
@@ -877,6 +1099,7 @@ droptcb(struct tcb *tcp)
 
 	if (tcp->mmap_cache)
 		tcp->mmap_cache->free_fn(tcp, __func__);
+	fdtable_release(tcp);
 
 	nprocs--;
 	debug_msg("dropped tcb for pid %d, %d remain", tcp->pid, nprocs);
@@ -887,10 +1110,12 @@ droptcb(struct tcb *tcp)
 			publish = is_number_in_set(STATUS_DETACHED, status_set);
 			strace_close_memstream(tcp, publish);
 		}
+		strace_free_memstream(tcp);
 
 		if (followfork >= 2) {
 			if (tcp->curcol != 0 && publish)
 				fprintf(tcp->outf, " <detached ...>\n");
+			list_remove(&tcp->output_list);
 			fclose(tcp->outf);
 		} else {
 			if (printing_tcp == tcp && tcp->curcol != 0 && publish)
@@ -906,7 +1131,11 @@ droptcb(struct tcb *tcp)
 
 	list_remove(&tcp->wait_list);
 
+	stop_latency_drop(tcp);
+	pid_tab_remove(tcp);
 	memset(tcp, 0, sizeof(*tcp));
+	tcp->next_free = free_tcbs;
+	free_tcbs = tcp;
 }
 
 /* Detach traced process.
@@ -1097,19 +1326,359 @@ process_opt_p_list(char *opt)
 	}
 }
 
+static char *
+shard_file_name(const char *const name, const unsigned int shard)
+{
+	const size_t size = strlen(name) + sizeof(int) * 3 + 2;
+	char *const buf = xmalloc(size);
+
+	snprintf(buf, size, "%s.%u", name, shard);
+	return buf;
+}
+
+/*
+ * The sort key of a line of shard output: its timestamp, which follows
+ * the pid, as the shards trace with -f.  All the timestamps of a trace
+ * have the same format and width, so they compare as strings.
+ */
+static const char *
+shard_line_key(const char *const line, size_t *const len)
+{
+	const char *p = line + strspn(line, "0123456789");
+
+	p += strspn(p, " ");
+	*len = strcspn(p, " \n");
+	return p;
+}
+
+static int
+shard_key_cmp(const char *const a, const size_t a_len,
+	      const char *const b, const size_t b_len)
+{
+	const int rc = memcmp(a, b, MIN(a_len, b_len));
+
+	return rc ? rc : (a_len > b_len) - (a_len < b_len);
+}
+
+/*
+ * Merges the outputs of the shards, FILE.K, into FILE, and removes them.
+ * With timestamps the lines are merged in the order of their timestamps,
+ * otherwise the outputs are concatenated in the order of the shards;
+ * either way every line starts with the pid of its thread.
+ */
+static void
+merge_shard_outputs(void)
+{
+	struct shard_output {
+		FILE *fp;
+		char *line;
+		size_t size;
+		ssize_t len;
+	} *const outs = xcalloc(tracer_shards, sizeof(*outs));
+	FILE *const fp = strace_fopen(outfname, open_append ? "a" : "w");
+	unsigned int i;
+
+	for (i = 0; i < tracer_shards; ++i) {
+		char *const name = shard_file_name(outfname, i);
+
+		outs[i].fp = fopen_stream(name, "r");
+		if (outs[i].fp) {
+			outs[i].len = getline(&outs[i].line, &outs[i].size,
+					      outs[i].fp);
+			unlink(name);
+		} else {
+			outs[i].len = -1;
+		}
+		free(name);
+	}
+
+	for (;;) {
+		struct shard_output *next = NULL;
+		const char *next_key = NULL;
+		size_t next_key_len = 0;
+
+		for (i = 0; i < tracer_shards; ++i) {
+			if (outs[i].len < 0)
+				continue;
+			if (!tflag) {
+				next = &outs[i];
+				break;
+			}
+
+			size_t key_len;
+			const char *const key =
+				shard_line_key(outs[i].line, &key_len);
+
+			if (!next || shard_key_cmp(key, key_len, next_key,
+						   next_key_len) < 0) {
+				next = &outs[i];
+				next_key = key;
+				next_key_len = key_len;
+			}
+		}
+		if (!next)
+			break;
+
+		fwrite(next->line, 1, next->len, fp);
+		next->len = getline(&next->line, &next->size, next->fp);
+	}
+
+	for (i = 0; i < tracer_shards; ++i) {
+		if (outs[i].fp)
+			fclose(outs[i].fp);
+		free(outs[i].line);
+	}
+	free(outs);
+	if (fclose(fp))
+		perror_msg("%s", outfname);
+}
+
+/*
+ * Starts a tracer process for each of the --tracer-shards, and returns in
+ * each of them.  The original process traces nothing: it passes
+ * termination signals on to the shards, waits for all of them, merges
+ * their outputs unless they are written per process with -ff, and exits.
+ *
+ * A shard attaches only to the threads shard_owns().  The shards trace
+ * with -f, so everything these threads clone later is attached at clone
+ * time to the same shard, as the tracer of a thread becomes the tracer
+ * of its new children.
+ */
+static void
+start_tracer_shards(void)
+{
+	static const int forwarded[] = {
+		SIGHUP, SIGINT, SIGQUIT, SIGPIPE, SIGTERM
+	};
+	pid_t *const pids = xcalloc(tracer_shards, sizeof(*pids));
+	const pid_t supervisor = getpid();
+	sigset_t set, orig_set;
+	unsigned int i;
+
+	/*
+	 * SIGCHLD is ignored by default, so it has to be blocked before
+	 * a shard gets a chance to exit for it to stay pending.
+	 */
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	for (i = 0; i < ARRAY_SIZE(forwarded); ++i)
+		sigaddset(&set, forwarded[i]);
+	sigprocmask(SIG_BLOCK, &set, &orig_set);
+
+	for (i = 0; i < tracer_shards; ++i) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			int saved_errno = errno;
+
+			while (i > 0)
+				kill(pids[--i], SIGKILL);
+			errno = saved_errno;
+			perror_func_msg_and_die("fork");
+		}
+
+		if (!pid) {
+			free(pids);
+			sigprocmask(SIG_SETMASK, &orig_set, NULL);
+			tracer_shard = i;
+			strace_tracer_pid = getpid();
+#if defined HAVE_PRCTL && defined PR_SET_PDEATHSIG
+			/* Detach if the supervisor is gone. */
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+			if (getppid() != supervisor)
+				kill(getpid(), SIGTERM);
+			return;
+		}
+
+		pids[i] = pid;
+	}
+
+	unsigned int running = tracer_shards;
+	bool failed = false, traced = false;
+	int interrupted_by = 0;
+
+	while (running) {
+		int sig = sigwaitinfo(&set, NULL);
+
+		if (sig < 0)
+			continue;
+
+		if (sig != SIGCHLD) {
+			interrupted_by = sig;
+			for (i = 0; i < tracer_shards; ++i) {
+				if (pids[i])
+					kill(pids[i], sig);
+			}
+			continue;
+		}
+
+		pid_t pid;
+		int status;
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (i = 0; i < tracer_shards; ++i) {
+				if (pids[i] == pid)
+					break;
+			}
+			if (i == tracer_shards)
+				continue;
+
+			pids[i] = 0;
+			--running;
+
+			if (WIFSIGNALED(status)
+			    && WTERMSIG(status) != interrupted_by) {
+				error_msg("tracer shard %u killed by %s", i,
+					  signame(WTERMSIG(status)));
+				failed = true;
+			} else if (WIFEXITED(status) && !WEXITSTATUS(status)) {
+				traced = true;
+			}
+			debug_msg("tracer shard %u (pid %d) finished, %u"
+				  " running", i, pid, running);
+		}
+	}
+
+	if (followfork < 2)
+		merge_shard_outputs();
+
+	/* Die the same way the shards did, like a single tracer would. */
+	if (interrupted_by) {
+		struct_rlimit rlim = {0, 0};
+		set_rlimit(RLIMIT_CORE, &rlim);
+
+		signal(interrupted_by, SIG_DFL);
+		sigprocmask(SIG_SETMASK, &orig_set, NULL);
+		raise(interrupted_by);
+	}
+
+	/*
+	 * A shard exits with a non-zero status when it has not attached
+	 * anything, which is fine as long as some other shard did.
+	 */
+	exit(failed || !traced);
+}
+
+static bool
+shard_owns(const int tid)
+{
+	return !tracer_shards || (unsigned int) tid % tracer_shards == tracer_shard;
+}
+
+/*
+ * Threads attached by startup_attach(), and the -p processes they belong
+ * to.  With PTRACE_SEIZE, these threads keep running until
+ * interrupt_attached() stops all of them in one go, so that a large
+ * thread group is not left partially stopped while the rest of it is
+ * being enumerated and seized.
+ */
+static int *attach_tids;
+static size_t attach_tids_size, nattach_tids;
+
+static struct attach_group {
+	int pid;
+	size_t first, end;	/* range of attach_tids */
+	struct timespec start, seized;
+} *attach_groups;
+static size_t attach_groups_size, nattach_groups;
+
+static int
+attach_tid(const int tid)
+{
+	if (!use_seize) {
+		if (ptrace_attach_or_seize(tid) < 0)
+			return -1;
+	} else if (ptrace(PTRACE_SEIZE, tid, 0L,
+			  (unsigned long) ptrace_setoptions) < 0) {
+		ptrace_attach_cmd = "PTRACE_SEIZE";
+		return -1;
+	}
+
+	if (nattach_tids >= attach_tids_size)
+		attach_tids = xgrowarray(attach_tids, &attach_tids_size,
+					 sizeof(*attach_tids));
+	attach_tids[nattach_tids++] = tid;
+	return 0;
+}
+
+static void
+add_attach_group(const int pid, const size_t first,
+		 const struct timespec *const start)
+{
+	if (nattach_groups >= attach_groups_size)
+		attach_groups = xgrowarray(attach_groups, &attach_groups_size,
+					   sizeof(*attach_groups));
+
+	struct attach_group *const ag = &attach_groups[nattach_groups++];
+
+	ag->pid = pid;
+	ag->first = first;
+	ag->end = nattach_tids;
+	ag->start = *start;
+	clock_gettime(CLOCK_MONOTONIC, &ag->seized);
+}
+
+static void
+interrupt_attached(void)
+{
+	for (size_t g = 0; g < nattach_groups; ++g) {
+		const struct attach_group *const ag = &attach_groups[g];
+
+		for (size_t i = ag->first; use_seize && i < ag->end; ++i) {
+			const int tid = attach_tids[i];
+
+			/* A thread that has exited is reaped by the main loop. */
+			if (ptrace(PTRACE_INTERRUPT, tid, 0L, 0L) < 0
+			    && errno != ESRCH)
+				perror_msg("attach: ptrace(PTRACE_INTERRUPT, %d)",
+					   tid);
+		}
+
+		if (debug_flag) {
+			struct timespec now, seize, stop;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			ts_sub(&seize, &ag->seized, &ag->start);
+			ts_sub(&stop, &now, &ag->seized);
+			debug_msg("attach to pid %d: %zu threads in %.6f s"
+				  " (%s %.6f s, interrupt %.6f s)",
+				  ag->pid, ag->end - ag->first,
+				  ts_float(&seize) + ts_float(&stop),
+				  use_seize ? "seize" : "attach",
+				  ts_float(&seize), ts_float(&stop));
+		}
+	}
+
+	nattach_tids = nattach_groups = 0;
+}
+
 static void
 attach_tcb(struct tcb *const tcp)
 {
-	if (ptrace_attach_or_seize(tcp->pid) < 0) {
-		perror_msg("attach: ptrace(%s, %d)",
-			   ptrace_attach_cmd, tcp->pid);
+	const int pid = tcp->pid;
+	const bool owned = shard_owns(pid);
+	const size_t first = nattach_tids;
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (owned) {
+		if (attach_tid(tcp->pid) < 0) {
+			perror_msg("attach: ptrace(%s, %d)",
+				   ptrace_attach_cmd, tcp->pid);
+			droptcb(tcp);
+			return;
+		}
+
+		after_successful_attach(tcp,
+					TCB_GRABBED | post_attach_sigstop);
+		debug_msg("attach to pid %d (main) succeeded", tcp->pid);
+	} else if (!followfork) {
 		droptcb(tcp);
 		return;
 	}
 
-	after_successful_attach(tcp, TCB_GRABBED | post_attach_sigstop);
-	debug_msg("attach to pid %d (main) succeeded", tcp->pid);
-
 	static const char task_path[] = "/proc/%d/task";
 	char procdir[sizeof(task_path) + sizeof(int) * 3];
 	DIR *dir;
@@ -1125,11 +1694,11 @@ attach_tcb(struct tcb *const tcp)
 				continue;
 
 			int tid = string_to_uint(de->d_name);
-			if (tid <= 0 || tid == tcp->pid)
+			if (tid <= 0 || tid == tcp->pid || !shard_owns(tid))
 				continue;
 
 			++ntid;
-			if (ptrace_attach_or_seize(tid) < 0) {
+			if (attach_tid(tid) < 0) {
 				++nerr;
 				debug_perror_msg("attach: ptrace(%s, %d)",
 						 ptrace_attach_cmd, tid);
@@ -1144,6 +1713,18 @@ attach_tcb(struct tcb *const tcp)
 		closedir(dir);
 	}
 
+	add_attach_group(pid, first, &start);
+
+	if (!owned) {
+		/* The leader is traced by another shard. */
+		if (!qflag && ntid > nerr)
+			error_msg("Process %u attached with %u threads"
+				  " (shard %u)",
+				  tcp->pid, ntid - nerr, tracer_shard);
+		droptcb(tcp);
+		return;
+	}
+
 	if (!qflag) {
 		if (ntid > nerr)
 			error_msg("Process %u attached"
@@ -1223,9 +1804,13 @@ startup_attach(void)
 		attach_tcb(tcp);
 
 		if (interrupted)
-			return;
+			break;
 	} /* for each tcbtab[] */
 
+	interrupt_attached();
+	if (interrupted)
+		return;
+
 	if (daemonized_tracer) {
 		/*
 		 * Make parent go away.
@@ -1256,7 +1841,7 @@ exec_or_die(void)
 
 	if (params->fd_to_close >= 0)
 		close(params->fd_to_close);
-	if (!daemonized_tracer && !use_seize) {
+	if (!daemonized_tracer && !use_seize && !seccomp_notify) {
 		if (ptrace(PTRACE_TRACEME, 0L, 0L, 0L) < 0) {
 			perror_msg_and_die("ptrace(PTRACE_TRACEME, ...)");
 		}
@@ -1281,7 +1866,9 @@ exec_or_die(void)
 			perror_msg_and_die("setreuid");
 		}
 
-	if (!daemonized_tracer) {
+	if (seccomp_notify) {
+		/* Nothing to wait for, the tracer does not ptrace us. */
+	} else if (!daemonized_tracer) {
 		/*
 		 * Induce a ptrace stop. Tracer (our parent)
 		 * will resume us with PTRACE_SYSCALL and display
@@ -1306,6 +1893,10 @@ exec_or_die(void)
 		  seccomp_filtering ? "enabled" : "disabled");
 	if (seccomp_filtering)
 		init_seccomp_filter();
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (seccomp_notify)
+		init_seccomp_notify_filter();
+#endif
 	execv(params->pathname, params->argv);
 	perror_msg_and_die("exec");
 }
@@ -1475,6 +2066,19 @@ startup_child(char **argv)
 
 	/* We are the tracer */
 
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (seccomp_notify) {
+		/*
+		 * There is nothing to attach to: the tcb is allocated
+		 * by seccomp_notify_loop() on the first notification.
+		 */
+		strace_child = pid;
+		seccomp_notify_attach(pid);
+		redirect_standard_fds();
+		return;
+	}
+#endif
+
 	if (!daemonized_tracer) {
 		strace_child = pid;
 		if (!use_seize) {
@@ -1659,6 +2263,9 @@ init(int argc, char *argv[])
 {
 	int c, i;
 	int optF = 0, zflags = 0;
+#ifdef ENABLE_DATASERIES
+	bool ds_buffer_limit_set = false;
+#endif
 #ifdef ENABLE_DATASERIES
 	char *ds_fname = NULL;
 #endif /* ENABLE_DATASERIES */
@@ -1694,15 +2301,56 @@ init(int argc, char *argv[])
 	enum {
 #ifdef ENABLE_DATASERIES
 		DATASERIES_OPTION = 255,
+		DATASERIES_ASYNC_OPTION = 0x101,
+		DATASERIES_DEDUP_OPTION = 0x102,
+		DS_CAPTURE_OPTION = 0x103,
+		DATASERIES_CLOCK_OPTION = 0x104,
+		DATASERIES_BUFFER_LIMIT_OPTION = 0x105,
+		DATASERIES_FDS_OPTION = 0x10e,
+# ifdef ENABLE_STACKTRACE
+		DS_STACKS_OPTION = 0x10c,
+# endif
 #endif /* ENABLE_DATASERIES */
-		SECCOMP_OPTION = 0x100
+		SECCOMP_OPTION = 0x100,
+		TRACER_SHARDS_OPTION = 0x106,
+		EVENT_ORDER_OPTION = 0x107,
+		STOP_LATENCY_OPTION = 0x108,
+		SECCOMP_NOTIFY_OPTION = 0x109,
+		PROFILE_TRACER_OPTION = 0x10a,
+#ifdef ENABLE_STACKTRACE
+		STACK_TRACE_CACHE_OPTION = 0x10b,
+#endif
+		OUTPUT_BUFFER_OPTION = 0x10d,
 	};
 	static const struct option longopts[] = {
 		{ "seccomp-bpf", no_argument, 0, SECCOMP_OPTION },
+		{ "seccomp-notify", no_argument, 0, SECCOMP_NOTIFY_OPTION },
+		{ "tracer-shards", required_argument, 0, TRACER_SHARDS_OPTION },
+		{ "event-order", required_argument, 0, EVENT_ORDER_OPTION },
+		{ "stop-latency", no_argument, 0, STOP_LATENCY_OPTION },
+		{ "profile-tracer", no_argument, 0, PROFILE_TRACER_OPTION },
+		{ "output-buffer", required_argument, 0, OUTPUT_BUFFER_OPTION },
+#ifdef ENABLE_STACKTRACE
+		{ "stack-trace-cache", required_argument, 0,
+		  STACK_TRACE_CACHE_OPTION },
+#endif
 		{ "help", no_argument, 0, 'h' },
 		{ "version", no_argument, 0, 'V' },
 #ifdef ENABLE_DATASERIES
 		{ "dataseries", required_argument, 0, DATASERIES_OPTION},
+		{ "dataseries-async", optional_argument, 0,
+		  DATASERIES_ASYNC_OPTION },
+		{ "dataseries-dedup", optional_argument, 0,
+		  DATASERIES_DEDUP_OPTION },
+		{ "dataseries-clock", required_argument, 0,
+		  DATASERIES_CLOCK_OPTION },
+		{ "dataseries-buffer-limit", required_argument, 0,
+		  DATASERIES_BUFFER_LIMIT_OPTION },
+		{ "dataseries-fds", no_argument, 0, DATASERIES_FDS_OPTION },
+		{ "ds-capture", required_argument, 0, DS_CAPTURE_OPTION },
+# ifdef ENABLE_STACKTRACE
+		{ "ds-stacks", required_argument, 0, DS_STACKS_OPTION },
+# endif
 #endif /* ENABLE_DATASERIES */
 		{ 0, 0, 0, 0 }
 	};
@@ -1846,12 +2494,79 @@ init(int argc, char *argv[])
 		case SECCOMP_OPTION:
 			seccomp_filtering = true;
 			break;
+		case SECCOMP_NOTIFY_OPTION:
+#ifdef HAVE_SECCOMP_NOTIFY
+			seccomp_notify = true;
+#else
+			error_msg_and_die("--seccomp-notify is not supported"
+					  " by this build");
+#endif
+			break;
+		case TRACER_SHARDS_OPTION:
+			i = string_to_uint_upto(optarg, MAX_TRACER_SHARDS);
+			if (i <= 0)
+				error_msg_and_help("invalid --tracer-shards"
+						   " argument: '%s'", optarg);
+			tracer_shards = i;
+			break;
+		case EVENT_ORDER_OPTION:
+			if (!strcmp(optarg, "fifo"))
+				event_order = EVENT_ORDER_FIFO;
+			else if (!strcmp(optarg, "round-robin"))
+				event_order = EVENT_ORDER_ROUND_ROBIN;
+			else
+				error_msg_and_help("invalid --event-order"
+						   " argument: '%s'", optarg);
+			break;
+		case STOP_LATENCY_OPTION:
+			stop_latency_enabled = true;
+			break;
+		case PROFILE_TRACER_OPTION:
+			profile_tracer = true;
+			break;
+		case OUTPUT_BUFFER_OPTION:
+			i = string_to_uint_upto(optarg, 1U << 30);
+			if (i <= 0)
+				error_msg_and_help("invalid --output-buffer"
+						   " argument: '%s'", optarg);
+			output_buffer_size = i;
+			break;
+#ifdef ENABLE_STACKTRACE
+		case STACK_TRACE_CACHE_OPTION:
+			unwind_set_cache_file(optarg);
+			break;
+#endif
 #ifdef ENABLE_DATASERIES
 		case DATASERIES_OPTION:
 			ds_fname = optarg;
 			if (!ds_fname)
 				error_msg_and_die("empty dataseries filename");
 			break;
+		case DATASERIES_ASYNC_OPTION:
+			ds_set_async_queue_depth(optarg);
+			break;
+		case DATASERIES_DEDUP_OPTION:
+			ds_set_dedup_chunk_size(optarg);
+			break;
+		case DATASERIES_CLOCK_OPTION:
+			ds_set_clock_mode(optarg);
+			break;
+		case DATASERIES_BUFFER_LIMIT_OPTION:
+			ds_set_stream_limit(optarg);
+			ds_buffer_limit_set = true;
+			break;
+		case DATASERIES_FDS_OPTION:
+			ds_fds_enabled = true;
+			break;
+		case DS_CAPTURE_OPTION:
+			qualify_ds_capture(optarg);
+			break;
+# ifdef ENABLE_STACKTRACE
+		case DS_STACKS_OPTION:
+			qualify_ds_stacks(optarg);
+			stack_trace_enabled = true;
+			break;
+# endif
 #endif /* ENABLE_DATASERIES */
 		default:
 			error_msg_and_help(NULL);
@@ -1874,6 +2589,27 @@ init(int argc, char *argv[])
 				   "count is %d",
 				   daemonized_tracer, MAX_DAEMONIZE_OPTS);
 
+	if (seccomp_notify) {
+		if (!argc || nprocs)
+			error_msg_and_help("--seccomp-notify requires PROG"
+					   " and cannot be used with -p");
+		if (daemonized_tracer || seccomp_filtering || cflag
+		    || stack_trace_enabled || detach_on_execve
+		    || !is_complete_set(status_set, NUMBER_OF_STATUSES))
+			error_msg_and_help("--seccomp-notify cannot be used"
+					   " with -D, -b, -c, -C, -k, -z, -Z,"
+					   " -e status, or --seccomp-bpf");
+		/* The registers cannot be changed, so nothing is injected. */
+		for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+			if (inject_vec[p])
+				error_msg_and_help("--seccomp-notify cannot be"
+						   " used with -e inject"
+						   " or -e fault");
+		}
+		if (!followfork)
+			followfork = 1;
+	}
+
 	if (seccomp_filtering && detach_on_execve) {
 		error_msg("--seccomp-bpf is not enabled because"
 			  " it is not compatible with -b");
@@ -1900,6 +2636,21 @@ init(int argc, char *argv[])
 		}
 	}
 
+	if (tracer_shards) {
+		if (argc)
+			error_msg_and_help("--tracer-shards can only be used"
+					   " with -p PID");
+		if (!outfname || outfname[0] == '|' || outfname[0] == '!')
+			error_msg_and_help("--tracer-shards requires -o FILE");
+		if (!followfork) {
+			error_msg("--tracer-shards implies -f");
+			followfork = 1;
+		}
+	}
+
+	if (output_buffer_size && !outfname)
+		error_msg_and_help("--output-buffer requires -o FILE");
+
 	if (followfork >= 2 && cflag) {
 		error_msg_and_help("(-c or -C) and -ff are mutually exclusive");
 	}
@@ -1938,6 +2689,35 @@ init(int argc, char *argv[])
 
 	set_sighandler(SIGCHLD, SIG_DFL, &params_for_tracee.child_sa);
 
+#ifdef ENABLE_DATASERIES
+	if (ds_async_queue_depth && !ds_fname)
+		error_msg_and_help("--dataseries-async requires --dataseries");
+	if (ds_dedup_chunk_size && !ds_fname)
+		error_msg_and_help("--dataseries-dedup requires --dataseries");
+	if (ds_clock_calibrated && !ds_fname)
+		error_msg_and_help("--dataseries-clock requires --dataseries");
+	if (ds_fds_enabled && !ds_fname)
+		error_msg_and_help("--dataseries-fds requires --dataseries");
+	if (ds_buffer_limit_set && !ds_fname)
+		error_msg_and_help("--dataseries-buffer-limit requires"
+				   " --dataseries");
+	if (seccomp_notify && ds_fname)
+		error_msg_and_help("--seccomp-notify cannot be used with"
+				   " --dataseries");
+#endif /* ENABLE_DATASERIES */
+
+	if (tracer_shards) {
+		start_tracer_shards();
+		if (followfork < 2)
+			outfname = shard_file_name(outfname, tracer_shard);
+#ifdef ENABLE_DATASERIES
+		if (ds_fname) {
+			ds_fname = shard_file_name(ds_fname, tracer_shard);
+			ds_set_shard(tracer_shard);
+		}
+#endif /* ENABLE_DATASERIES */
+	}
+
 #ifdef ENABLE_DATASERIES
 	if (ds_fname) {
 		char ds_top[PATH_MAX] = {0};
@@ -1966,9 +2746,29 @@ init(int argc, char *argv[])
 					   "fname=\"%s\" table_path=\"%s\" "
 					   "xml_path=\"%s\" ",
 					   ds_fname, tab_path, xml_path);
+		ds_dedup_init(ds_fname);
+		ds_clock_init(ds_fname);
+		ds_stacks_init(ds_fname);
+		ds_fds_init(ds_fname);
 	}
 #endif /* ENABLE_DATASERIES */
 
+	/*
+	 * The descriptor table is kept up to date on every syscall exit,
+	 * so it is only worth it for the options that look descriptors up.
+	 * Tracer shards see the syscalls of some of the threads of a
+	 * process only, and would miss the closes made by the others.
+	 */
+	if ((show_fd_path || tracing_paths
+#ifdef ENABLE_DATASERIES
+	     || ds_fds_enabled
+#endif
+	    ) && !seccomp_notify && !tracer_shards)
+		fdtable_enable();
+	/* For the same reason, the shards read the maps every time. */
+	if (tracer_shards)
+		mmap_cache_disable();
+
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_enabled)
 		unwind_init();
@@ -2001,6 +2801,10 @@ init(int argc, char *argv[])
 		check_seccomp_filter();
 	if (seccomp_filtering)
 		ptrace_setoptions |= PTRACE_O_TRACESECCOMP;
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (seccomp_notify)
+		check_seccomp_notify();
+#endif
 
 	debug_msg("ptrace_setoptions = %#x", ptrace_setoptions);
 	test_ptrace_seize();
@@ -2032,7 +2836,8 @@ init(int argc, char *argv[])
 						   "are mutually exclusive");
 			shared_log = strace_popen(outfname + 1);
 		} else if (followfork < 2) {
-			shared_log = strace_fopen(outfname);
+			shared_log = strace_fopen(outfname,
+						  open_append ? "a" : "w");
 		} else if (strlen(outfname) >= PATH_MAX - sizeof(int) * 3) {
 			errno = ENAMETOOLONG;
 			perror_msg_and_die("%s", outfname);
@@ -2043,7 +2848,10 @@ init(int argc, char *argv[])
 			followfork = 1;
 	}
 
-	if (!outfname || outfname[0] == '|' || outfname[0] == '!') {
+	if (output_buffer_size) {
+		if (followfork < 2)
+			setvbuf(shared_log, NULL, _IOFBF, output_buffer_size);
+	} else if (!outfname || outfname[0] == '|' || outfname[0] == '!') {
 		setvbuf(shared_log, NULL, _IOLBF, 0);
 	}
 
@@ -2108,28 +2916,28 @@ init(int argc, char *argv[])
 	 * -p PID1,PID2: yes (there are already more than one pid)
 	 */
 	print_pid_pfx = (outfname && followfork < 2 && (followfork == 1 || nprocs > 1));
+
+	/*
+	 * SIGCHLD is ignored by default, so it has to be blocked
+	 * for wait_for_stop to see the stops it reports.
+	 */
+	if (output_buffer_size) {
+		sigemptyset(&chld_set);
+		sigaddset(&chld_set, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &chld_set, NULL);
+	}
 }
 
 static struct tcb *
 pid2tcb(const int pid)
 {
-	if (pid <= 0)
+	if (pid <= 0 || !pid_tab.slots)
 		return NULL;
 
-#define PID2TCB_CACHE_SIZE 1024U
-#define PID2TCB_CACHE_MASK (PID2TCB_CACHE_SIZE - 1)
-
-	static struct tcb *pid2tcb_cache[PID2TCB_CACHE_SIZE];
-	struct tcb **const ptcp = &pid2tcb_cache[pid & PID2TCB_CACHE_MASK];
-	struct tcb *tcp = *ptcp;
-
-	if (tcp && tcp->pid == pid)
-		return tcp;
-
-	for (unsigned int i = 0; i < tcbtabsize; ++i) {
-		tcp = tcbtab[i];
-		if (tcp->pid == pid)
-			return *ptcp = tcp;
+	for (size_t pos = pid_tab_pos(pid); pid_tab.slots[pos];
+	     pos = (pos + 1) & pid_tab.mask) {
+		if (pid_tab.slots[pos]->pid == pid)
+			return pid_tab.slots[pos];
 	}
 
 	return NULL;
@@ -2300,7 +3108,9 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 	droptcb(tcp);
 	/* Switch to the thread, reusing leader's outfile and pid */
 	tcp = execve_thread;
+	pid_tab_remove(tcp);
 	tcp->pid = pid;
+	pid_tab_insert(tcp);
 	if (cflag != CFLAG_ONLY_STATS) {
 		printleader(tcp);
 		tprintf("+++ superseded by execve in pid %lu +++\n", old_pid);
@@ -2490,6 +3300,92 @@ tcb_wait_tab_check_size(const size_t size)
 	}
 }
 
+static uint64_t dispatch_seq;
+
+static int
+dispatch_seq_cmp(const void *a, const void *b)
+{
+	const uint64_t sa = (*(struct tcb *const *) a)->dispatch_seq;
+	const uint64_t sb = (*(struct tcb *const *) b)->dispatch_seq;
+
+	return sa < sb ? -1 : sa > sb;
+}
+
+/*
+ * Reorders the tcbs queued by a harvest so that the ones whose events
+ * were dispatched least recently go first.  Otherwise the tracees that
+ * wait4 happens to return first would always be restarted first, and
+ * the rest would always wait for all of them.
+ */
+static void
+sort_pending_tcps(struct list_item *const pending, const size_t n)
+{
+	static struct tcb **v;
+	static size_t v_size;
+	struct list_item *elem;
+	size_t i = 0;
+
+	while (n > v_size)
+		v = xgrowarray(v, &v_size, sizeof(*v));
+
+	while (i < n && (elem = list_remove_head(pending)) != NULL)
+		v[i++] = list_elem(elem, struct tcb, wait_list);
+
+	qsort(v, i, sizeof(*v), dispatch_seq_cmp);
+
+	for (size_t j = 0; j < i; ++j)
+		list_append(pending, &v[j]->wait_list);
+}
+
+/*
+ * Returns whether the buffered output is due to be flushed, and stores
+ * the time left until it is in remaining otherwise.
+ */
+static bool
+output_flush_due(struct timespec *const remaining)
+{
+	static const struct timespec interval = {
+		.tv_nsec = OUTPUT_FLUSH_INTERVAL_MS * 1000000
+	};
+	struct timespec now, elapsed;
+
+	if (!output_pending)
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ts_sub(&elapsed, &now, &output_pending_since);
+	if (ts_cmp(&elapsed, &interval) >= 0)
+		return true;
+	if (remaining)
+		ts_sub(remaining, &interval, &elapsed);
+	return false;
+}
+
+/*
+ * wait4() for the next stop, flushing the buffered output
+ * if none comes before it is due.
+ */
+static int
+wait_for_stop(int *const status, struct rusage *const ru)
+{
+	struct timespec remaining;
+
+	while (output_pending) {
+		const int pid = wait4(-1, status, __WALL | WNOHANG, ru);
+
+		if (pid)
+			return pid;
+		if (output_flush_due(&remaining))
+			break;
+		if (sigtimedwait(&chld_set, NULL, &remaining) < 0
+		    && errno == EINTR)
+			return -1;
+	}
+
+	flush_pending_output();
+	return wait4(-1, status, __WALL, ru);
+}
+
 static const struct tcb_wait_data *
 next_event(void)
 {
@@ -2497,6 +3393,10 @@ next_event(void)
 		return NULL;
 
 	invalidate_umove_cache();
+	if (profile_tracer)
+		profile_stop_done();
+	if (output_flush_due(NULL))
+		flush_pending_output();
 
 	struct tcb *tcp = NULL;
 	struct list_item *elem;
@@ -2561,8 +3461,10 @@ next_event(void)
 	 */
 	int status;
 	struct rusage ru;
-	int pid = wait4(-1, &status, __WALL, (cflag ? &ru : NULL));
+	enum profile_phase prev = profile_enter(PROFILE_WAIT);
+	int pid = wait_for_stop(&status, cflag ? &ru : NULL);
 	int wait_errno = errno;
+	profile_leave(prev);
 
 	/*
 	 * The window of opportunity to handle expirations
@@ -2630,6 +3532,9 @@ next_event(void)
 			tcp->stime.tv_nsec = ru.ru_stime.tv_usec * 1000;
 		}
 
+		if (stop_latency_enabled)
+			stop_latency_stopped(tcp);
+
 		tcb_wait_tab_check_size(wait_tab_pos);
 
 		/* Initialise a new wait data structure.  */
@@ -2743,11 +3648,16 @@ next_event(void)
 			break;
 
 next_event_wait_next:
+		prev = profile_enter(PROFILE_WAIT);
 		pid = wait4(-1, &status, __WALL | WNOHANG, (cflag ? &ru : NULL));
 		wait_errno = errno;
+		profile_leave(prev);
 		wait_nohang = true;
 	}
 
+	if (event_order == EVENT_ORDER_ROUND_ROBIN && wait_tab_pos > 1)
+		sort_pending_tcps(&pending_tcps, wait_tab_pos);
+
 next_event_get_tcp:
 	elem = list_remove_head(&pending_tcps);
 
@@ -2763,6 +3673,8 @@ next_event_get_tcp:
 	}
 
 next_event_exit:
+	tcp->dispatch_seq = ++dispatch_seq;
+
 	/* Is this the very first time we see this tracee stopped? */
 	if (tcp->flags & TCB_STARTUP)
 		startup_tcb(tcp);
@@ -2780,6 +3692,8 @@ trace_syscall(struct tcb *tcp, unsigned int *sig)
 {
 	if (entering(tcp)) {
 		int res = syscall_entering_decode(tcp);
+		if (profile_tracer)
+			profile_syscall_stop(tcp);
 		switch (res) {
 		case 0:
 			return 0;
@@ -2789,6 +3703,8 @@ trace_syscall(struct tcb *tcp, unsigned int *sig)
 		syscall_entering_finish(tcp, res);
 		return res;
 	} else {
+		if (profile_tracer)
+			profile_syscall_stop(tcp);
 		struct timespec ts = {};
 		int res = syscall_exiting_decode(tcp, &ts);
 		if (res != 0) {
@@ -3086,6 +4002,16 @@ terminate(void)
 	cleanup(sig);
 	if (cflag)
 		call_summary(shared_log);
+	if (stop_latency_enabled)
+		stop_latency_summary(shared_log);
+	if (profile_tracer)
+		profile_summary(shared_log);
+#ifdef ENABLE_STACKTRACE
+	if (stack_trace_enabled)
+		unwind_fin();
+#endif
+	print_umove_cache_stats();
+	print_fdtable_stats();
 	fflush(NULL);
 	if (shared_log != stderr)
 		fclose(shared_log);
@@ -3122,14 +4048,171 @@ terminate(void)
 	/*
 	 * Free up memory that are used by DataSeriesOutputModule.
 	 * Destructor will be called and extents are flushed to the
-	 * output file.
+	 * output file.  Records still queued for the asynchronous
+	 * writer are drained first.
 	 */
-	if (ds_module)
+	if (ds_module) {
+		ds_writer_finish();
+		ds_dedup_finish();
+		ds_clock_finish();
+		ds_stacks_finish();
+		ds_fds_finish();
+		ds_arena_print_stats();
 		ds_destroy_module(ds_module);
+	}
 #endif /* ENABLE_DATASERIES */
 	exit(exit_code);
 }
 
+#ifdef HAVE_SECCOMP_NOTIFY
+/*
+ * Whether the thread is gone or is a zombie.  The tracees are not our
+ * children and are not ptraced, so nothing tells us when they are
+ * killed by a signal or taken down with their thread group.
+ */
+static bool
+notify_tracee_gone(const int pid)
+{
+	static const char stat_path[] = "/proc/%d/stat";
+	char path[sizeof(stat_path) + sizeof(int) * 3];
+	char buf[512];
+
+	xsprintf(path, stat_path, pid);
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return errno == ENOENT || errno == ESRCH;
+
+	const ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return true;
+	buf[n] = '\0';
+
+	/* The state follows the command name, which may contain ')'. */
+	const char *const p = strrchr(buf, ')');
+	return p && p[1] && (p[2] == 'Z' || p[2] == 'X');
+}
+
+/* Drops the tcbs of the tracees that are gone. */
+static void
+notify_reap_gone(void)
+{
+	for (size_t i = 0; i < tcbtabsize; ++i) {
+		struct tcb *const tcp = tcbtab[i];
+
+		if (tcp->pid && notify_tracee_gone(tcp->pid))
+			droptcb(tcp);
+	}
+}
+
+/*
+ * Drops the tcbs of all the threads of the thread group of the tcb,
+ * which is calling exit_group.  The threads are listed before the
+ * syscall is let go on, while they are all still there.
+ */
+static void
+notify_drop_thread_group(struct tcb *const tcp)
+{
+	static const char task_path[] = "/proc/%d/task";
+	char procdir[sizeof(task_path) + sizeof(int) * 3];
+	DIR *dir;
+
+	xsprintf(procdir, task_path, tcp->pid);
+	if ((dir = opendir(procdir)) != NULL) {
+		struct_dirent *de;
+
+		while ((de = read_dir(dir)) != NULL) {
+			const int tid = string_to_uint(de->d_name);
+			struct tcb *t;
+
+			if (tid > 0 && tid != tcp->pid && (t = pid2tcb(tid)))
+				droptcb(t);
+		}
+		closedir(dir);
+	}
+
+	droptcb(tcp);
+}
+
+/*
+ * The main loop of --seccomp-notify.  The tracees are not ptraced: their
+ * syscall entries come from the seccomp listener, are printed right
+ * away, and the tracees are let go on.  The tcbs are created on demand
+ * and dropped when the thread calls exit, or with its whole thread
+ * group when it calls exit_group.  The tracees that die any other way
+ * give no notice, so whenever the number of tcbs has doubled, those
+ * whose thread is gone are reaped.
+ */
+static void ATTRIBUTE_NORETURN
+seccomp_notify_loop(void)
+{
+	enum { REAP_MIN = 64 };
+	struct seccomp_notify_event ev;
+	unsigned int reap_at = REAP_MIN;
+	int rc;
+
+	while (!interrupted && (rc = seccomp_notify_receive(&ev)) != 0) {
+		if (rc < 0)
+			continue;
+
+		struct tcb *tcp = pid2tcb(ev.pid);
+		if (!tcp) {
+			if (nprocs >= reap_at) {
+				notify_reap_gone();
+				reap_at = MAX(2 * nprocs, (unsigned int) REAP_MIN);
+			}
+			tcp = alloctcb(ev.pid);
+			init_tcb_output(tcp);
+		}
+
+		invalidate_umove_cache();
+
+		const int pers = seccomp_arch_personality(ev.arch);
+		if (pers >= 0) {
+			set_current_tcp(tcp);
+			syscall_entering_notify(tcp, pers, &ev);
+			if (profile_tracer)
+				profile_syscall_stop(tcp);
+		}
+
+		/* exit and exit_group share SEN_exit. */
+		const bool exiting = pers >= 0 && tcp->s_ent->sen == SEN_exit;
+		const bool exiting_group =
+			exiting && !strcmp(tcp->s_ent->sys_name, "exit_group");
+
+		if (exiting_group)
+			notify_drop_thread_group(tcp);
+		seccomp_notify_continue(ev.id);
+		if (profile_tracer)
+			profile_stop_done();
+
+		if (exiting && !exiting_group)
+			droptcb(tcp);
+	}
+
+	if (!interrupted && strace_child) {
+		int status;
+		struct tcb *tcp = pid2tcb(strace_child);
+
+		if (!tcp) {
+			tcp = alloctcb(strace_child);
+			init_tcb_output(tcp);
+		}
+		set_current_tcp(tcp);
+		while (waitpid(strace_child, &status, 0) < 0) {
+			if (errno != EINTR)
+				perror_msg_and_die("waitpid");
+		}
+		if (WIFSIGNALED(status))
+			print_signalled(tcp, strace_child, status);
+		else
+			print_exited(tcp, strace_child, status);
+	}
+
+	terminate();
+}
+#endif /* HAVE_SECCOMP_NOTIFY */
+
 int
 main(int argc, char *argv[])
 {
@@ -3139,9 +4222,15 @@ main(int argc, char *argv[])
 #ifdef ENABLE_DATASERIES
 	if (ds_module) {
 		ds_write_umask_at_start(ds_module, strace_child);
+		ds_writer_start();
 	}
 #endif /* ENABLE_DATASERIES */
 
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (seccomp_notify)
+		seccomp_notify_loop();
+#endif
+
 	exit_code = !nprocs;
 
 	while (dispatch_event(next_event()))
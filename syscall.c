@@ -21,6 +21,7 @@
 #include "nsig.h"
 #include "number_set.h"
 #include "delay.h"
+#include "filter_seccomp.h"
 #include "retval.h"
 #include <limits.h>
 
@@ -460,6 +461,8 @@ print_err_ret(kernel_ulong_t ret, unsigned long u_error)
 
 static long get_regs(struct tcb *);
 static int get_syscall_args(struct tcb *);
+static void decode_subcall(struct tcb *);
+static void set_sysent(struct tcb *);
 static int get_syscall_result(struct tcb *);
 static void get_error(struct tcb *, bool);
 static void set_error(struct tcb *, unsigned long);
@@ -587,10 +590,14 @@ tamper_with_syscall_exiting(struct tcb *tcp)
 int
 syscall_entering_decode(struct tcb *tcp)
 {
+	const enum profile_phase prev = profile_enter(PROFILE_REGS);
 	int res = get_scno(tcp);
+	if (res == 1)
+		res = get_syscall_args(tcp);
+	profile_leave(prev);
 	if (res == 0)
 		return res;
-	if (res != 1 || (res = get_syscall_args(tcp)) != 1) {
+	if (res != 1) {
 		printleader(tcp);
 		tprintf("%s(", tcp_sysent(tcp)->sys_name);
 		/*
@@ -600,6 +607,15 @@ syscall_entering_decode(struct tcb *tcp)
 		return res;
 	}
 
+	decode_subcall(tcp);
+	fdtable_syscall_entering(tcp);
+
+	return 1;
+}
+
+static void
+decode_subcall(struct tcb *tcp)
+{
 #ifdef SYS_syscall_subcall
 	if (tcp_sysent(tcp)->sen == SEN_syscall)
 		decode_syscall_subcall(tcp);
@@ -619,9 +635,42 @@ syscall_entering_decode(struct tcb *tcp)
 # endif
 	}
 #endif
+}
 
-	return 1;
+#ifdef HAVE_SECCOMP_NOTIFY
+/*
+ * Decodes and prints a syscall entry reported through the seccomp
+ * listener instead of a ptrace stop.  There is no exit to wait for,
+ * so the line is finished right away, without a return value and
+ * without the arguments that are decoded on exit.
+ */
+void
+syscall_entering_notify(struct tcb *tcp, unsigned int personality,
+			const struct seccomp_notify_event *ev)
+{
+	update_personality(tcp, personality);
+	tcp->scno = shuffle_scno(ev->nr);
+	tcp->s_ent = NULL;
+	tcp->qual_flg = QUAL_RAW | DEFAULT_QUAL_FLAGS;
+	set_sysent(tcp);
+	for (unsigned int i = 0; i < ARRAY_SIZE(ev->args); ++i)
+		tcp->u_arg[i] = ev->args[i];
+	decode_subcall(tcp);
+
+	unsigned int sig = 0;
+	const int res = syscall_entering_trace(tcp, &sig);
+
+	if (tcp->flags & TCB_FILTERED)
+		return;
+
+	if (!(res & RVAL_DECODED))
+		tprints("...");
+	tprints(") ");
+	tabto();
+	tprints("= ?\n");
+	line_ended();
 }
+#endif /* HAVE_SECCOMP_NOTIFY */
 
 int
 syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
@@ -665,8 +714,14 @@ syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
 
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_enabled) {
-		if (tcp_sysent(tcp)->sys_flags & STACKTRACE_CAPTURE_ON_ENTER)
-			unwind_tcb_capture(tcp);
+		if (tcp_sysent(tcp)->sys_flags & STACKTRACE_CAPTURE_ON_ENTER) {
+# ifdef ENABLE_DATASERIES
+			if (ds_module)
+				ds_stacks_capture(tcp);
+			else
+# endif
+				unwind_tcb_capture(tcp);
+		}
 	}
 #endif
 
@@ -675,8 +730,10 @@ syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
 
 	printleader(tcp);
 	tprintf("%s(", tcp_sysent(tcp)->sys_name);
+	enum profile_phase prev = profile_enter(PROFILE_DECODE);
 	int res = raw(tcp) ? printargs(tcp) : tcp_sysent(tcp)->sys_func(tcp);
-	fflush(tcp->outf);
+	profile_leave(prev);
+	flush_tcp_output(tcp);
 	return res;
 }
 
@@ -717,10 +774,10 @@ syscall_entering_finish(struct tcb *tcp, int res)
 	 * in tcp->etime.
 	 */
 	if (ds_module) {
-		struct timespec entry_time_real;
-		clock_gettime(CLOCK_REALTIME, &entry_time_real);
-		tcp->entry_real_ns = timespec_to_ns(&entry_time_real);
-		clock_gettime(CLOCK_MONOTONIC, &tcp->etime);
+		const enum profile_phase prev =
+			profile_enter(PROFILE_DATASERIES);
+
+		ds_clock_read(&tcp->etime, &tcp->entry_real_ns);
 		/* initialize v_args and common_fields with NULL */
 		memset(v_args, 0, sizeof(void *) * DS_MAX_ARGS);
 		memset(common_fields, 0, sizeof(void *)
@@ -752,7 +809,7 @@ syscall_entering_finish(struct tcb *tcp, int res)
 		switch (tcp->s_ent->sen) {
 		case SEN_vfork:
 		case SEN_clone:
-		        tcp->clone_dsid = ds_get_next_id(ds_module);
+		        tcp->clone_dsid = ds_next_id();
 			break;
 		case SEN_exit: /* exit system call */
 			/*
@@ -763,10 +820,12 @@ syscall_entering_finish(struct tcb *tcp, int res)
 			 */
 			if (exiting(tcp))
 				exit_generated = true;
-			v_args[0] = &exit_generated;
+			v_args[0] = DS_SCALAR_ARG(exit_generated);
 
-			ds_write_record(ds_module, "exit", tcp->u_arg,
+			ds_stacks_claim_id(tcp, common_fields);
+			ds_submit_record("exit", tcp->u_arg,
 					common_fields, v_args);
+			ds_stacks_record(tcp, common_fields);
 			v_args[0] = NULL;
 			common_fields[DS_COMMON_FIELD_TIME_RETURNED] = &tcp->entry_real_ns;
 			break;
@@ -783,17 +842,17 @@ syscall_entering_finish(struct tcb *tcp, int res)
 			 * have an incrementing continuation number.
 			 */
 			continuation_number = 0;
-			v_args[0] = &continuation_number;
+			v_args[0] = DS_SCALAR_ARG(continuation_number);
 			v_args[1] = ds_get_path(tcp, tcp->u_arg[0]);
 
 			/* Add first record to the dataseries file. */
-			ds_write_record(ds_module, "execve", tcp->u_arg,
+			ds_stacks_claim_id(tcp, common_fields);
+			ds_submit_record("execve", tcp->u_arg,
 					common_fields, v_args);
+			ds_stacks_record(tcp, common_fields);
+			common_fields[DS_COMMON_FIELD_UNIQUE_ID] = NULL;
 			v_args[0] = NULL;
-			if (v_args[1]) {
-				free(v_args[1]);
-				v_args[1] = NULL;
-			}
+			v_args[1] = NULL;
 
 			/* Then, write records for each argument variable. */
 			ds_write_execve_records(tcp, tcp->u_arg[1],
@@ -809,6 +868,8 @@ syscall_entering_finish(struct tcb *tcp, int res)
 						common_fields, v_args);
 			break;
 		}
+		ds_forget_args();
+		profile_leave(prev);
 	}
 	else if ((Tflag || cflag) && !filtered(tcp))
 		clock_gettime(CLOCK_MONOTONIC, &tcp->etime);
@@ -849,12 +910,8 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 {
 #ifdef ENABLE_DATASERIES
 	/* Get a time stamp for time_returned and store as in a timeval tv. */
-	if (ds_module) {
-		clock_gettime(CLOCK_MONOTONIC, pts);
-		struct timespec exit_time_real;
-		clock_gettime(CLOCK_REALTIME, &exit_time_real);
-		tcp->exit_real_ns = timespec_to_ns(&exit_time_real);
-	}
+	if (ds_module)
+		ds_clock_read(pts, &tcp->exit_real_ns);
 	else if ((Tflag || cflag) && !filtered(tcp))
 		clock_gettime(CLOCK_MONOTONIC, pts);
 #else /* !ENABLE_DATASERIES */
@@ -865,6 +922,7 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 
 	if (tcp_sysent(tcp)->sys_flags & MEMORY_MAPPING_CHANGE)
 		mmap_notify_report(tcp);
+	fdtable_syscall_exiting(tcp);
 
 	if (filtered(tcp))
 		return 0;
@@ -878,7 +936,10 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 	update_personality(tcp, tcp->currpers);
 #endif
 
-	return get_syscall_result(tcp);
+	const enum profile_phase prev = profile_enter(PROFILE_REGS);
+	const int res = get_syscall_result(tcp);
+	profile_leave(prev);
+	return res;
 }
 
 void
@@ -893,7 +954,7 @@ print_syscall_resume(struct tcb *tcp)
 	 * "strace -ff -oLOG test/threaded_execve" corner case.
 	 * It's the only case when -ff mode needs reprinting.
 	 */
-	if ((followfork < 2 && printing_tcp != tcp && !tcp->staged_output_data)
+	if ((followfork < 2 && printing_tcp != tcp && !strace_output_staged(tcp))
 	    || (tcp->flags & TCB_REPRINT)) {
 		tcp->flags &= ~TCB_REPRINT;
 		printleader(tcp);
@@ -901,11 +962,180 @@ print_syscall_resume(struct tcb *tcp)
 	}
 }
 
+#ifdef ENABLE_DATASERIES
+/*
+ * Writes the records of the syscalls marked custom in ds_capture.in,
+ * the others are handled by ds_capture_exiting().
+ */
+static void
+ds_write_custom_records(struct tcb *tcp, void **common_fields, void **v_args)
+{
+	int iov_number, continuation_number;
+	struct msghdr *msg;
+
+	switch (tcp->s_ent->sen) {
+		case SEN_readv: /* readv system call */
+			/* iov_number equals to '-1' denotes first record. */
+			iov_number = -1;
+			v_args[0] = DS_SCALAR_ARG(iov_number);
+			v_args[1] = DS_SCALAR_ARG(tcp->u_rval);
+			/*
+			 * Write the first record, then iteratively the
+			 * record for each buffer passed in struct iovec.
+			 */
+			ds_write_iov_records(tcp, tcp->u_arg[1], "readv",
+					common_fields, v_args, tcp->u_arg[2]);
+			break;
+		case SEN_writev: /* writev system call */
+			/* iov_number equals to '-1' denotes first record. */
+			iov_number = -1;
+			v_args[0] = DS_SCALAR_ARG(iov_number);
+			v_args[1] = DS_SCALAR_ARG(tcp->u_rval);
+			/*
+			 * Write the first record, then iteratively the
+			 * record for each buffer passed in struct iovec.
+			 */
+			ds_write_iov_records(tcp, tcp->u_arg[1], "writev",
+					common_fields, v_args, tcp->u_arg[2]);
+			break;
+		case SEN_execve: /* execve system call */
+			/*
+			 * continuation number equal to '-1' denotes the
+			 * extra record which stores the common fields of
+			 * execve system call.
+			 */
+			continuation_number = -1;
+			v_args[0] = DS_SCALAR_ARG(continuation_number);
+			ds_submit_record("execve", tcp->u_arg,
+					common_fields, v_args);
+			v_args[0] = NULL;
+			break;
+		case SEN_fcntl: /* fcntl system call */
+			if ((tcp->u_arg[1] == F_SETLK) ||
+			    (tcp->u_arg[1] == F_SETLKW) ||
+			    (tcp->u_arg[1] == F_GETLK)) {
+				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
+							 sizeof(struct flock));
+			}
+			ds_submit_record("fcntl", tcp->u_arg,
+					common_fields, v_args);
+			break;
+		case SEN_ioctl: /* ioctl system call */ {
+			u_int ioctl_size = ds_staged_ioctl_size();
+			if (ioctl_size > 0) {
+				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
+							  ioctl_size);
+			} else {
+				v_args[0] = NULL;
+			}
+			ds_submit_record("ioctl", tcp->u_arg,
+					common_fields, v_args);
+			ds_stage_ioctl_size(0);
+			break;
+		}
+		case SEN_clone: /* clone system call */ {
+			int ctid_index = ds_staged_clone_ctid_index();
+			v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
+						  sizeof(int));
+			v_args[1] = ds_get_buffer(tcp, tcp->u_arg[ctid_index],
+						  sizeof(int));
+			common_fields[DS_COMMON_FIELD_UNIQUE_ID] = &tcp->clone_dsid;
+			ds_submit_into_same_record("clone", tcp->u_arg,
+						  common_fields, v_args);
+			break;
+		}
+		case SEN_vfork: /* vfork system call */
+			common_fields[DS_COMMON_FIELD_UNIQUE_ID] = &tcp->clone_dsid;
+			ds_submit_into_same_record("vfork", tcp->u_arg,
+						  common_fields, v_args);
+			break;
+			/*
+			 * NOTE: support for replaying the
+			 * recvmsg(2) system call is incomplete.
+			 */
+		case SEN_recvmsg: /* recvmsg system call*/
+			msg = ds_get_buffer(tcp, tcp->u_arg[1],
+					    sizeof(struct msghdr));
+			/* iov_number equals to '-1' denotes first record */
+			iov_number = -1;
+			if (!msg) {
+			  v_args[0] = NULL;
+			  v_args[1] = NULL;
+			} else {
+			  v_args[0] = DS_SCALAR_ARG(iov_number);
+			  v_args[1] = DS_SCALAR_ARG(tcp->u_rval);
+			}
+			/*
+			 * Write the first record, then iteratively the
+			 * record for each buffer passed in struct iovec.
+			 */
+			if (msg) {
+			  ds_write_iov_records(tcp, (long)msg->msg_iov,
+					       "recvmsg", common_fields,
+					       v_args, msg->msg_iovlen);
+			} else {
+			  ds_submit_record("recvmsg", tcp->u_arg,
+					   common_fields, v_args);
+			}
+			break;
+			/*
+			 * NOTE: support for tracing the sendmsg
+			 * system call is incomplete.  Currently, we
+			 * do not record all the fields in the
+			 * struct msghdr.
+			 */
+		case SEN_sendmsg: /* sendmsg system call */
+			msg = ds_get_buffer(tcp, tcp->u_arg[1],
+					    sizeof(struct msghdr));
+			/* iov_number equals to '-1' denotes first record. */
+			iov_number = -1;
+			if (!msg) {
+				v_args[0] = NULL;
+				v_args[1] = NULL;
+			} else {
+				v_args[0] = DS_SCALAR_ARG(iov_number);
+				v_args[1] = DS_SCALAR_ARG(tcp->u_rval);
+			}
+			/*
+			 * Write the first record, then iteratively the
+			 * record for each buffer passed in struct iovec.
+			 */
+			if (msg) {
+				ds_write_iov_records(tcp, (long)msg->msg_iov,
+						     "sendmsg", common_fields,
+						     v_args, msg->msg_iovlen);
+			} else {
+				ds_submit_record("sendmsg", tcp->u_arg,
+						 common_fields, v_args);
+			}
+			break;
+		default:
+			ds_submit_warning(tcp->s_ent->sys_name,
+					  tcp->scno);
+	}
+}
+#endif /* ENABLE_DATASERIES */
+
+/*
+ * Publishes or drops the staged output of the syscall tcp is exiting from,
+ * depending on whether it failed, and returns whether it was published.
+ */
+static bool
+publish_staged_output(struct tcb *tcp)
+{
+	bool publish = syserror(tcp)
+		       && is_number_in_set(STATUS_FAILED, status_set);
+	publish |= !syserror(tcp)
+		   && is_number_in_set(STATUS_SUCCESSFUL, status_set);
+	strace_close_memstream(tcp, publish);
+
+	return publish;
+}
+
 int
 syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 {
 #ifdef ENABLE_DATASERIES
-	int i;
 	/*
 	 * Arguments such as pathname or read/write buffer passed to
 	 * system calls cannot be referenced directly from tcp->u_args.
@@ -915,9 +1145,6 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	 */
 	void *v_args[DS_MAX_ARGS];
 	void *common_fields[DS_NUM_COMMON_FIELDS];
-	int iov_number, continuation_number;
-	socklen_t ulen;
-	struct msghdr *msg;
 #endif /* ENABLE_DATASERIES */
 	if (syscall_tampered(tcp) || inject_delay_exit(tcp))
 		tamper_with_syscall_exiting(tcp);
@@ -948,26 +1175,36 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	}
 	tcp->s_prev_ent = tcp->s_ent;
 
+	/*
+	 * The status is known before the syscall is decoded on exiting,
+	 * so the output of the syscalls to be dropped is not formatted
+	 * any further.  modify_ldt is the exception, its decoder tells
+	 * whether it failed.
+	 */
+	if (!is_complete_set(status_set, NUMBER_OF_STATUSES)
+	    && tcp_sysent(tcp)->sen != SEN_modify_ldt
+	    && !publish_staged_output(tcp)) {
+		line_ended();
+		return 0;
+	}
+
 	int sys_res = 0;
 	if (raw(tcp)) {
 		/* sys_res = printargs(tcp); - but it's nop on sysexit */
 	} else {
-		if (tcp->sys_func_rval & RVAL_DECODED)
+		if (tcp->sys_func_rval & RVAL_DECODED) {
 			sys_res = tcp->sys_func_rval;
-		else
+		} else {
+			const enum profile_phase prev =
+				profile_enter(PROFILE_DECODE);
 			sys_res = tcp_sysent(tcp)->sys_func(tcp);
+			profile_leave(prev);
+		}
 	}
 
-	if (!is_complete_set(status_set, NUMBER_OF_STATUSES)) {
-		bool publish = syserror(tcp)
-			       && is_number_in_set(STATUS_FAILED, status_set);
-		publish |= !syserror(tcp)
-			   && is_number_in_set(STATUS_SUCCESSFUL, status_set);
-		strace_close_memstream(tcp, publish);
-		if (!publish) {
-			line_ended();
-			return 0;
-		}
+	if (strace_output_staged(tcp) && !publish_staged_output(tcp)) {
+		line_ended();
+		return 0;
 	}
 
 	tprints(") ");
@@ -1102,11 +1339,19 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	line_ended();
 
 #ifdef ENABLE_STACKTRACE
-	if (stack_trace_enabled)
+	/* With DataSeries output, the stack goes to the stack store. */
+	if (stack_trace_enabled
+# ifdef ENABLE_DATASERIES
+	    && !ds_module
+# endif
+	   )
 		unwind_tcb_print(tcp);
 #endif
 #ifdef ENABLE_DATASERIES
 	if (ds_module) {
+		const enum profile_phase prev =
+			profile_enter(PROFILE_DATASERIES);
+
 		/*
 		 * Write record in dataseries file for the system call which
 		 * is being traced.
@@ -1134,733 +1379,18 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 		 * pid is same as tid.
 		 */
 		common_fields[DS_COMMON_FIELD_EXECUTING_TID] = &tcp->pid;
-		switch (tcp->s_ent->sen) {
-			case SEN_open: /* open system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "open", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_openat: /* openat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "openat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_close: /* close system call */
-				ds_write_record(ds_module, "close", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_read: /* read system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_rval);
-				ds_write_record(ds_module, "read", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_write: /* write system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module, "write", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_chdir: /* chdir system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "chdir", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_chroot: /* chroot system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "chroot", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_mkdir: /* mkdir system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "mkdir", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_mkdirat: /* mkdirat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "mkdirat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_rmdir: /* rmdir system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "rmdir", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_link: /* link system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "link", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_linkat: /* linkat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				v_args[1] = ds_get_path(tcp, tcp->u_arg[3]);
-				ds_write_record(ds_module, "linkat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_symlink: /* symlink system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "symlink", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_symlinkat: /* symlinkat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_path(tcp, tcp->u_arg[2]);
-				ds_write_record(ds_module, "symlinkat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_unlink: /* unlink system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "unlink", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_unlinkat: /* unlinkat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "unlinkat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_truncate: /* truncate system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "truncate", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_ftruncate: /* ftruncate system call */
-				ds_write_record(ds_module, "ftruncate", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_flock: /* flock system call */
-				ds_write_record(ds_module, "flock", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_creat: /* creat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "creat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_access: /* access system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "access", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_faccessat: /* faccessat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "faccessat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_chmod: /* chmod system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "chmod", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_umask: /* umask system call */
-				ds_write_record(ds_module, "umask", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fchmod: /* fchmod system call */
-				ds_write_record(ds_module, "fchmod", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fchmodat: /* fchmodat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "fchmodat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fchdir: /* fchmod system call */
-				ds_write_record(ds_module, "fchdir", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_lseek: /* lseek system call */
-				ds_write_record(ds_module, "lseek", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_pread: /* pread system call */
-				v_args[0] =  ds_get_buffer(tcp, tcp->u_arg[1],
-							   tcp->u_rval);
-				ds_write_record(ds_module, "pread", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_pwrite: /* pwrite system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module, "pwrite", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_stat: /* stat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct stat));
-				ds_write_record(ds_module, "stat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_statfs: /* statfs system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct statfs));
-				ds_write_record(ds_module, "statfs", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fstatfs: /* fstatfs system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct statfs));
-				ds_write_record(ds_module, "fstatfs", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_chown: /* chown system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "chown", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_readlink: /* readlink system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_rval);
-				ds_write_record(ds_module, "readlink", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_readv: /* readv system call */
-				/* iov_number equals to '-1' denotes first record. */
-				iov_number = -1;
-				v_args[0] = &iov_number;
-				v_args[1] = &tcp->u_rval;
-				/* First, write the first record. */
-				ds_write_record(ds_module, "readv", tcp->u_arg,
-						common_fields, v_args);
-				/*
-				 * Then, iteratively write the record for each
-				 * buffer passed in struct iovec.
-				 */
-				ds_write_iov_records(tcp, tcp->u_arg[1], "readv",
-						common_fields, v_args, tcp->u_arg[2]);
-				break;
-			case SEN_writev: /* writev system call */
-				/* iov_number equals to '-1' denotes first record. */
-				iov_number = -1;
-				v_args[0] = &iov_number;
-				v_args[1] = &tcp->u_rval;
-				/* First, write the first record. */
-				ds_write_record(ds_module, "writev", tcp->u_arg,
-						common_fields, v_args);
-				/*
-				 * Then, iteratively write the record for each
-				 * buffer passed in struct iovec.
-				 */
-				ds_write_iov_records(tcp, tcp->u_arg[1], "writev",
-						common_fields, v_args, tcp->u_arg[2]);
-				break;
-			case SEN_utime: /* utime system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct utimbuf));
-				ds_write_record(ds_module, "utime", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_lstat: /* lstat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct stat));
-				ds_write_record(ds_module, "lstat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fstat: /* fstat system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct stat));
-				ds_write_record(ds_module, "fstat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_newfstatat: /* fstatat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  sizeof(struct stat));
-				ds_write_record(ds_module, "fstatat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_utimes: /* utimes system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  2 * sizeof(struct timespec));
-				ds_write_record(ds_module, "utimes", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_utimensat_time32:
-			case SEN_utimensat_time64: /* utimensat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[2],
-							2 * sizeof(struct timespec));
-				ds_write_record(ds_module, "utimensat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_rename: /* rename system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "rename", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fsync: /* fsync system call */
-				ds_write_record(ds_module, "fsync", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_fdatasync: /* fdatasync system call */
-				ds_write_record(ds_module, "fdatasync", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_fallocate: /* fallocate system call */
-				ds_write_record(ds_module, "fallocate", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_readahead: /* readahead system call */
-				ds_write_record(ds_module, "readahead", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_mknod: /* mknod system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				ds_write_record(ds_module, "mknod", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_mknodat: /* mknodat system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "mknodat", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_pipe: /* pipe system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[0],
-							  2 * sizeof(int));
-				ds_write_record(ds_module, "pipe", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_dup: /* dup system call */
-				ds_write_record(ds_module, "dup", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_dup2: /* dup2 system call */
-				ds_write_record(ds_module, "dup2", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_dup3: /* dup3 system call */
-				ds_write_record(ds_module, "dup3", tcp->u_arg,
-						common_fields, NULL);
-				break;
-			case SEN_execve: /* execve system call */
-				/*
-				 * continuation number equal to '-1' denotes the
-				 * extra record which stores the common fields of
-				 * execve system call.
-				 */
-				continuation_number = -1;
-				v_args[0] = &continuation_number;
-				ds_write_record(ds_module, "execve", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_mmap: /* mmap system call */
-				ds_write_record(ds_module, "mmap", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_munmap: /* munmap system call */
-				ds_write_record(ds_module, "munmap", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fcntl: /* fcntl system call */
-				if ((tcp->u_arg[1] == F_SETLK) ||
-				    (tcp->u_arg[1] == F_SETLKW) ||
-				    (tcp->u_arg[1] == F_GETLK)) {
-					v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
-								 sizeof(struct flock));
-				}
-				ds_write_record(ds_module, "fcntl", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_getdents: /* getdents system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_rval);
-				ds_write_record(ds_module, "getdents", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_ioctl: /* ioctl system call */ {
-				u_int ioctl_size = ds_get_ioctl_size(ds_module);
-				if (ioctl_size > 0) {
-					v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
-								  ioctl_size);
-				} else {
-					v_args[0] = NULL;
-				}
-				ds_write_record(ds_module, "ioctl", tcp->u_arg,
-						common_fields, v_args);
-				ds_set_ioctl_size(ds_module, 0);
-				break;
-			}
-			case SEN_clone: /* clone system call */ {
-				int ctid_index = ds_get_clone_ctid_index(ds_module);
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  sizeof(int));
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[ctid_index],
-							  sizeof(int));
-				common_fields[DS_COMMON_FIELD_UNIQUE_ID] = &tcp->clone_dsid;
-				ds_write_into_same_record(ds_module, "clone", tcp->u_arg,
-							  common_fields, v_args);
-				break;
-			}
-			case SEN_vfork: /* vfork system call */
-				common_fields[DS_COMMON_FIELD_UNIQUE_ID] = &tcp->clone_dsid;
-				ds_write_into_same_record(ds_module, "vfork", tcp->u_arg,
-							  common_fields, v_args);
-				break;
-			case SEN_setrlimit: /* setrlimit system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-					sizeof(struct rlimit));
-				ds_write_record(ds_module, "setrlimit", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_getrlimit: /* getrlimit system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  sizeof(struct rlimit));
-				ds_write_record(ds_module, "getrlimit", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_setpgid: /* setpgid system call */
-				ds_write_record(ds_module, "setpgid", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_setsid: /* setsid system call */
-				ds_write_record(ds_module, "setsid", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_setxattr: /* lsetxattr and setxattr system calls */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_name(tcp, tcp->u_arg[1]);
-				v_args[2] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  tcp->u_arg[3]);
-				if (tcp->s_ent->sys_name[0] == 'l')
-					ds_write_record(ds_module, "lsetxattr", tcp->u_arg,
-							common_fields, v_args);
-				else
-					ds_write_record(ds_module, "setxattr", tcp->u_arg,
-							common_fields, v_args);
-				break;
-			case SEN_getxattr: /* lgetxattr and getxattr system calls */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_name(tcp, tcp->u_arg[1]);
-				v_args[2] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  tcp->u_rval);
-				if (tcp->s_ent->sys_name[0] == 'l')
-					ds_write_record(ds_module, "lgetxattr", tcp->u_arg,
-							common_fields, v_args);
-				else
-					ds_write_record(ds_module, "getxattr", tcp->u_arg,
-							common_fields, v_args);
-				break;
-			case SEN_fsetxattr: /* fsetxattr system call */
-				v_args[0] = ds_get_name(tcp, tcp->u_arg[1]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  tcp->u_arg[3]);
-				ds_write_record(ds_module, "fsetxattr", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_fgetxattr: /* fgetxattr system call */
-				v_args[0] = ds_get_name(tcp, tcp->u_arg[1]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[2],
-							  tcp->u_rval);
-				ds_write_record(ds_module, "fgetxattr", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_listxattr: /* Listxattr and Llistxattr system call */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_rval);
-				if (tcp->s_ent->sys_name[1] == 'l')
-					ds_write_record(ds_module, "llistxattr",
-							tcp->u_arg, common_fields, v_args);
-				else
-					ds_write_record(ds_module, "listxattr",
-							tcp->u_arg, common_fields, v_args);
-				break;
-			case SEN_flistxattr: /* Flistxattr system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_rval);
-				ds_write_record(ds_module, "flistxattr", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_removexattr: /* Removexattr & LRemovexattr system calls */
-				v_args[0] = ds_get_path(tcp, tcp->u_arg[0]);
-				v_args[1] = ds_get_name(tcp, tcp->u_arg[1]);
-				if (tcp->s_ent->sys_name[0] == 'l')
-					ds_write_record(ds_module, "lremovexattr",
-							tcp->u_arg, common_fields, v_args);
-				else
-					ds_write_record(ds_module, "removexattr",
-							tcp->u_arg, common_fields, v_args);
-				break;
-			case SEN_fremovexattr: /* FRemovexattr system call */
-				v_args[0] = ds_get_name(tcp, tcp->u_arg[1]);
-				ds_write_record(ds_module, "fremovexattr", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_socket: /* Socket system call */
-				ds_write_record(ds_module, "socket", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_epoll_create: /* epoll_create system call */
-				ds_write_record(ds_module, "epoll_create", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_epoll_create1: /* epoll_create1 system call */
-				ds_write_record(ds_module, "epoll_create1", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_connect:  /* Connect system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module, "connect", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_bind:  /* Bind system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module, "bind", tcp->u_arg,
-						common_fields, v_args);
-				break;
-				/*
-				 * NOTE: support for tracing the accept(2),
-				 * getsockname(2) and getpeername(2) system
-				 * calls is incomplete.  We do not currently
-				 * record the struct sockaddr buffer and it
-				 * is set as NULL in ds_module for now.  Nor
-				 * do we record the value of the buffer's
-				 * original length on syscall entry.
-				 */
-			case SEN_accept:  /* Accept system call */
-				if ((!tcp->u_arg[2]) ||
-				    (umoven(tcp, tcp->u_arg[2], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[0] = &ulen;
-				ds_write_record(ds_module, "accept", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_accept4:  /* Accept system call */
-				if ((!tcp->u_arg[2]) ||
-				    (umoven(tcp, tcp->u_arg[2], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[0] = &ulen;
-				ds_write_record(ds_module, "accept4", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_getsockname: /* Getsockname system call */
-				if ((!tcp->u_arg[2]) ||
-				    (umoven(tcp, tcp->u_arg[2], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[0] = &ulen;
-				ds_write_record(ds_module, "getsockname", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_getpeername: /* Getpeername system call*/
-				if ((!tcp->u_arg[2]) ||
-				    (umoven(tcp, tcp->u_arg[2], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[0] = &ulen;
-				ds_write_record(ds_module, "getpeername", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_listen: /* listen system call */
-				ds_write_record(ds_module, "listen", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_shutdown: /*shutdown system call */
-				ds_write_record(ds_module, "shutdown", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_socketpair: /* socketpair system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[3],
-							  2 * sizeof(int));
-				ds_write_record(ds_module, "socketpair", tcp->u_arg,
-						common_fields, v_args);
-				break;
-				/*
-				 * NOTE: support for tracing the
-				 * getsockopt(2) system call is incomplete.
-				 * We do not currently record the optval
-				 * buffer and it is set as NULL in ds_module
-				 * for now.  Nor do we record the value of
-				 * the buffer's original length on syscall
-				 * entry.
-				 */
-			case SEN_getsockopt: /* getsockopt system call */
-				if ((!tcp->u_arg[4]) ||
-				    (umoven(tcp, tcp->u_arg[4], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[0] = &ulen;
-				ds_write_record(ds_module, "getsockopt", tcp->u_arg,
-						common_fields, v_args);
-				v_args[0] = NULL;
-				break;
-			case SEN_setsockopt: /* setsockopt system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[3],
-							  tcp->u_arg[4]);
-				ds_write_record(ds_module, "setsockopt", tcp->u_arg,
-						common_fields, v_args);
-				break;
-				/*
-				 * NOTE: support for replaying the recv(2)
-				 * system call is incomplete.
-				 */
-			case SEN_recv: /* recv system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module,"recv", tcp->u_arg,
-						common_fields, v_args);
-				break;
-				/*
-				 * NOTE: support for replaying the
-				 * recvfrom(2) system call is incomplete.
-				 */
-			case SEN_recvfrom: /* recvfrom system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				if ((!tcp->u_arg[5]) ||
-				    (umoven(tcp, tcp->u_arg[5], sizeof(socklen_t), &ulen) < 0)) {
-				  ulen = 0;
-				}
-				v_args[1] = &ulen;
-				ds_write_record(ds_module, "recvfrom", tcp->u_arg,
-						common_fields, v_args);
-				v_args[1] = NULL;
-				break;
-				/*
-				 * NOTE: support for replaying the
-				 * recvmsg(2) system call is incomplete.
-				 */
-			case SEN_recvmsg: /* recvmsg system call*/
-				msg = ds_get_buffer(tcp, tcp->u_arg[1],
-						    sizeof(struct msghdr));
-				/* iov_number equals to '-1' denotes first record */
-				iov_number = -1;
-				if (!msg) {
-				  v_args[0] = NULL;
-				  v_args[1] = NULL;
-				} else {
-				  v_args[0] = &iov_number;
-				  v_args[1] = &tcp->u_rval;
-				}
-				/* Write the first record */
-				ds_write_record(ds_module, "recvmsg", tcp->u_arg,
-						common_fields, v_args);
-				/*
-				 * Then, iteratively write the record for each
-				 * buffer passed in struct iovec.
-				 */
-				if (msg) {
-				  ds_write_iov_records(tcp, (long)msg->msg_iov,
-						       "recvmsg", common_fields,
-						       v_args, msg->msg_iovlen);
-				  free(msg);
-				}
-				break;
-			case SEN_send: /* send system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				ds_write_record(ds_module, "send", tcp->u_arg,
-						common_fields, v_args);
-				break;
-			case SEN_sendto: /* sendto system call */
-				v_args[0] = ds_get_buffer(tcp, tcp->u_arg[1],
-							  tcp->u_arg[2]);
-				v_args[1] = ds_get_buffer(tcp, tcp->u_arg[4],
-							  tcp->u_arg[5]);
-				ds_write_record(ds_module, "sendto", tcp->u_arg,
-						common_fields, v_args);
-				break;
-				/*
-				 * NOTE: support for tracing the sendmsg
-				 * system call is incomplete.  Currently, we
-				 * do not record all the fields in the
-				 * struct msghdr.
-				 */
-			case SEN_sendmsg: /* sendmsg system call */
-				msg = ds_get_buffer(tcp, tcp->u_arg[1],
-						    sizeof(struct msghdr));
-				/* iov_number equals to '-1' denotes first record. */
-				iov_number = -1;
-				if (!msg) {
-					v_args[0] = NULL;
-					v_args[1] = NULL;
-				} else {
-					v_args[0] = &iov_number;
-					v_args[1] = &tcp->u_rval;
-				}
-				/* Write the first record. */
-				ds_write_record(ds_module, "sendmsg", tcp->u_arg,
-						common_fields, v_args);
-				/*
-				 * Then, iteratively write the record for each
-				 * buffer passed in struct iovec.
-				 */
-				if (msg) {
-					ds_write_iov_records(tcp, (long)msg->msg_iov,
-							     "sendmsg", common_fields,
-							     v_args, msg->msg_iovlen);
-					free(msg);
-				}
-				break;
-			/*
-			 * These system calls are chosen not be traced by
-			 * reanimator-strace.
-			 */
-			case SEN_brk:
-			case SEN_mprotect:
-			case SEN_arch_prctl:
-			case SEN_rt_sigaction:
-			case SEN_getpid:
-			case SEN_wait4:
-			case SEN_getrusage:
-			case SEN_getcwd:
-			case SEN_rt_sigprocmask:
-			case SEN_mremap:
-			case SEN_madvise:
-			case SEN_rt_sigreturn:
-			case SEN_sigreturn:
-			case SEN_rt_sigsuspend:
-			case SEN_getuid:
-			case SEN_getgid:
-			case SEN_geteuid:
-			case SEN_getegid:
-			case SEN_uname:
-			case SEN_getppid:
-			case SEN_getpgrp:
-			case SEN_nanosleep_time32:
-			case SEN_nanosleep_time64:
-			case SEN_set_tid_address:
-			case SEN_set_robust_list:
-			case SEN_futex_time32:
-			case SEN_futex_time64:
-			case SEN_getgroups:
-			case SEN_fadvise64:
-			case SEN_sched_getaffinity:
-			case SEN_sigaltstack:
-			case SEN_poll_time32:
-			case SEN_poll_time64:
-			case SEN_select:
-				ds_add_to_untraced_set(ds_module,
-						       tcp->s_ent->sys_name,
-						       tcp->scno);
-				break;
-			default:
-				ds_print_warning(ds_module,
-						 tcp->s_ent->sys_name,
-						 tcp->scno);
-		}
-		/* Free memory allocated to v_args. */
-		for (i = 0; i < DS_MAX_ARGS; i++) {
-			if (v_args[i])
-				free(v_args[i]);
-		}
+		ds_fds_claim_id(tcp, common_fields);
+		ds_stacks_claim_id(tcp, common_fields);
+		if (!ds_capture_exiting(tcp, common_fields, v_args))
+			ds_write_custom_records(tcp, common_fields, v_args);
+		ds_fds_record(tcp, common_fields, v_args);
+		ds_stacks_record(tcp, common_fields);
+		/*
+		 * Memory allocated to v_args belongs to the tcb arena
+		 * and is released in syscall_exiting_finish().
+		 */
+		ds_forget_args();
+		profile_leave(prev);
 	}
 #endif /* ENABLE_DATASERIES */
 	return 0;
@@ -1872,6 +1402,10 @@ syscall_exiting_finish(struct tcb *tcp)
 	tcp->flags &= ~(TCB_INSYSCALL | TCB_TAMPERED | TCB_INJECT_DELAY_EXIT);
 	tcp->sys_func_rval = 0;
 	free_tcb_priv_data(tcp);
+#ifdef ENABLE_DATASERIES
+	ds_arena_reset(tcp);
+	tcp->ds_stack_id = 0;
+#endif
 
 	if (cflag)
 		tcp->ltime = tcp->stime;
@@ -2257,7 +1791,15 @@ get_scno(struct tcb *tcp)
 	}
 
 	tcp->scno = shuffle_scno(tcp->scno);
+	set_sysent(tcp);
+
+	return 1;
+}
 
+/* Looks up the sysent of the syscall tcp->scno. */
+static void
+set_sysent(struct tcb *tcp)
+{
 	if (scno_is_valid(tcp->scno)) {
 		tcp->s_ent = &sysent[tcp->scno];
 		tcp->qual_flg = qual_flags(tcp->scno);
@@ -2284,8 +1826,6 @@ get_scno(struct tcb *tcp)
 	 */
 	if (recovering(tcp))
 		tcp->qual_flg |= QUAL_RAW;
-
-	return 1;
 }
 
 static int
@@ -265,7 +265,7 @@ term_ioctl(struct tcb *const tcp, const unsigned int code,
 		tprints(", ");
 #ifdef ENABLE_DATASERIES
 		if (ds_module)
-			ds_set_ioctl_size(ds_module, 1);
+			ds_stage_ioctl_size(1);
 #endif /* ENABLE_DATASERIES */
 		printstrn(tcp, arg, 1);
 		break;
@@ -0,0 +1,112 @@
+#!/bin/sh
+#
+# Measure the tracing overhead of strace on the workloads of
+# bench_workload.c.  Each workload is run untraced, traced with text
+# output written to a file, and, if strace is built with DataSeries
+# support, traced with --dataseries.  The results are printed as CSV:
+#
+#   workload,mode,ops,seconds,ops_per_sec,slowdown,tracer_rss_kb
+#
+# where slowdown is the time relative to the untraced run.  If a
+# thresholds file is given, every line "WORKLOAD MODE MAX_SLOWDOWN" in it
+# is checked, and the exit status is 1 if any slowdown exceeds its limit.
+#
+# Usage: ./bench.sh [THRESHOLDS]
+#
+# Environment: STRACE (default ../strace), BENCH_WORKLOAD (default
+# ./bench_workload), BENCH_SCALE (a percentage of the default number of
+# operations, default 100), TMPDIR.
+#
+# Copyright (c) 2020 The strace developers.
+# All rights reserved.
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+
+set -e
+
+STRACE="${STRACE:-../strace}"
+BENCH_WORKLOAD="${BENCH_WORKLOAD:-./bench_workload}"
+BENCH_SCALE="${BENCH_SCALE:-100}"
+thresholds="$1"
+
+tmpdir="$(mktemp -d "${TMPDIR:-/tmp}/strace-bench.XXXXXX")"
+trap 'rm -rf "$tmpdir"' EXIT
+export TMPDIR="$tmpdir"
+
+modes='untraced text'
+if "$STRACE" -h 2>&1 | grep -q -e '--dataseries'; then
+	modes="$modes dataseries"
+fi
+
+# workload, default number of operations
+workloads='
+small-read 200000
+large-write 2000
+fork-exec 200
+futex 50000
+readv-writev 100000
+'
+
+run()
+{
+	mode="$1"; shift
+
+	case "$mode" in
+	untraced)
+		"$@" ;;
+	text)
+		"$STRACE" -f -qq -o "$tmpdir/out" "$@" ;;
+	dataseries)
+		"$STRACE" -f -qq --dataseries "$tmpdir/out.ds" "$@" ;;
+	esac
+	rm -f "$tmpdir"/out*
+}
+
+# Prints the value of KEY=... in the line of bench_workload.
+field()
+{
+	printf '%s\n' "$2" | tr ' ' '\n' | sed -n "s/^$1=//p"
+}
+
+{
+echo 'workload,mode,ops,seconds,ops_per_sec,slowdown,tracer_rss_kb'
+printf '%s\n' "$workloads" | while read -r workload n; do
+	[ -n "$workload" ] || continue
+	n=$((n * BENCH_SCALE / 100))
+	[ "$n" -gt 0 ] || n=1
+	base=
+	for mode in $modes; do
+		line="$(run "$mode" "$BENCH_WORKLOAD" "$workload" "$n")"
+		ops="$(field ops "$line")"
+		seconds="$(field seconds "$line")"
+		rss="$(field tracer_rss_kb "$line")"
+		[ -n "$base" ] || base="$seconds"
+		awk -v w="$workload" -v m="$mode" -v o="$ops" -v s="$seconds" \
+		    -v b="$base" -v r="$rss" 'BEGIN {
+			printf "%s,%s,%d,%.6f,%.0f,%.2f,%d\n",
+			       w, m, o, s, (s > 0 ? o / s : 0),
+			       (b > 0 ? s / b : 0), r
+		}'
+	done
+done
+} | tee "$tmpdir/results"
+
+[ -n "$thresholds" ] || exit 0
+
+# Each threshold line that matches a result is checked.
+awk -F, -v thresholds="$thresholds" '
+BEGIN {
+	while ((getline line < thresholds) > 0) {
+		if (line ~ /^[ \t]*(#|$)/)
+			continue
+		split(line, f, " ")
+		limit[f[1] "," f[2]] = f[3]
+	}
+}
+NR > 1 && ($1 "," $2) in limit && $6 > limit[$1 "," $2] {
+	printf "bench: %s/%s: slowdown %.2f exceeds %.2f\n",
+	       $1, $2, $6, limit[$1 "," $2] > "/dev/stderr"
+	failed = 1
+}
+END { exit failed }
+' "$tmpdir/results"
@@ -0,0 +1,302 @@
+/*
+ * Synthetic workloads for measuring the tracing overhead, see bench.sh.
+ *
+ * Each workload makes a known number of operations and prints one line
+ *
+ *   workload=NAME ops=N seconds=S tracer_rss_kb=K
+ *
+ * where S is the time the operations took, measured by the workload
+ * itself so that the startup of the tracer is not included, and K is
+ * the peak RSS of the process tracing us, 0 if there is none.  An
+ * operation is one syscall, except in fork-exec, where it is a whole
+ * fork, execve of a trivial program, and wait4 cycle, and in futex,
+ * where it is a lock and unlock of a lock shared by NTHREADS threads.
+ *
+ * Usage: ./bench_workload small-read [N]
+ *        ./bench_workload large-write [N]
+ *        ./bench_workload fork-exec [N]
+ *        ./bench_workload futex [N [NTHREADS]]
+ *        ./bench_workload readv-writev [N]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* The VmHWM of our tracer, in kB. */
+static unsigned long
+tracer_rss_kb(void)
+{
+	char line[256], path[64];
+	unsigned long tracer = 0, kb = 0;
+	FILE *fp = fopen("/proc/self/status", "r");
+
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "TracerPid: %lu", &tracer) == 1)
+			break;
+	fclose(fp);
+	if (!tracer)
+		return 0;
+
+	snprintf(path, sizeof(path), "/proc/%lu/status", tracer);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "VmHWM: %lu", &kb) == 1)
+			break;
+	fclose(fp);
+	return kb;
+}
+
+/* 64-byte reads from /dev/zero. */
+static unsigned long
+small_read(unsigned long n)
+{
+	char buf[64];
+	int fd = open("/dev/zero", O_RDONLY);
+
+	if (fd < 0)
+		die("/dev/zero");
+	for (unsigned long i = 0; i < n; ++i)
+		if (read(fd, buf, sizeof(buf)) != sizeof(buf))
+			die("read");
+	close(fd);
+	return n;
+}
+
+/* 1 MiB sequential writes to an unlinked file, rewound every 64 MiB. */
+static unsigned long
+large_write(unsigned long n)
+{
+	enum { SIZE = 1 << 20 };
+	char name[] = "/tmp/bench_workload.XXXXXX";
+	const char *dir = getenv("TMPDIR");
+	char *buf = calloc(1, SIZE);
+	char *path = name;
+	int fd;
+
+	if (dir) {
+		if (asprintf(&path, "%s/bench_workload.XXXXXX", dir) < 0)
+			die("asprintf");
+	}
+	if (!buf)
+		die("calloc");
+	fd = mkstemp(path);
+	if (fd < 0)
+		die("mkstemp");
+	unlink(path);
+
+	for (unsigned long i = 0; i < n; ++i) {
+		if (write(fd, buf, SIZE) != SIZE)
+			die("write");
+		if (i % 64 == 63 && lseek(fd, 0, SEEK_SET))
+			die("lseek");
+	}
+	close(fd);
+	free(buf);
+	return n;
+}
+
+/* fork, execve of ourselves doing nothing, wait4. */
+static unsigned long
+fork_exec(unsigned long n)
+{
+	for (unsigned long i = 0; i < n; ++i) {
+		pid_t pid = fork();
+		int status;
+
+		if (pid < 0)
+			die("fork");
+		if (!pid) {
+			execl("/proc/self/exe", "bench_workload", "exit",
+			      (char *) NULL);
+			_exit(127);
+		}
+		if (waitpid(pid, &status, 0) != pid || status)
+			die("child");
+	}
+	return n;
+}
+
+/*
+ * Threads contending on a lock built on futex(2), in the way of
+ * Drepper's "Futexes Are Tricky" mutex #2.  The lock holder yields the
+ * CPU, so the others find the lock taken even on a single CPU.
+ */
+static atomic_int futex_word;
+static unsigned long futex_iterations;
+static pthread_barrier_t futex_start;
+
+static void
+futex_lock(void)
+{
+	int c = 0;
+
+	if (atomic_compare_exchange_strong(&futex_word, &c, 1))
+		return;
+	if (c != 2)
+		c = atomic_exchange(&futex_word, 2);
+	while (c) {
+		syscall(__NR_futex, &futex_word, FUTEX_WAIT_PRIVATE, 2,
+			NULL, NULL, 0);
+		c = atomic_exchange(&futex_word, 2);
+	}
+}
+
+static void
+futex_unlock(void)
+{
+	if (atomic_fetch_sub(&futex_word, 1) != 1) {
+		atomic_store(&futex_word, 0);
+		syscall(__NR_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1,
+			NULL, NULL, 0);
+	}
+}
+
+static void *
+futex_thread(void *arg)
+{
+	pthread_barrier_wait(&futex_start);
+	for (unsigned long i = 0; i < futex_iterations; ++i) {
+		futex_lock();
+		sched_yield();
+		futex_unlock();
+	}
+	return arg;
+}
+
+static unsigned long
+futex_contention(unsigned long n, unsigned long nthreads)
+{
+	pthread_t *tids = calloc(nthreads, sizeof(*tids));
+
+	if (!tids)
+		die("calloc");
+	futex_iterations = n / nthreads;
+	pthread_barrier_init(&futex_start, NULL, nthreads);
+	for (unsigned long i = 0; i < nthreads; ++i)
+		if (pthread_create(&tids[i], NULL, futex_thread, NULL))
+			die("pthread_create");
+	for (unsigned long i = 0; i < nthreads; ++i)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	return futex_iterations * nthreads;
+}
+
+/* writev and readv of 8 x 512 bytes through a pipe, 2 ops per round. */
+static unsigned long
+readv_writev(unsigned long n)
+{
+	enum { IOVS = 8, LEN = 512 };
+	static char bufs[IOVS][LEN];
+	struct iovec iov[IOVS];
+	int fds[2];
+
+	if (pipe(fds))
+		die("pipe");
+	for (unsigned int i = 0; i < IOVS; ++i) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = LEN;
+	}
+	for (unsigned long i = 0; i < n / 2; ++i) {
+		if (writev(fds[1], iov, IOVS) != IOVS * LEN)
+			die("writev");
+		if (readv(fds[0], iov, IOVS) != IOVS * LEN)
+			die("readv");
+	}
+	close(fds[0]);
+	close(fds[1]);
+	return n / 2 * 2;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		unsigned long n;
+	} defaults[] = {
+		{ "small-read",		200000 },
+		{ "large-write",	2000 },
+		{ "fork-exec",		200 },
+		{ "futex",		50000 },
+		{ "readv-writev",	100000 },
+	};
+
+	if (argc > 1 && !strcmp(argv[1], "exit"))
+		return 0;
+
+	unsigned long n, nthreads;
+	unsigned int w;
+
+	for (w = 0; argc > 1 && w < ARRAY_SIZE(defaults); ++w)
+		if (!strcmp(argv[1], defaults[w].name))
+			break;
+	if (argc < 2 || w == ARRAY_SIZE(defaults)) {
+		fprintf(stderr, "usage: %s small-read|large-write|fork-exec"
+			"|futex|readv-writev [N [NTHREADS]]\n", argv[0]);
+		return 1;
+	}
+	n = argc > 2 ? strtoul(argv[2], NULL, 0) : defaults[w].n;
+	if (!n)
+		n = defaults[w].n;
+
+	const double t0 = now();
+	unsigned long ops;
+
+	switch (w) {
+	case 0:
+		ops = small_read(n);
+		break;
+	case 1:
+		ops = large_write(n);
+		break;
+	case 2:
+		ops = fork_exec(n);
+		break;
+	case 3:
+		nthreads = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+		ops = futex_contention(n, nthreads ? nthreads : 8);
+		break;
+	default:
+		ops = readv_writev(n);
+		break;
+	}
+
+	const double t1 = now();
+
+	printf("workload=%s ops=%lu seconds=%.6f tracer_rss_kb=%lu\n",
+	       defaults[w].name, ops, t1 - t0, tracer_rss_kb());
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Measure the per-event cost of tracing a process with many threads.
+ *
+ * Starts NTHREADS threads, waits until all of them are alive, then has
+ * every thread make NCALLS getppid calls, and prints the time spent per
+ * call.  Run it under strace with growing thread counts, e.g.
+ *
+ *   for n in 10 100 1000 10000 50000; do
+ *	strace -f -qq -e trace=getppid -o /dev/null ./many_threads $n 100
+ *   done
+ *
+ * With a per-event tcb lookup that does not depend on the number of
+ * traced threads, the time per call stays roughly the same.
+ *
+ * Usage: ./many_threads NTHREADS [NCALLS]
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static pthread_barrier_t start, done;
+static unsigned long ncalls = 100;
+
+static void *
+thread(void *arg)
+{
+	pthread_barrier_wait(&start);
+	for (unsigned long i = 0; i < ncalls; ++i)
+		syscall(__NR_getppid);
+	pthread_barrier_wait(&done);
+	return arg;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s NTHREADS [NCALLS]\n", argv[0]);
+		return 1;
+	}
+
+	const unsigned long nthreads = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		ncalls = strtoul(argv[2], NULL, 0);
+	if (!nthreads || !ncalls) {
+		fprintf(stderr, "usage: %s NTHREADS [NCALLS]\n", argv[0]);
+		return 1;
+	}
+
+	pthread_t *const tids = calloc(nthreads, sizeof(*tids));
+	pthread_attr_t attr;
+
+	if (!tids) {
+		perror("calloc");
+		return 1;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN);
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	pthread_barrier_init(&done, NULL, nthreads + 1);
+
+	for (unsigned long i = 0; i < nthreads; ++i) {
+		if (pthread_create(&tids[i], &attr, thread, NULL)) {
+			fprintf(stderr, "pthread_create failed after %lu"
+				" threads\n", i);
+			return 1;
+		}
+	}
+
+	pthread_barrier_wait(&start);
+	const double t0 = now();
+	pthread_barrier_wait(&done);
+	const double t1 = now();
+
+	for (unsigned long i = 0; i < nthreads; ++i)
+		pthread_join(tids[i], NULL);
+
+	printf("%lu threads: %.0f ns per call\n", nthreads,
+	       (t1 - t0) * 1e9 / (nthreads * ncalls));
+	return 0;
+}
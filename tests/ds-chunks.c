@@ -0,0 +1,217 @@
+/*
+ * Reassemble the payloads stored in a DataSeries payload store,
+ * DSFILE.chunks, checking that its entries are consistent, and write
+ * them to stdout in the order they were stored in.
+ *
+ * Usage: ds-chunks DSFILE.chunks [TYPES]
+ *
+ * Fails unless there is at least one entry of each of the TYPES.
+ * See ds_dedup.c for the format.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <endian.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct chunk {
+	uint32_t len;
+	unsigned char *data;
+};
+
+static FILE *store;
+static struct chunk *chunks;
+static uint64_t nchunks;
+static uint64_t entries[256];
+
+/* The payload being streamed, see check_piece(). */
+static struct {
+	uint64_t unique_id;
+	uint32_t index;
+	uint64_t offset;
+} piece;
+
+static void
+get(void *const buf, const size_t size)
+{
+	if (size && fread(buf, size, 1, store) != 1)
+		error_msg_and_fail("truncated entry");
+}
+
+static uint32_t
+get_u32(void)
+{
+	uint32_t v;
+
+	get(&v, sizeof(v));
+	return le32toh(v);
+}
+
+static uint64_t
+get_u64(void)
+{
+	uint64_t v;
+
+	get(&v, sizeof(v));
+	return le64toh(v);
+}
+
+static void
+put(const void *const buf, const size_t size)
+{
+	if (size && fwrite(buf, size, 1, stdout) != 1)
+		perror_msg_and_fail("fwrite");
+}
+
+static void
+read_chunk(void)
+{
+	const uint64_t id = get_u64();
+
+	if (id != nchunks)
+		error_msg_and_fail("chunk %#jx instead of %#jx",
+				   (uintmax_t) id, (uintmax_t) nchunks);
+
+	chunks = realloc(chunks, (nchunks + 1) * sizeof(*chunks));
+	if (!chunks)
+		perror_msg_and_fail("realloc");
+
+	struct chunk *const c = &chunks[nchunks++];
+
+	c->len = get_u32();
+	c->data = malloc(c->len ? c->len : 1);
+	if (!c->data)
+		perror_msg_and_fail("malloc");
+	get(c->data, c->len);
+}
+
+/* Writes the chunks of a reference, returns the number of bytes. */
+static uint64_t
+put_chunks(void)
+{
+	const uint32_t count = get_u32();
+	uint64_t len = 0;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint64_t id = get_u64();
+
+		if (id >= nchunks)
+			error_msg_and_fail("chunk %#jx is not stored yet",
+					   (uintmax_t) id);
+		put(chunks[id].data, chunks[id].len);
+		len += chunks[id].len;
+	}
+
+	return len;
+}
+
+static void
+read_ref(void)
+{
+	const uint64_t unique_id = get_u64();
+	const uint32_t index = get_u32();
+	const uint64_t len = get_u64();
+	const uint64_t chunked = put_chunks();
+
+	if (chunked != len)
+		error_msg_and_fail("payload %#jx:%u of %ju bytes"
+				   " has %ju bytes in chunks",
+				   (uintmax_t) unique_id, index,
+				   (uintmax_t) len, (uintmax_t) chunked);
+}
+
+/*
+ * The pieces of a streamed payload follow each other, and each one
+ * starts where the previous one ended.
+ */
+static void
+check_piece(const uint64_t unique_id, const uint32_t index,
+	    const uint64_t offset)
+{
+	if (offset
+	    && (unique_id != piece.unique_id || index != piece.index
+		|| offset != piece.offset))
+		error_msg_and_fail("piece %#jx:%u at %ju does not follow"
+				   " %#jx:%u at %ju",
+				   (uintmax_t) unique_id, index,
+				   (uintmax_t) offset,
+				   (uintmax_t) piece.unique_id, piece.index,
+				   (uintmax_t) piece.offset);
+	piece.unique_id = unique_id;
+	piece.index = index;
+}
+
+static void
+read_piece(const int type)
+{
+	const uint64_t unique_id = get_u64();
+	const uint32_t index = get_u32();
+	const uint64_t offset = get_u64();
+
+	check_piece(unique_id, index, offset);
+
+	if (type == 'D') {
+		piece.offset = offset + put_chunks();
+	} else {
+		const uint32_t size = get_u32();
+		unsigned char *const data = malloc(size ? size : 1);
+
+		if (!data)
+			perror_msg_and_fail("malloc");
+		get(data, size);
+		put(data, size);
+		free(data);
+		piece.offset = offset + size;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static const char magic[] = "DSCHUNK1";
+	char buf[sizeof(magic) - 1];
+	int type;
+
+	if (argc < 2)
+		error_msg_and_fail("missing operand");
+
+	store = fopen(argv[1], "r");
+	if (!store)
+		perror_msg_and_fail("fopen: %s", argv[1]);
+
+	get(buf, sizeof(buf));
+	if (memcmp(buf, magic, sizeof(buf)))
+		error_msg_and_fail("%s: bad magic", argv[1]);
+
+	while ((type = fgetc(store)) != EOF) {
+		switch (type) {
+		case 'C':
+			read_chunk();
+			break;
+		case 'R':
+			read_ref();
+			break;
+		case 'S':
+		case 'D':
+			read_piece(type);
+			break;
+		default:
+			error_msg_and_fail("unexpected entry type %#x", type);
+		}
+		++entries[type];
+	}
+
+	for (const char *p = argc > 2 ? argv[2] : ""; *p; ++p) {
+		if (!entries[(unsigned char) *p])
+			error_msg_and_fail("no '%c' entries", *p);
+	}
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Check of the timestamps of DataSeries records taken by ds_clock.c in
+ * both --dataseries-clock modes: checks that ds_clock_read returns a
+ * monotonic time and a realtime timestamp read between two readings of
+ * these clocks, that the calibrated mode recalibrates once the interval
+ * has passed, and that every calibration is written to DSFILE.clock.
+ * Given a number of ITERATIONS, then prints how long the timestamping
+ * of a syscall, that is, of its entry and exit stops, takes in each
+ * mode:
+ *
+ *   realtime:   N ns per syscall
+ *   calibrated: N ns per syscall
+ *   speedup:    N.NNx
+ *
+ * The exit status is 1 if any check fails.
+ *
+ * Usage: ./ds-clock-read [ITERATIONS]
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#if defined ENABLE_DATASERIES \
+    && !defined MPERS_IS_m32 && !defined MPERS_IS_mx32
+
+# include "defs.h"
+# include <stdarg.h>
+# include <sys/stat.h>
+
+/* The timestamps checked are those of strace itself. */
+# include "ds_clock.c"
+# include "ds_sidecar.c"
+
+/* The calibrated realtime is off by the error of the offset at most. */
+# define MAX_ERROR_NS	10000000LL
+
+# define DS_FNAME	"ds-clock-read"
+/* Magic, then 'T' u64 u64 u32 per calibration. */
+# define CLOCK_ENTRY_SIZE	(1 + 8 + 8 + 4)
+
+bool debug_flag;
+
+int64_t
+timespec_to_ns(struct timespec *t)
+{
+	return t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+FILE *
+strace_fopen(const char *path, const char *mode)
+{
+	FILE *const fp = fopen(path, mode);
+
+	if (!fp)
+		perror_msg_and_die("%s", path);
+	return fp;
+}
+
+static void
+vmsg(const char *fmt, va_list args)
+{
+	vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+}
+
+void
+error_msg(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vmsg(fmt, args);
+	va_end(args);
+}
+
+void
+perror_msg(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vmsg(fmt, args);
+	va_end(args);
+}
+
+void
+error_msg_and_help(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vmsg(fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+void
+error_msg_and_die(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vmsg(fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+void
+perror_msg_and_die(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vmsg(fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+static int64_t
+read_ns(const clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return timespec_to_ns(&ts);
+}
+
+/* Reads the clocks around ds_clock_read and checks what it returns. */
+static int
+check_read(const char *const mode, const int64_t max_error)
+{
+	const int64_t mono0 = read_ns(CLOCK_MONOTONIC);
+	const int64_t real0 = read_ns(CLOCK_REALTIME);
+	struct timespec mono;
+	int64_t real;
+
+	ds_clock_read(&mono, &real);
+
+	const int64_t real1 = read_ns(CLOCK_REALTIME);
+	const int64_t mono1 = read_ns(CLOCK_MONOTONIC);
+	const int64_t mono_ns = timespec_to_ns(&mono);
+	int failed = 0;
+
+	if (mono_ns < mono0 || mono_ns > mono1) {
+		fprintf(stderr, "%s: monotonic %" PRId64 " is not within"
+			" [%" PRId64 ", %" PRId64 "]\n",
+			mode, mono_ns, mono0, mono1);
+		failed = 1;
+	}
+	if (real < real0 - max_error || real > real1 + max_error) {
+		fprintf(stderr, "%s: realtime %" PRId64 " is not within"
+			" [%" PRId64 ", %" PRId64 "] +- %" PRId64 "\n",
+			mode, real, real0, real1, max_error);
+		failed = 1;
+	}
+
+	return failed;
+}
+
+static int
+check_clock_file(const uint64_t count)
+{
+	struct stat st;
+
+	if (stat(DS_FNAME ".clock", &st)) {
+		perror(DS_FNAME ".clock");
+		return 1;
+	}
+	if ((uint64_t) st.st_size
+	    != strlen(DS_CLOCK_MAGIC) + count * CLOCK_ENTRY_SIZE) {
+		fprintf(stderr, "%s.clock: %lld bytes for %" PRIu64
+			" calibrations\n", DS_FNAME,
+			(long long) st.st_size, count);
+		return 1;
+	}
+
+	return 0;
+}
+
+static double
+run(const unsigned long iterations)
+{
+	struct timespec mono;
+	volatile int64_t sink;
+	int64_t real;
+	const int64_t start = read_ns(CLOCK_MONOTONIC);
+
+	for (unsigned long i = 0; i < iterations; ++i) {
+		ds_clock_read(&mono, &real);	/* syscall entry */
+		sink = real;
+		ds_clock_read(&mono, &real);	/* syscall exit */
+		sink = real;
+	}
+	(void) sink;
+
+	return (double) (read_ns(CLOCK_MONOTONIC) - start) / iterations;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const unsigned long iterations =
+		argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+	int failed = 0;
+
+	ds_set_clock_mode("realtime");
+	ds_clock_init(DS_FNAME);
+	failed |= check_read("realtime", 0);
+
+	ds_set_clock_mode("calibrated");
+	ds_clock_init(DS_FNAME);
+	failed |= check_read("calibrated", MAX_ERROR_NS);
+
+	/* The next read is past the calibration interval. */
+	const uint64_t count = calibration.count;
+
+	calibration.next = read_ns(CLOCK_MONOTONIC);
+	failed |= check_read("recalibrated", MAX_ERROR_NS);
+	if (calibration.count != count + 1) {
+		fprintf(stderr, "%" PRIu64 " calibrations instead of %" PRIu64
+			"\n", calibration.count, count + 1);
+		failed = 1;
+	}
+
+	double calibrated = 0;
+
+	if (iterations) {
+		/* Warm up the vDSO pages and the branch predictors. */
+		run(iterations / 10 + 1);
+		calibrated = run(iterations);
+	}
+
+	/* One more calibration is written on finish. */
+	const uint64_t written = calibration.count + 1;
+
+	ds_clock_finish();
+	failed |= check_clock_file(written);
+	unlink(DS_FNAME ".clock");
+
+	if (!iterations)
+		return failed;
+
+	ds_set_clock_mode("realtime");
+	run(iterations / 10 + 1);
+
+	const double realtime = run(iterations);
+
+	printf("realtime:   %.1f ns per syscall\n", realtime);
+	printf("calibrated: %.1f ns per syscall\n", calibrated);
+	printf("speedup:    %.2fx\n", realtime / calibrated);
+
+	return failed;
+}
+
+#else
+
+/* strace writes DataSeries records of its native personality only. */
+# include "tests.h"
+SKIP_MAIN_UNDEFINED("ENABLE_DATASERIES")
+
+#endif
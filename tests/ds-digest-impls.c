@@ -0,0 +1,213 @@
+/*
+ * Check of the implementations of the payload digest of ds_digest.c:
+ * checks that each of them gives the same digest as the scalar one on
+ * payloads of every length up to a few blocks, whether they are digested
+ * at once or fed piece by piece, and that payloads differing in one byte
+ * or in the order of two stripes get different digests.  Given a number
+ * of ROUNDS, then prints how fast each of them is on SIZE bytes, as CSV:
+ *
+ *   impl,mb_per_sec,speedup
+ *
+ * where speedup is relative to the scalar implementation.  The exit
+ * status is 1 if any check fails.
+ *
+ * Usage: ./ds-digest-impls [ROUNDS [SIZE]]
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#ifdef ENABLE_DATASERIES
+
+/* The implementations checked are those of strace itself. */
+# include "ds_digest.c"
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <time.h>
+
+static const char *const impls[] = { "scalar", "sse2", "avx2" };
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool
+digest_eq(const struct ds_digest a, const struct ds_digest b)
+{
+	return a.lo == b.lo && a.hi == b.hi;
+}
+
+/* The digest of str[0..len) fed in random pieces. */
+static struct ds_digest
+digest_pieces(const unsigned char *const str, const size_t len)
+{
+	struct ds_digest_state st;
+
+	ds_digest_init(&st, len);
+	for (size_t pos = 0; pos < len;) {
+		const size_t piece = random() % 200;
+		const size_t n = MIN(len - pos, piece);
+
+		ds_digest_update(&st, str + pos, n);
+		pos += n;
+	}
+	return ds_digest_final(&st);
+}
+
+static int
+check(const char *const impl)
+{
+	enum { MAX_LEN = 2 * 1024 + 200 };
+	unsigned char str[MAX_LEN];
+	int failed = 0;
+
+	for (int round = 0; round < 10; ++round) {
+		for (size_t i = 0; i < MAX_LEN; ++i)
+			str[i] = random();
+
+		for (size_t len = 0; len <= MAX_LEN; ++len) {
+			ds_digest_select("scalar");
+			const struct ds_digest expected = ds_digest(str, len);
+			ds_digest_select(impl);
+
+			if (!digest_eq(ds_digest(str, len), expected)) {
+				fprintf(stderr, "%s: digest of %zu bytes"
+					" differs from scalar\n", impl, len);
+				failed = 1;
+			}
+			if (!digest_eq(digest_pieces(str, len), expected)) {
+				fprintf(stderr, "%s: digest of %zu bytes"
+					" in pieces differs\n", impl, len);
+				failed = 1;
+			}
+		}
+	}
+
+	return failed;
+}
+
+/* The digest tells apart payloads that differ in a byte or an order. */
+static int
+check_distinct(void)
+{
+	enum { LEN = 4096 };
+	static unsigned char str[LEN], other[LEN];
+	int failed = 0;
+
+	for (size_t i = 0; i < LEN; ++i)
+		str[i] = random();
+
+	const struct ds_digest d = ds_digest(str, LEN);
+
+	for (size_t i = 0; i < LEN; i += 61) {
+		memcpy(other, str, LEN);
+		other[i] ^= 1;
+		if (digest_eq(ds_digest(other, LEN), d)) {
+			fprintf(stderr, "%s: flipping byte %zu keeps"
+				" the digest\n", ds_digest_name(), i);
+			failed = 1;
+		}
+	}
+
+	/* The first two stripes swapped, and two stripes of two blocks. */
+	memcpy(other, str, LEN);
+	memcpy(other, str + 64, 64);
+	memcpy(other + 64, str, 64);
+	if (digest_eq(ds_digest(other, LEN), d)) {
+		fprintf(stderr, "%s: swapping stripes keeps the digest\n",
+			ds_digest_name());
+		failed = 1;
+	}
+	memcpy(other, str, LEN);
+	memcpy(other, str + 1024, 64);
+	memcpy(other + 1024, str, 64);
+	if (digest_eq(ds_digest(other, LEN), d)) {
+		fprintf(stderr, "%s: swapping blocks keeps the digest\n",
+			ds_digest_name());
+		failed = 1;
+	}
+
+	/* The zero padding of the last stripe is not taken for data. */
+	memset(other, 0, LEN);
+	if (digest_eq(ds_digest(other, 10), ds_digest(other, 11))) {
+		fprintf(stderr, "%s: trailing zero keeps the digest\n",
+			ds_digest_name());
+		failed = 1;
+	}
+
+	return failed;
+}
+
+static double
+measure(const unsigned char *const str, const size_t size,
+	const unsigned int rounds)
+{
+	volatile uint64_t sink = 0;
+	const double start = now();
+
+	for (unsigned int i = 0; i < rounds; ++i)
+		sink += ds_digest(str, size).lo;
+
+	(void) sink;
+	return (double) size * rounds / (now() - start) / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+	const unsigned int rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+	const size_t size = argc > 2 ? strtoul(argv[2], NULL, 0) : 65536;
+	int failed = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(impls); ++i) {
+		if (ds_digest_select(impls[i]))
+			continue;
+		failed |= check(impls[i]);
+		failed |= check_distinct();
+	}
+
+	if (!rounds)
+		return failed;
+
+	unsigned char *const str = malloc(size);
+
+	if (!str) {
+		perror("malloc");
+		return 1;
+	}
+	for (size_t i = 0; i < size; ++i)
+		str[i] = random();
+
+	double scalar = 0;
+
+	puts("impl,mb_per_sec,speedup");
+	for (size_t i = 0; i < ARRAY_SIZE(impls); ++i) {
+		if (ds_digest_select(impls[i]))
+			continue;
+
+		const double mbs = measure(str, size, rounds);
+
+		if (!i)
+			scalar = mbs;
+		printf("%s,%.0f,%.2f\n", impls[i], mbs, mbs / scalar);
+	}
+
+	return failed;
+}
+
+#else
+
+# include "tests.h"
+SKIP_MAIN_UNDEFINED("ENABLE_DATASERIES")
+
+#endif /* ENABLE_DATASERIES */
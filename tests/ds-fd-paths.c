@@ -0,0 +1,96 @@
+/*
+ * Check the descriptor store written by --dataseries-fds.
+ *
+ * Without arguments, open descriptors by an absolute path, relative to
+ * a directory descriptor, and by dup, and print the paths they are
+ * expected to be recorded with.  With DSFILE.fds as an argument, print
+ * the paths recorded in it that are in the working directory.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <endian.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static char dir[PATH_MAX];
+
+static void
+get(FILE *const fp, void *const buf, const size_t size)
+{
+	if (size && fread(buf, size, 1, fp) != 1)
+		error_msg_and_fail("truncated entry");
+}
+
+static void
+print_store(const char *const name)
+{
+	static const char magic[] = "DSFDTAB1";
+	char buf[PATH_MAX + sizeof(magic)];
+	FILE *const fp = fopen(name, "r");
+	int type;
+
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", name);
+
+	get(fp, buf, sizeof(magic) - 1);
+	if (memcmp(buf, magic, sizeof(magic) - 1))
+		error_msg_and_fail("%s: bad magic", name);
+
+	while ((type = fgetc(fp)) != EOF) {
+		uint64_t unique_id;
+		int32_t fd;
+		uint32_t len;
+
+		if (type != 'F')
+			error_msg_and_fail("unexpected entry type %#x", type);
+		get(fp, &unique_id, sizeof(unique_id));
+		get(fp, &fd, sizeof(fd));
+		get(fp, &len, sizeof(len));
+		len = le32toh(len);
+		if (len >= sizeof(buf))
+			error_msg_and_fail("path of %u bytes", len);
+		get(fp, buf, len);
+		buf[len] = '\0';
+
+		if (!strncmp(buf, dir, strlen(dir)))
+			puts(buf);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	if (!getcwd(dir, sizeof(dir)))
+		perror_msg_and_fail("getcwd");
+
+	if (argc > 1) {
+		print_store(argv[1]);
+		return 0;
+	}
+
+	int dirfd = open(dir, O_RDONLY|O_DIRECTORY);
+	if (dirfd < 0)
+		perror_msg_and_fail("open: %s", dir);
+	puts(dir);
+
+	int fd = openat(dirfd, "ds-fds.sample", O_RDONLY|O_CREAT, 0600);
+	if (fd < 0)
+		perror_msg_and_fail("openat: ds-fds.sample");
+	printf("%s/ds-fds.sample\n", dir);
+
+	if (dup(fd) < 0)
+		perror_msg_and_fail("dup");
+	printf("%s/ds-fds.sample\n", dir);
+
+	unlink("ds-fds.sample");
+	return 0;
+}
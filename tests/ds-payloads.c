@@ -0,0 +1,51 @@
+/*
+ * Write payloads for the checks of the DataSeries payload store,
+ * each at least 4096 bytes long, to stdout.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+static void
+write_all(const void *const buf, const size_t len)
+{
+	if (write(1, buf, len) != (ssize_t) len)
+		perror_msg_and_fail("write");
+}
+
+int
+main(void)
+{
+	static char same[8192];
+	static char mixed[10000];
+	static char iov_bufs[2][6000];
+	const struct iovec iov[] = {
+		{ .iov_base = iov_bufs[0], .iov_len = sizeof(iov_bufs[0]) },
+		{ .iov_base = iov_bufs[1], .iov_len = sizeof(iov_bufs[1]) },
+	};
+
+	/* The same chunks over and over. */
+	memset(same, 'x', sizeof(same));
+	for (unsigned int i = 0; i < 3; ++i)
+		write_all(same, sizeof(same));
+
+	/* Chunks that all differ, and a short last one. */
+	fill_memory(mixed, sizeof(mixed));
+	write_all(mixed, sizeof(mixed));
+
+	/* Elements of an iovec, which share the id of their syscall. */
+	fill_memory_ex(iov_bufs[0], sizeof(iov_bufs[0]), 'a', 26);
+	fill_memory_ex(iov_bufs[1], sizeof(iov_bufs[1]), '0', 10);
+	if (writev(1, iov, ARRAY_SIZE(iov))
+	    != (ssize_t) (sizeof(iov_bufs[0]) + sizeof(iov_bufs[1])))
+		perror_msg_and_fail("writev");
+
+	return 0;
+}
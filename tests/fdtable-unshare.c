@@ -0,0 +1,85 @@
+/*
+ * Check that strace -y does not print the path of a descriptor of
+ * a thread that has unshared its descriptors for another thread's.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "scno.h"
+
+static char dir[PATH_MAX + 1];
+static long fd;
+
+static long
+open_file(const char *const name)
+{
+	long rc = open(name, O_RDONLY|O_CREAT, 0600);
+
+	if (rc < 0)
+		perror_msg_and_fail("open: %s", name);
+	return rc;
+}
+
+static void
+check_fsync(const char *const name)
+{
+	const int rc = fsync(fd);
+
+	printf("%-5d fsync(%ld<", (int) syscall(__NR_gettid), fd);
+	print_quoted_string_ex(dir, false, ">:");
+	printf("/%s>) = %s\n", name, sprintrc(rc));
+}
+
+static void *
+thread(void *arg)
+{
+	if (unshare(CLONE_FILES))
+		perror_msg_and_fail("unshare");
+
+	/* The number is freed and taken again in this thread only. */
+	close(fd);
+	if (open_file("fdtable-unshare.2") != fd)
+		error_msg_and_fail("open: not %ld", fd);
+	check_fsync("fdtable-unshare.2");
+
+	/* Its descriptors are closed when the thread exits. */
+	return NULL;
+}
+
+int
+main(void)
+{
+	pthread_t t;
+
+	if (!getcwd(dir, sizeof(dir)))
+		perror_msg_and_fail("getcwd");
+
+	fd = open_file("fdtable-unshare.1");
+	check_fsync("fdtable-unshare.1");
+
+	errno = pthread_create(&t, NULL, thread, NULL);
+	if (errno)
+		perror_msg_and_fail("pthread_create");
+	errno = pthread_join(t, NULL);
+	if (errno)
+		perror_msg_and_fail("pthread_join");
+
+	check_fsync("fdtable-unshare.1");
+
+	close(fd);
+	unlink("fdtable-unshare.1");
+	unlink("fdtable-unshare.2");
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Check that strace -y does not print the stale paths of descriptors
+ * that were closed or renamed behind the back of its descriptor table.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <asm/unistd.h>
+
+static char dir[PATH_MAX + 1];
+
+static long
+open_file(const char *const name)
+{
+	long fd = open(name, O_RDONLY|O_CREAT, 0600);
+
+	if (fd < 0)
+		perror_msg_and_fail("open: %s", name);
+	return fd;
+}
+
+static void
+check_fsync(const long fd, const char *const name)
+{
+	int rc = fsync(fd);
+
+	printf("fsync(%ld<", fd);
+	print_quoted_string_ex(dir, false, ">:");
+	printf("/%s>) = %s\n", name, sprintrc(rc));
+}
+
+int
+main(void)
+{
+	if (!getcwd(dir, sizeof(dir)))
+		perror_msg_and_fail("getcwd");
+
+	/*
+	 * close_range is not decoded, and the descriptor number
+	 * it frees is taken by the next open.
+	 */
+	long fd = open_file("fdtable-y.1");
+	check_fsync(fd, "fdtable-y.1");
+#ifdef __NR_close_range
+	if (syscall(__NR_close_range, fd, fd, 0))
+#endif
+		close(fd);
+	long fd2 = open_file("fdtable-y.2");
+	if (fd2 != fd)
+		error_msg_and_fail("open: %ld instead of %ld", fd2, fd);
+	check_fsync(fd2, "fdtable-y.2");
+
+	/* A renamed file is printed by its new name. */
+	if (rename("fdtable-y.2", "fdtable-y.3"))
+		perror_msg_and_fail("rename");
+	check_fsync(fd2, "fdtable-y.3");
+
+	close(fd2);
+	unlink("fdtable-y.1");
+	unlink("fdtable-y.3");
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * This file is part of output-buffer strace test.
+ *
+ * Makes lines of trace output of every length up to a few kilobytes.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <string.h>
+#include <unistd.h>
+
+int
+main(void)
+{
+	static char dir[4096];
+
+	for (size_t len = 0; len < sizeof(dir) - 1; len += 1 + len / 16) {
+		memset(dir, 'x', len);
+		dir[len] = '\0';
+		if (!chdir(dir))
+			perror_msg_and_fail("chdir");
+	}
+
+	return 0;
+}
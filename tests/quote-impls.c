@@ -0,0 +1,186 @@
+/*
+ * Check of the implementations of the string quoting and dumping loops
+ * of quote_simd.c: checks that each of them produces the same output as
+ * the scalar one on strings of every length up to a few vectors and of
+ * every kind of content.  Given a number of ROUNDS, then prints how fast
+ * each of them is on SIZE bytes, as CSV:
+ *
+ *   function,impl,data,mb_per_sec,speedup
+ *
+ * where speedup is relative to the scalar implementation.  The exit
+ * status is 1 if any output differs.
+ *
+ * Usage: ./quote-impls [ROUNDS [SIZE]]
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/* The implementations checked are those of strace itself. */
+#include "quote_simd.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *const impls[] = { "scalar", "sse2", "avx2" };
+
+enum data_kind { DATA_TEXT, DATA_BINARY, DATA_NUM };
+static const char *const data_names[] = { "text", "binary" };
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Printable text with a special character now and then, or random bytes. */
+static void
+fill(unsigned char *const buf, const size_t size, const enum data_kind kind)
+{
+	static const char special[] = "\"\\\t\n\r\v\f\0\177\200\377";
+
+	for (size_t i = 0; i < size; ++i) {
+		if (kind == DATA_BINARY)
+			buf[i] = random();
+		else if (random() % 64)
+			buf[i] = ' ' + random() % ('~' - ' ' + 1);
+		else
+			buf[i] = special[random() % (sizeof(special) - 1)];
+	}
+}
+
+/* Output of the function `fn' of the current implementation on str. */
+static size_t
+run(const int fn, char *const out, const unsigned char *const str,
+    const size_t size)
+{
+	switch (fn) {
+	case 0:
+		return quote_span_plain(str, size);
+	case 1:
+		return quote_span_verbatim(str, size);
+	case 2:
+		return quote_hex_escape(out, str, size) - out;
+	case 3:
+		return quote_hex_pairs(out, str, size) - out;
+	default:
+		return quote_print_or_dot(out, str, size) - out;
+	}
+}
+
+static const char *const fn_names[] = {
+	"span_plain", "span_verbatim", "hex_escape", "hex_pairs", "print_or_dot"
+};
+
+static int
+check(const char *const impl)
+{
+	enum { MAX_LEN = 200 };
+	unsigned char str[MAX_LEN];
+	char expected[MAX_LEN * 4], got[MAX_LEN * 4];
+	int failed = 0;
+
+	for (int kind = 0; kind < DATA_NUM; ++kind) {
+		for (int round = 0; round < 100; ++round) {
+			fill(str, MAX_LEN, kind);
+			for (size_t len = 0; len <= MAX_LEN; ++len) {
+				for (size_t fn = 0; fn < ARRAY_SIZE(fn_names);
+				     ++fn) {
+					quote_simd_select("scalar");
+					size_t n = run(fn, expected, str, len);
+					quote_simd_select(impl);
+					size_t m = run(fn, got, str, len);
+
+					if (n == m && (fn < 2
+						       || !memcmp(expected, got,
+								  n)))
+						continue;
+					fprintf(stderr, "%s: %s differs from"
+						" scalar on %zu bytes of %s\n",
+						impl, fn_names[fn], len,
+						data_names[kind]);
+					failed = 1;
+				}
+			}
+		}
+	}
+
+	return failed;
+}
+
+static double
+measure(const int fn, char *const out, const unsigned char *const str,
+	const size_t size, const unsigned int rounds)
+{
+	volatile size_t sink = 0;
+	const double start = now();
+
+	for (unsigned int i = 0; i < rounds; ++i) {
+		/* The spans stop at the first special byte, skip past it. */
+		for (size_t off = 0; off < size; ++off) {
+			const size_t n = run(fn, out, str + off, size - off);
+
+			sink += n;
+			if (fn >= 2)
+				break;
+			off += n;
+		}
+	}
+
+	(void) sink;
+	return (double) size * rounds / (now() - start) / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+	const unsigned int rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+	const size_t size = argc > 2 ? strtoul(argv[2], NULL, 0) : 65536;
+	int failed = 0;
+
+	for (size_t i = 1; i < ARRAY_SIZE(impls); ++i) {
+		if (!quote_simd_select(impls[i]))
+			failed |= check(impls[i]);
+	}
+
+	if (!rounds)
+		return failed;
+
+	unsigned char *const str = malloc(size);
+	char *const out = malloc(size * 4);
+
+	if (!str || !out) {
+		perror("malloc");
+		return 1;
+	}
+
+	puts("function,impl,data,mb_per_sec,speedup");
+	for (int kind = 0; kind < DATA_NUM; ++kind) {
+		fill(str, size, kind);
+		for (size_t fn = 0; fn < ARRAY_SIZE(fn_names); ++fn) {
+			double scalar = 0;
+
+			for (size_t i = 0; i < ARRAY_SIZE(impls); ++i) {
+				if (quote_simd_select(impls[i]))
+					continue;
+
+				const double mbs =
+					measure(fn, out, str, size, rounds);
+
+				if (!i)
+					scalar = mbs;
+				printf("%s,%s,%s,%.0f,%.2f\n", fn_names[fn],
+				       impls[i], data_names[kind], mbs,
+				       mbs / scalar);
+			}
+		}
+	}
+
+	return failed;
+}
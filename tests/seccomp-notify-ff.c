@@ -0,0 +1,176 @@
+/*
+ * Check that --seccomp-notify -ff does not keep the output files of
+ * tracees that are gone: the threads of a group that calls exit_group,
+ * and processes killed by a signal.
+ *
+ * Usage: seccomp-notify-ff LOG
+ *
+ * The tracer has to be the parent, writing to LOG.PID.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "scno.h"
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define T 8
+#define P 192
+
+static pid_t tracer;
+static const char *log_name;
+static pthread_barrier_t barrier;
+static pid_t *tids;
+static unsigned int blocked;
+static int fds[2];
+
+/* Whether the tracer has the output file of the pid open. */
+static bool
+output_open(const pid_t pid)
+{
+	char dir_path[sizeof("/proc//fd") + sizeof(int) * 3];
+	char suffix[PATH_MAX];
+	DIR *dir;
+	struct dirent *de;
+	bool found = false;
+
+	snprintf(dir_path, sizeof(dir_path), "/proc/%d/fd", tracer);
+	snprintf(suffix, sizeof(suffix), "/%s.%d", log_name, pid);
+	const size_t suffix_len = strlen(suffix);
+
+	dir = opendir(dir_path);
+	if (!dir)
+		perror_msg_and_fail("opendir: %s", dir_path);
+
+	while (!found && (de = readdir(dir)) != NULL) {
+		char link[sizeof(dir_path) + sizeof(de->d_name)];
+		char target[PATH_MAX];
+
+		snprintf(link, sizeof(link), "%s/%s", dir_path, de->d_name);
+		const ssize_t n = readlink(link, target, sizeof(target) - 1);
+		if (n < (ssize_t) suffix_len)
+			continue;
+		target[n] = '\0';
+		found = !strcmp(target + n - suffix_len, suffix);
+	}
+
+	closedir(dir);
+	return found;
+}
+
+/*
+ * The threads block in a read, which is not traced, so that none of them
+ * has a notification pending when the group exits.
+ */
+static void *
+thread(void *arg)
+{
+	char c;
+
+	tids[(long) arg] = syscall(__NR_gettid);
+	pthread_barrier_wait(&barrier);
+	__atomic_add_fetch(&blocked, 1, __ATOMIC_SEQ_CST);
+	if (read(fds[0], &c, 1) < 0)
+		perror_msg_and_fail("read");
+	return NULL;
+}
+
+static void
+thread_group(void)
+{
+	pthread_t t;
+
+	if (pipe(fds))
+		perror_msg_and_fail("pipe");
+
+	errno = pthread_barrier_init(&barrier, NULL, T + 1);
+	if (errno)
+		perror_msg_and_fail("pthread_barrier_init");
+
+	for (long i = 0; i < T; ++i) {
+		errno = pthread_create(&t, NULL, thread, (void *) i);
+		if (errno)
+			perror_msg_and_fail("pthread_create");
+	}
+
+	pthread_barrier_wait(&barrier);
+	while (__atomic_load_n(&blocked, __ATOMIC_SEQ_CST) < T)
+		sched_yield();
+	_exit(0);
+}
+
+static void
+wait_for(const pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid)
+		perror_msg_and_fail("waitpid");
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		error_msg_and_fail("missing operand");
+	log_name = argv[1];
+	tracer = getppid();
+
+	tids = mmap(NULL, T * sizeof(*tids), PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (tids == MAP_FAILED)
+		perror_msg_and_fail("mmap");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		perror_msg_and_fail("fork");
+	if (!pid)
+		thread_group();
+	wait_for(pid);
+
+	for (unsigned int i = 0; i < T; ++i) {
+		if (!tids[i])
+			error_msg_and_fail("thread %u has not started", i);
+		if (output_open(tids[i]))
+			error_msg_and_fail("the output of thread %d of the"
+					   " exited group is still open",
+					   tids[i]);
+	}
+
+	pid_t pids[P];
+
+	for (unsigned int i = 0; i < P; ++i) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			perror_msg_and_fail("fork");
+		if (!pids[i]) {
+			kill(getpid(), SIGKILL);
+			_exit(1);
+		}
+		wait_for(pids[i]);
+	}
+
+	/* The killed ones are reaped whenever the number of tcbs doubles. */
+	unsigned int open = 0;
+	for (unsigned int i = 0; i < P; ++i)
+		open += output_open(pids[i]);
+	if (open >= P / 2)
+		error_msg_and_fail("the outputs of %u of %u killed processes"
+				   " are still open", open, P);
+
+	return 0;
+}
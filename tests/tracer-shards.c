@@ -0,0 +1,128 @@
+/*
+ * This file is part of tracer-shards strace test.
+ *
+ * Starts T threads, writes its pid to PIDFILE, waits for all of them to
+ * be traced, then calls chdir in each of them and in a forked child,
+ * printing what strace is expected to, in no particular order.
+ *
+ * Usage: tracer-shards PIDFILE
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "scno.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define T 4
+
+static pthread_barrier_t barrier;
+
+static bool
+traced(const pid_t tid)
+{
+	char path[sizeof("/proc/self/task//status") + sizeof(int) * 3];
+	char buf[256];
+	bool ret = false;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+	FILE *const fp = fopen(path, "r");
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", path);
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (!strncmp(buf, "TracerPid:", 10)) {
+			ret = atoi(buf + 10) != 0;
+			break;
+		}
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+static void
+do_chdir(const char *const who)
+{
+	const pid_t tid = syscall(__NR_gettid);
+
+	while (!traced(tid))
+		;
+
+	char dir[64];
+	snprintf(dir, sizeof(dir), "tracer-shards.test %s", who);
+	const int rc = chdir(dir);
+
+	printf("%-5d chdir(\"%s\") = %s\n", tid, dir, sprintrc(rc));
+}
+
+static void *
+thread(void *arg)
+{
+	char who[sizeof(int) * 3 + 8];
+
+	snprintf(who, sizeof(who), "thread %ld", (long) arg);
+	pthread_barrier_wait(&barrier);
+	do_chdir(who);
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	pthread_t t[T];
+
+	if (argc < 2)
+		error_msg_and_fail("missing operand");
+
+	errno = pthread_barrier_init(&barrier, NULL, T + 1);
+	if (errno)
+		perror_msg_and_fail("pthread_barrier_init");
+
+	for (long i = 0; i < T; ++i) {
+		errno = pthread_create(&t[i], NULL, thread, (void *) i);
+		if (errno)
+			perror_msg_and_fail("pthread_create");
+	}
+
+	FILE *const fp = fopen(argv[1], "w");
+	if (!fp)
+		perror_msg_and_fail("fopen: %s", argv[1]);
+	fprintf(fp, "%d\n", getpid());
+	if (fclose(fp))
+		perror_msg_and_fail("fclose: %s", argv[1]);
+
+	pthread_barrier_wait(&barrier);
+	do_chdir("main");
+
+	/* The child is traced by the shard of its parent. */
+	fflush(stdout);
+	const pid_t pid = fork();
+	if (pid < 0)
+		perror_msg_and_fail("fork");
+	if (!pid) {
+		do_chdir("child");
+		return 0;
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid)
+		perror_msg_and_fail("waitpid");
+
+	for (unsigned int i = 0; i < T; ++i) {
+		errno = pthread_join(t[i], NULL);
+		if (errno)
+			perror_msg_and_fail("pthread_join");
+	}
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Check of the lookup index of the xlat tables of xlat_index_corpus.h,
+ * that is, every generated xlat table that can be compiled without the
+ * includes of its decoder.  Checks that looking up each value of each
+ * table, and its neighbour, gives the same result with the lookup index
+ * of the table as by a scan or a bsearch.  Given a number of ROUNDS,
+ * then prints how fast both are, as CSV:
+ *
+ *   type,tables,lookups,ns_scan,ns_index,speedup
+ *
+ * The exit status is 1 if any result differs.
+ *
+ * Usage: ./xlat-index [ROUNDS]
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#if defined MPERS_IS_m32 || defined MPERS_IS_mx32
+
+/* The xlat tables of strace are built for its native personality only. */
+# include "tests.h"
+SKIP_MAIN_UNDEFINED("xlat tables of the native personality")
+
+#else
+
+# include "defs.h"
+# include <stdarg.h>
+
+/* The lookups checked are those of strace itself. */
+# include "xlat.c"
+# include "xmalloc.c"
+
+# include "xlat_index_corpus.h"
+
+static const struct {
+	const char *name;
+	const struct xlat *xlat;
+} corpus[] = {
+# define XLAT_INDEX_TABLE(name_) { #name_, name_ },
+	XLAT_INDEX_TABLES
+# undef XLAT_INDEX_TABLE
+};
+
+static const char *const type_names[] = {
+	[XT_NORMAL]	= "normal",
+	[XT_SORTED]	= "sorted",
+};
+
+/* The values looked up in a table, and the table without its index. */
+struct index_queries {
+	struct xlat scan;
+	uint64_t *vals;
+	size_t nvals;
+};
+
+static struct index_queries queries[ARRAY_SIZE(corpus)];
+
+/* xlat.c prints nothing in xlookup. */
+enum xlat_style xlat_verbosity = XLAT_STYLE_ABBREV;
+
+void
+tprintf(const char *fmt, ...)
+{
+}
+
+void
+tprints(const char *str)
+{
+}
+
+void
+tprints_comment(const char *str)
+{
+}
+
+void
+error_msg(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+void
+error_msg_and_die(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Every value of the table and its neighbour. */
+static void
+init_queries(struct index_queries *const q, const struct xlat *const x)
+{
+	q->scan = *x;
+	q->scan.index = NULL;
+	if (!x->size)
+		return;
+
+	q->vals = xcalloc(2 * x->size, sizeof(*q->vals));
+
+	for (size_t i = 0; i < x->size; ++i) {
+		q->vals[q->nvals++] = x->data[i].val;
+		q->vals[q->nvals++] = x->data[i].val + 1;
+	}
+}
+
+static int
+check(const size_t t)
+{
+	const struct index_queries *const q = &queries[t];
+	int failed = 0;
+
+	for (size_t i = 0; i < q->nvals; ++i) {
+		const char *const expected = xlookup(&q->scan, q->vals[i]);
+		const char *const str = xlookup(corpus[t].xlat, q->vals[i]);
+
+		if (str == expected)
+			continue;
+
+		fprintf(stderr, "%s: %#" PRIx64 " is %s instead of %s\n",
+			corpus[t].name, q->vals[i], str ? str : "(null)",
+			expected ? expected : "(null)");
+		failed = 1;
+	}
+
+	return failed;
+}
+
+/* Returns the time per lookup in the tables of the type, in nanoseconds. */
+static double
+measure(const enum xlat_type type, const bool scan, const unsigned int rounds,
+	size_t *const tables, size_t *const lookups)
+{
+	volatile size_t sink = 0;
+	size_t n = 0;
+	const double start = now();
+
+	*tables = 0;
+	for (unsigned int r = 0; r < rounds; ++r) {
+		for (size_t t = 0; t < ARRAY_SIZE(corpus); ++t) {
+			const struct index_queries *const q = &queries[t];
+
+			if (corpus[t].xlat->type != type)
+				continue;
+
+			const struct xlat *const x =
+				scan ? &q->scan : corpus[t].xlat;
+
+			for (size_t i = 0; i < q->nvals; ++i)
+				sink += !!xlookup(x, q->vals[i]);
+			n += q->nvals;
+			*tables += !r && q->nvals;
+		}
+	}
+
+	(void) sink;
+	*lookups = n / rounds;
+	return (now() - start) * 1e9 / n;
+}
+
+int
+main(int argc, char **argv)
+{
+	const unsigned int rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+	int failed = 0;
+
+	for (size_t t = 0; t < ARRAY_SIZE(corpus); ++t) {
+		init_queries(&queries[t], corpus[t].xlat);
+		failed |= check(t);
+	}
+
+	if (!rounds)
+		return failed;
+
+	puts("type,tables,lookups,ns_scan,ns_index,speedup");
+	for (enum xlat_type type = XT_NORMAL; type <= XT_SORTED; ++type) {
+		size_t tables, lookups;
+		const double ns_scan =
+			measure(type, true, rounds, &tables, &lookups);
+		const double ns_index =
+			measure(type, false, rounds, &tables, &lookups);
+
+		printf("%s,%zu,%zu,%.1f,%.1f,%.2f\n", type_names[type],
+		       tables, lookups, ns_scan, ns_index, ns_scan / ns_index);
+	}
+
+	return failed;
+}
+
+#endif /* !MPERS_IS_m32 && !MPERS_IS_mx32 */
@@ -13,6 +13,7 @@
  */
 
 #include "defs.h"
+#include <limits.h>
 #include <sys/uio.h>
 
 #include "scno.h"
@@ -40,6 +41,19 @@ static ssize_t strace_process_vm_readv(pid_t pid,
 # define process_vm_readv strace_process_vm_readv
 #endif /* !HAVE_PROCESS_VM_READV */
 
+static ssize_t
+process_readv_mem(const pid_t pid, const struct iovec *const local,
+		  const struct iovec *const remote, const unsigned long cnt)
+{
+	const enum profile_phase prev = profile_enter(PROFILE_UMOVE);
+	const ssize_t rc = process_vm_readv(pid, local, cnt, remote, cnt, 0);
+	profile_leave(prev);
+	if (rc < 0 && errno == ENOSYS)
+		process_vm_readv_not_supported = true;
+
+	return rc;
+}
+
 static ssize_t
 process_read_mem(const pid_t pid, void *const laddr,
 		 void *const raddr, const size_t len)
@@ -53,20 +67,98 @@ process_read_mem(const pid_t pid, void *const laddr,
 		.iov_len = len
 	};
 
-	const ssize_t rc = process_vm_readv(pid, &local, 1, &remote, 1, 0);
-	if (rc < 0 && errno == ENOSYS)
-		process_vm_readv_not_supported = true;
-
-	return rc;
+	return process_readv_mem(pid, &local, &remote, 1);
 }
 
-static int cached_idx = -1;
-static unsigned long cached_raddr[2];
+/*
+ * A small LRU cache of whole tracee pages, so that repeated and
+ * overlapping reads within one stop, e.g. the same pathname or struct
+ * fetched both for the text output and for DataSeries capture, are
+ * served from local memory.  It is invalidated on every next_event(),
+ * so it never has to be keyed by pid nor kept coherent with the tracee.
+ */
+# define UMOVE_CACHE_PAGES	16
+/* Reads spanning more pages than this bypass the cache. */
+# define UMOVE_CACHE_MAX_SPAN	4
+
+static struct umove_cache_page {
+	unsigned long raddr;
+	unsigned long generation;	/* valid if equal to umove_cache_gen */
+	unsigned long last_used;
+	char *buf;
+} umove_cache[UMOVE_CACHE_PAGES];
+
+static unsigned long umove_cache_gen = 1;
+static unsigned long umove_cache_clock;
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypasses;
+} umove_cache_stats;
 
 void
 invalidate_umove_cache(void)
 {
-	cached_idx = -1;
+	++umove_cache_gen;
+}
+
+void
+print_umove_cache_stats(void)
+{
+	debug_msg("umove cache: %" PRIu64 " page hits, %" PRIu64
+		  " page misses, %" PRIu64 " uncached reads",
+		  umove_cache_stats.hits, umove_cache_stats.misses,
+		  umove_cache_stats.bypasses);
+}
+
+/* Returns the cached copy of the tracee page at raddr, or NULL. */
+static struct umove_cache_page *
+umove_cache_find(const unsigned long raddr)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(umove_cache); ++i) {
+		struct umove_cache_page *const p = &umove_cache[i];
+
+		if (p->generation == umove_cache_gen && p->raddr == raddr) {
+			++umove_cache_stats.hits;
+			p->last_used = ++umove_cache_clock;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Takes the least recently used slot for the tracee page at raddr,
+ * which the caller is to read.  The pages of the current read have
+ * just been used, and there are more slots than they span, so none
+ * of them is taken.
+ */
+static struct umove_cache_page *
+umove_cache_claim(const unsigned long raddr, const size_t page_size)
+{
+	struct umove_cache_page *victim = &umove_cache[0];
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(umove_cache); ++i) {
+		struct umove_cache_page *const p = &umove_cache[i];
+
+		if (p->generation != umove_cache_gen) {
+			victim = p;
+			break;
+		}
+		if (p->last_used < victim->last_used)
+			victim = p;
+	}
+
+	++umove_cache_stats.misses;
+
+	if (!victim->buf)
+		victim->buf = xmalloc(page_size);
+	victim->raddr = raddr;
+	victim->generation = umove_cache_gen;
+	victim->last_used = ++umove_cache_clock;
+	return victim;
 }
 
 static ssize_t
@@ -94,39 +186,68 @@ vm_read_mem(const pid_t pid, void *const laddr,
 
 	if (!raddr_page_start ||
 	    raddr_page_next < raddr_page_start ||
-	    raddr_page_next - raddr_page_start != page_size)
+	    raddr_page_next - raddr_page_start
+	    > UMOVE_CACHE_MAX_SPAN * page_size) {
+		++umove_cache_stats.bypasses;
 		return process_read_mem(pid, laddr, (void *) taddr, len);
-
-	int idx = -1;
-	if (cached_idx >= 0) {
-		if (raddr_page_start == cached_raddr[cached_idx])
-			idx = cached_idx;
-		else if (raddr_page_start == cached_raddr[!cached_idx])
-			idx = !cached_idx;
 	}
 
-	static char *buf[2];
+	/*
+	 * The pages that are not cached are all read
+	 * by a single process_vm_readv, one iovec each.
+	 */
+	const unsigned int npages =
+		(raddr_page_next - raddr_page_start) / page_size;
+	struct umove_cache_page *pages[UMOVE_CACHE_MAX_SPAN];
+	bool missed[UMOVE_CACHE_MAX_SPAN];
+	struct iovec local[UMOVE_CACHE_MAX_SPAN];
+	struct iovec remote[UMOVE_CACHE_MAX_SPAN];
+	unsigned int nmissed = 0;
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		const unsigned long page = raddr_page_start + i * page_size;
+
+		pages[i] = umove_cache_find(page);
+		missed[i] = !pages[i];
+		if (!missed[i])
+			continue;
 
-	if (idx == -1) {
-		idx = !cached_idx;
+		pages[i] = umove_cache_claim(page, page_size);
+		local[nmissed].iov_base = pages[i]->buf;
+		local[nmissed].iov_len = page_size;
+		remote[nmissed].iov_base = (void *) page;
+		remote[nmissed].iov_len = page_size;
+		++nmissed;
+	}
 
-		if (!buf[idx])
-			buf[idx] = xmalloc(page_size);
+	const ssize_t rc = nmissed
+			   ? process_readv_mem(pid, local, remote, nmissed)
+			   : 0;
+	/* The pages are read in order, up to the first unreadable one. */
+	unsigned int nread = rc > 0 ? rc / page_size : 0;
+	size_t copied = 0;
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		if (missed[i] && !nread) {
+			for (unsigned int j = i; j < npages; ++j) {
+				if (missed[j])
+					pages[j]->generation = 0;
+			}
+			/* A short read, as process_vm_readv would return. */
+			return copied ? (ssize_t) copied : rc;
+		}
+		if (missed[i])
+			--nread;
 
-		const ssize_t rc =
-			process_read_mem(pid, buf[idx],
-					 (void *) raddr_page_start, page_size);
-		if (rc < 0)
-			return rc;
+		const unsigned long page = raddr_page_start + i * page_size;
+		const unsigned long from = MAX(page, taddr);
+		const size_t n = MIN(page + page_size, taddr + len) - from;
 
-		cached_raddr[idx] = raddr_page_start;
-		if (cached_idx < 0)
-			cached_raddr[!idx] = 0;
-		cached_idx = idx;
+		memcpy(laddr + copied, pages[i]->buf + (from - page), n);
+		copied += n;
 	}
 
-	memcpy(laddr, buf[idx] + (taddr - cached_raddr[idx]), len);
-	return len;
+	return copied;
 }
 
 static bool
@@ -140,6 +261,15 @@ tracee_addr_is_invalid(kernel_ulong_t addr)
 #endif
 }
 
+static long
+peek_word(const int pid, const kernel_ulong_t addr)
+{
+	const enum profile_phase prev = profile_enter(PROFILE_UMOVE);
+	const long val = ptrace(PTRACE_PEEKDATA, pid, addr, 0);
+	profile_leave(prev);
+	return val;
+}
+
 /* legacy method of copying from tracee */
 static int
 umoven_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
@@ -155,7 +285,7 @@ umoven_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 		union {
 			long val;
 			char x[sizeof(long)];
-		} u = { .val = ptrace(PTRACE_PEEKDATA, pid, addr, 0) };
+		} u = { .val = peek_word(pid, addr) };
 
 		switch (errno) {
 			case 0:
@@ -233,6 +363,59 @@ umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	}
 }
 
+/*
+ * Copy cnt remote buffers described by rvec[] into the local buffers
+ * described by lvec[] (which must have the same lengths) using as few
+ * process_vm_readv calls as possible: up to IOV_MAX buffers are
+ * gathered by a single call.  If a call stops short, the buffer it
+ * stopped at is retried alone with umoven and gathering resumes after
+ * it, so one bad buffer does not spoil the rest.
+ *
+ * fetched[i] tells whether buffer i has been copied.
+ * Returns the number of buffers copied.
+ */
+size_t
+umove_iovec(struct tcb *const tcp, const struct iovec *const rvec,
+	    const struct iovec *const lvec, const size_t cnt,
+	    bool *const fetched)
+{
+	size_t nfetched = 0;
+	size_t i = 0;
+
+	while (i < cnt) {
+		const size_t n = MIN(cnt - i, (size_t) IOV_MAX);
+		ssize_t rc = -1;
+
+		if (!process_vm_readv_not_supported) {
+			const enum profile_phase prev =
+				profile_enter(PROFILE_UMOVE);
+			rc = process_vm_readv(tcp->pid, lvec + i, n,
+					      rvec + i, n, 0);
+			profile_leave(prev);
+			if (rc < 0 && errno == ENOSYS)
+				process_vm_readv_not_supported = true;
+		}
+		if (rc < 0)
+			rc = 0;
+
+		size_t k;
+		for (k = i; k < i + n && (size_t) rc >= lvec[k].iov_len; ++k) {
+			rc -= lvec[k].iov_len;
+			fetched[k] = true;
+			++nfetched;
+		}
+		if (k < i + n) {
+			fetched[k] = !umoven(tcp, ptr_to_kulong(rvec[k].iov_base),
+					     lvec[k].iov_len, lvec[k].iov_base);
+			nfetched += fetched[k];
+			++k;
+		}
+		i = k;
+	}
+
+	return nfetched;
+}
+
 /*
  * Like umoven_peekdata but make the additional effort of looking
  * for a terminating zero byte.
@@ -252,7 +435,7 @@ umovestr_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 		union {
 			unsigned long val;
 			char x[sizeof(long)];
-		} u = { .val = ptrace(PTRACE_PEEKDATA, pid, addr, 0) };
+		} u = { .val = peek_word(pid, addr) };
 
 		switch (errno) {
 			case 0:
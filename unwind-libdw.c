@@ -17,6 +17,9 @@
 #include "defs.h"
 #include "unwind.h"
 #include "mmap_notify.h"
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <elfutils/libdwfl.h>
 
 struct ctx {
@@ -108,8 +111,48 @@ flush_cache_maybe(struct tcb *tcp)
 	ctx->last_proc_updating = mapping_generation;
 }
 
+static const struct unwind_symcache_module *
+get_symcache_module(Dwfl_Module *mod, const char *modname, void **userdata)
+{
+	if (userdata && *userdata)
+		return *userdata;
+
+	/*
+	 * libdw knows the build-id only once it has found the ELF file,
+	 * which is not loaded just for that: otherwise the build-id is
+	 * read from the notes of the file.
+	 */
+	const unsigned char *bits;
+	GElf_Addr vaddr;
+	const int len = dwfl_module_build_id(mod, &bits, &vaddr);
+	struct unwind_symcache_module *cmod;
+
+	if (len > 0) {
+		cmod = unwind_symcache_module_by_build_id(bits, len, modname);
+	} else {
+		/*
+		 * Without a build-id, the file has to be told apart
+		 * from the other binaries installed at the same path.
+		 */
+		struct stat st;
+
+		if (!modname || stat(modname, &st))
+			memset(&st, 0, sizeof(st));
+		cmod = unwind_symcache_module_by_file(modname ? modname : "",
+						      major(st.st_dev),
+						      minor(st.st_dev),
+						      st.st_ino,
+						      unwind_symcache_mtime(&st));
+	}
+
+	if (userdata)
+		*userdata = cmod;
+	return cmod;
+}
+
 struct frame_user_data {
 	unwind_call_action_fn call_action;
+	unwind_frame_action_fn frame_action;
 	unwind_error_action_fn error_action;
 	void *data;
 	int stack_depth;
@@ -139,14 +182,40 @@ frame_callback(Dwfl_Frame *state, void *arg)
 		const char *symname = NULL;
 		GElf_Sym sym;
 		Dwarf_Addr true_offset = pc;
+		void **userdata;
 
-		modname = dwfl_module_info(mod, NULL, NULL, NULL, NULL,
+		modname = dwfl_module_info(mod, &userdata, NULL, NULL, NULL,
 					   NULL, NULL, NULL);
-		symname = dwfl_module_addrinfo(mod, pc, &off, &sym,
-					       NULL, NULL, NULL);
 		dwfl_module_relocate_address(mod, &true_offset);
-		user_data->call_action(user_data->data, modname, symname,
-				       off, true_offset);
+
+		/*
+		 * The symbol cache module of a Dwfl_Module is kept in its
+		 * userdata, so that the symbol table of the module is not
+		 * loaded by every process as long as its frames are cached.
+		 */
+		const struct unwind_symcache_module *cmod =
+			get_symcache_module(mod, modname, userdata);
+
+		unwind_function_offset_t function_offset;
+
+		if (user_data->frame_action) {
+			user_data->frame_action(user_data->data, cmod,
+						true_offset);
+		} else {
+			if (unwind_symcache_lookup(cmod, true_offset, &symname,
+						   &function_offset)) {
+				off = function_offset;
+			} else {
+				symname = dwfl_module_addrinfo(mod, pc, &off,
+							       &sym, NULL,
+							       NULL, NULL);
+				symname = unwind_symcache_insert(cmod,
+								 true_offset,
+								 symname, off);
+			}
+			user_data->call_action(user_data->data, modname,
+					       symname, off, true_offset);
+		}
 	}
 	/* Max number of frames to print reached? */
 	if (user_data->stack_depth-- == 0)
@@ -156,10 +225,11 @@ frame_callback(Dwfl_Frame *state, void *arg)
 }
 
 static void
-tcb_walk(struct tcb *tcp,
-	 unwind_call_action_fn call_action,
-	 unwind_error_action_fn error_action,
-	 void *data)
+walk(struct tcb *tcp,
+     unwind_call_action_fn call_action,
+     unwind_frame_action_fn frame_action,
+     unwind_error_action_fn error_action,
+     void *data)
 {
 	struct ctx *ctx = tcp->unwind_ctx;
 	if (!ctx)
@@ -167,6 +237,7 @@ tcb_walk(struct tcb *tcp,
 
 	struct frame_user_data user_data = {
 		.call_action = call_action,
+		.frame_action = frame_action,
 		.error_action = error_action,
 		.data = data,
 		.stack_depth = 256,
@@ -182,10 +253,29 @@ tcb_walk(struct tcb *tcp,
 			     0);
 }
 
+static void
+tcb_walk(struct tcb *tcp,
+	 unwind_call_action_fn call_action,
+	 unwind_error_action_fn error_action,
+	 void *data)
+{
+	walk(tcp, call_action, NULL, error_action, data);
+}
+
+static void
+tcb_walk_frames(struct tcb *tcp,
+		unwind_frame_action_fn frame_action,
+		unwind_error_action_fn error_action,
+		void *data)
+{
+	walk(tcp, NULL, frame_action, error_action, data);
+}
+
 const struct unwind_unwinder_t unwinder = {
 	.name = "libdw",
 	.init = init,
 	.tcb_init = tcb_init,
 	.tcb_fin = tcb_fin,
 	.tcb_walk = tcb_walk,
+	.tcb_walk_frames = tcb_walk_frames,
 };
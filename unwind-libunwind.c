@@ -62,6 +62,7 @@ get_symbol_name(unw_cursor_t *cursor, char **name,
 static int
 print_stack_frame(struct tcb *tcp,
 		  unwind_call_action_fn call_action,
+		  unwind_frame_action_fn frame_action,
 		  unwind_error_action_fn error_action,
 		  void *data,
 		  unw_cursor_t *cursor,
@@ -80,15 +81,40 @@ print_stack_frame(struct tcb *tcp,
 	if (entry
 	    /* ignore mappings that have no PROT_EXEC bit set */
 	    && (entry->protections & MMAP_CACHE_PROT_EXECUTABLE)) {
-		unw_word_t function_offset;
-
-		get_symbol_name(cursor, symbol_name, symbol_name_size,
-				&function_offset);
 		unsigned long true_offset =
 			ip - entry->start_addr + entry->mmap_offset;
+		/*
+		 * The maps tell the device and inode of the mapped file,
+		 * but not its modification time.
+		 */
+		const struct unwind_symcache_module *module =
+			unwind_symcache_module_by_file(entry->binary_filename,
+						       entry->major,
+						       entry->minor,
+						       entry->inode, 0);
+
+		if (frame_action) {
+			frame_action(data, module, true_offset);
+			return 0;
+		}
+
+		unwind_function_offset_t function_offset;
+		const char *name;
+
+		if (!unwind_symcache_lookup(module, true_offset, &name,
+					    &function_offset)) {
+			unw_word_t offset;
+
+			get_symbol_name(cursor, symbol_name, symbol_name_size,
+					&offset);
+			function_offset = offset;
+			name = unwind_symcache_insert(module, true_offset,
+						      *symbol_name,
+						      function_offset);
+		}
 		call_action(data,
 			    entry->binary_filename,
-			    *symbol_name,
+			    name,
 			    function_offset,
 			    true_offset);
 
@@ -108,6 +134,7 @@ print_stack_frame(struct tcb *tcp,
 static void
 walk(struct tcb *tcp,
      unwind_call_action_fn call_action,
+     unwind_frame_action_fn frame_action,
      unwind_error_action_fn error_action,
      void *data)
 {
@@ -125,8 +152,9 @@ walk(struct tcb *tcp,
 		perror_func_msg_and_die("cannot initialize libunwind");
 
 	for (stack_depth = 0; stack_depth < 256; ++stack_depth) {
-		if (print_stack_frame(tcp, call_action, error_action, data,
-				&cursor, &symbol_name, &symbol_name_size) < 0)
+		if (print_stack_frame(tcp, call_action, frame_action,
+				      error_action, data, &cursor,
+				      &symbol_name, &symbol_name_size) < 0)
 			break;
 		if (unw_step(&cursor) <= 0)
 			break;
@@ -138,10 +166,11 @@ walk(struct tcb *tcp,
 }
 
 static void
-tcb_walk(struct tcb *tcp,
-	 unwind_call_action_fn call_action,
-	 unwind_error_action_fn error_action,
-	 void *data)
+walk_if_mapped(struct tcb *tcp,
+	       unwind_call_action_fn call_action,
+	       unwind_frame_action_fn frame_action,
+	       unwind_error_action_fn error_action,
+	       void *data)
 {
 	switch (mmap_cache_rebuild_if_invalid(tcp, __func__)) {
 		case MMAP_CACHE_REBUILD_RENEWED:
@@ -153,7 +182,8 @@ tcb_walk(struct tcb *tcp,
 			unw_flush_cache(libunwind_as, 0, 0);
 			ATTRIBUTE_FALLTHROUGH;
 		case MMAP_CACHE_REBUILD_READY:
-			walk(tcp, call_action, error_action, data);
+			walk(tcp, call_action, frame_action, error_action,
+			     data);
 			break;
 		default:
 			/* Do nothing */
@@ -161,10 +191,29 @@ tcb_walk(struct tcb *tcp,
 	}
 }
 
+static void
+tcb_walk(struct tcb *tcp,
+	 unwind_call_action_fn call_action,
+	 unwind_error_action_fn error_action,
+	 void *data)
+{
+	walk_if_mapped(tcp, call_action, NULL, error_action, data);
+}
+
+static void
+tcb_walk_frames(struct tcb *tcp,
+		unwind_frame_action_fn frame_action,
+		unwind_error_action_fn error_action,
+		void *data)
+{
+	walk_if_mapped(tcp, NULL, frame_action, error_action, data);
+}
+
 const struct unwind_unwinder_t unwinder = {
 	.name = "libunwind",
 	.init = init,
 	.tcb_init = tcb_init,
 	.tcb_fin = tcb_fin,
 	.tcb_walk = tcb_walk,
+	.tcb_walk_frames = tcb_walk_frames,
 };
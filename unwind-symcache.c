@@ -0,0 +1,561 @@
+/*
+ * Symbol cache for stack traces.
+ *
+ * Copyright (c) 2020 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/*
+ * Resolving a frame to a symbol is by far the most expensive part of -k:
+ * the backends search the symbol tables of the binary, which they load
+ * once per traced process.  The results are cached here, keyed by the
+ * binary and the offset of the frame in it, for all the tracees.
+ *
+ * A binary is identified by its GNU build-id, so that every process
+ * mapping it, whatever its path in the mount namespace of the process,
+ * shares the same entries.  A binary without a build-id is identified
+ * by its path and, if known, its device, inode and modification time;
+ * such entries live as long as the tracer does.  The entries of binaries with a build-id can
+ * be kept across runs in a file given by --stack-trace-cache.
+ */
+
+#include "defs.h"
+#include "unwind.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "largefile_wrappers.h"
+#include "xstring.h"
+
+struct symcache_file {
+	struct symcache_file *next;		/* in the hash chain */
+	char *filename;
+	unsigned long major, minor, inode;
+	unsigned long long mtime;		/* in ns, 0 if unknown */
+	struct unwind_symcache_module *module;
+};
+
+struct symcache_entry {
+	struct symcache_entry *next;		/* in the hash chain */
+	const struct unwind_symcache_module *module;
+	unsigned long true_offset;
+	unwind_function_offset_t function_offset;
+	char *symbol_name;			/* NULL if there is no symbol */
+};
+
+#define SYMCACHE_HASH_SIZE	256
+
+static struct unwind_symcache_module *modules[SYMCACHE_HASH_SIZE];
+static unsigned int nmodules;
+static struct symcache_file *files[SYMCACHE_HASH_SIZE];
+
+/* A power of 2, grown when there are more entries than buckets. */
+static struct symcache_entry **entries;
+static size_t entries_size;
+static size_t nentries;
+
+static uint64_t hits, misses;
+
+static const char *cache_filename;
+
+#define CACHE_FILE_MAGIC	"strace stack trace cache 1"
+
+static unsigned int
+hash_bytes(const void *const data, const size_t len)
+{
+	const unsigned char *const p = data;
+	unsigned int h = 2166136261U;
+
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+static size_t
+entry_hash(const struct unwind_symcache_module *const module,
+	   const unsigned long true_offset)
+{
+	uint64_t h = (uintptr_t) module ^ true_offset;
+
+	h *= 0x9e3779b97f4a7c15ULL;
+	return (h ^ (h >> 32)) & (entries_size - 1);
+}
+
+static struct unwind_symcache_module *
+new_module(const char *const binary_filename)
+{
+	struct unwind_symcache_module *const module =
+		xcalloc(1, sizeof(*module));
+
+	module->id = nmodules++;
+	if (binary_filename)
+		module->filename = xstrdup(binary_filename);
+	return module;
+}
+
+struct unwind_symcache_module *
+unwind_symcache_module_by_build_id(const void *const build_id,
+				   const size_t len,
+				   const char *const binary_filename)
+{
+	struct unwind_symcache_module **const bucket =
+		&modules[hash_bytes(build_id, len) % SYMCACHE_HASH_SIZE];
+	struct unwind_symcache_module *module;
+
+	for (module = *bucket; module; module = module->next) {
+		if (module->build_id_len == len
+		    && !memcmp(module->build_id, build_id, len))
+			break;
+	}
+
+	if (!module) {
+		module = new_module(NULL);
+		module->build_id = xmalloc(len);
+		memcpy(module->build_id, build_id, len);
+		module->build_id_len = len;
+		module->next = *bucket;
+		*bucket = module;
+	}
+	if (!module->filename && binary_filename)
+		module->filename = xstrdup(binary_filename);
+
+	return module;
+}
+
+/*
+ * Looks for the NT_GNU_BUILD_ID note in the PT_NOTE segments of the ELF
+ * file fd, and stores its length in *len.  Only the files of the byte
+ * order of strace are looked into.
+ */
+static unsigned char *
+read_build_id(const int fd, size_t *const len)
+{
+	union {
+		unsigned char e_ident[EI_NIDENT];
+		Elf32_Ehdr e32;
+		Elf64_Ehdr e64;
+	} ehdr;
+#if WORDS_BIGENDIAN
+	const unsigned char elfdata = ELFDATA2MSB;
+#else
+	const unsigned char elfdata = ELFDATA2LSB;
+#endif
+
+	if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr)
+	    || memcmp(ehdr.e_ident, ELFMAG, SELFMAG)
+	    || ehdr.e_ident[EI_DATA] != elfdata)
+		return NULL;
+
+	const bool is64 = ehdr.e_ident[EI_CLASS] == ELFCLASS64;
+	if (!is64 && ehdr.e_ident[EI_CLASS] != ELFCLASS32)
+		return NULL;
+
+	const uint64_t phoff = is64 ? ehdr.e64.e_phoff : ehdr.e32.e_phoff;
+	const unsigned int phnum = is64 ? ehdr.e64.e_phnum : ehdr.e32.e_phnum;
+	const size_t phsize = is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr);
+
+	for (unsigned int i = 0; i < phnum && i < 64; ++i) {
+		union {
+			Elf32_Phdr p32;
+			Elf64_Phdr p64;
+		} phdr;
+
+		if (pread(fd, &phdr, phsize, phoff + i * phsize)
+		    != (ssize_t) phsize)
+			return NULL;
+		if ((is64 ? phdr.p64.p_type : phdr.p32.p_type) != PT_NOTE)
+			continue;
+
+		const uint64_t offset =
+			is64 ? phdr.p64.p_offset : phdr.p32.p_offset;
+		const uint64_t size =
+			is64 ? phdr.p64.p_filesz : phdr.p32.p_filesz;
+		const uint64_t align =
+			(is64 ? phdr.p64.p_align : phdr.p32.p_align) == 8
+			? 8 : 4;
+		unsigned char notes[4096];
+		const size_t n = MIN(size, sizeof(notes));
+
+		if (pread(fd, notes, n, offset) != (ssize_t) n)
+			continue;
+
+		for (size_t pos = 0; pos + sizeof(Elf32_Nhdr) <= n;) {
+			Elf32_Nhdr nhdr;
+
+			memcpy(&nhdr, notes + pos, sizeof(nhdr));
+			const size_t name_pos = pos + sizeof(nhdr);
+			const size_t desc_pos = name_pos +
+				ROUNDUP(nhdr.n_namesz, align);
+			pos = desc_pos + ROUNDUP(nhdr.n_descsz, align);
+			if (pos > n || desc_pos + nhdr.n_descsz > n)
+				break;
+
+			if (nhdr.n_type == NT_GNU_BUILD_ID
+			    && nhdr.n_namesz == sizeof(ELF_NOTE_GNU)
+			    && !memcmp(notes + name_pos, ELF_NOTE_GNU,
+				       sizeof(ELF_NOTE_GNU))
+			    && nhdr.n_descsz) {
+				unsigned char *const id =
+					xmalloc(nhdr.n_descsz);
+
+				memcpy(id, notes + desc_pos, nhdr.n_descsz);
+				*len = nhdr.n_descsz;
+				return id;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The build-id of filename, if the file is still the one that has been
+ * mapped, that is, if it is on device major:minor with the given inode
+ * and, if known, modification time.
+ */
+static unsigned char *
+file_build_id(const char *const filename, const unsigned long major,
+	      const unsigned long minor, const unsigned long inode,
+	      const unsigned long long mtime, size_t *const len)
+{
+	if (filename[0] != '/')
+		return NULL;
+
+	const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	unsigned char *id = NULL;
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode)
+	    && (!inode || (st.st_ino == inode
+			   && major(st.st_dev) == major
+			   && minor(st.st_dev) == minor
+			   && (!mtime || unwind_symcache_mtime(&st) == mtime))))
+		id = read_build_id(fd, len);
+	close(fd);
+
+	return id;
+}
+
+unsigned long long
+unwind_symcache_mtime(const struct stat *const st)
+{
+	return st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+}
+
+struct unwind_symcache_module *
+unwind_symcache_module_by_file(const char *const filename,
+			       const unsigned long major,
+			       const unsigned long minor,
+			       const unsigned long inode,
+			       const unsigned long long mtime)
+{
+	struct symcache_file **const bucket =
+		&files[(hash_bytes(filename, strlen(filename)) ^ inode)
+		       % SYMCACHE_HASH_SIZE];
+	struct symcache_file *file;
+
+	for (file = *bucket; file; file = file->next) {
+		if (file->inode == inode && file->major == major
+		    && file->minor == minor && file->mtime == mtime
+		    && !strcmp(file->filename, filename))
+			return file->module;
+	}
+
+	file = xcalloc(1, sizeof(*file));
+	file->filename = xstrdup(filename);
+	file->major = major;
+	file->minor = minor;
+	file->inode = inode;
+	file->mtime = mtime;
+
+	size_t len = 0;
+	unsigned char *const id =
+		file_build_id(filename, major, minor, inode, mtime, &len);
+
+	debug_func_msg("%s: %s build-id", filename, id ? "with" : "no");
+	if (id) {
+		file->module = unwind_symcache_module_by_build_id(id, len,
+								  filename);
+		free(id);
+	} else {
+		file->module = new_module(filename);
+	}
+
+	file->next = *bucket;
+	*bucket = file;
+
+	return file->module;
+}
+
+bool
+unwind_symcache_lookup(const struct unwind_symcache_module *const module,
+		       const unsigned long true_offset,
+		       const char **const symbol_name,
+		       unwind_function_offset_t *const function_offset)
+{
+	if (entries_size) {
+		for (const struct symcache_entry *e =
+		     entries[entry_hash(module, true_offset)];
+		     e; e = e->next) {
+			if (e->module == module
+			    && e->true_offset == true_offset) {
+				++hits;
+				*symbol_name = e->symbol_name;
+				*function_offset = e->function_offset;
+				return true;
+			}
+		}
+	}
+
+	++misses;
+	return false;
+}
+
+static void
+grow_entries(void)
+{
+	struct symcache_entry **const old = entries;
+	const size_t old_size = entries_size;
+
+	entries_size = old_size ? old_size * 2 : 1024;
+	entries = xcalloc(entries_size, sizeof(*entries));
+
+	for (size_t i = 0; i < old_size; ++i) {
+		struct symcache_entry *e, *next;
+
+		for (e = old[i]; e; e = next) {
+			struct symcache_entry **const bucket =
+				&entries[entry_hash(e->module,
+						    e->true_offset)];
+
+			next = e->next;
+			e->next = *bucket;
+			*bucket = e;
+		}
+	}
+	free(old);
+}
+
+const char *
+unwind_symcache_insert(const struct unwind_symcache_module *const module,
+		       const unsigned long true_offset,
+		       const char *const symbol_name,
+		       const unwind_function_offset_t function_offset)
+{
+	if (nentries >= entries_size)
+		grow_entries();
+
+	struct symcache_entry **const bucket =
+		&entries[entry_hash(module, true_offset)];
+	struct symcache_entry *const e = xmalloc(sizeof(*e));
+
+	e->module = module;
+	e->true_offset = true_offset;
+	e->function_offset = function_offset;
+	e->symbol_name = symbol_name ? xstrdup(symbol_name) : NULL;
+	e->next = *bucket;
+	*bucket = e;
+	++nentries;
+
+	return e->symbol_name;
+}
+
+void
+unwind_set_cache_file(const char *const filename)
+{
+	cache_filename = filename;
+}
+
+static bool
+parse_build_id(const char *hex, unsigned char *const id, size_t *const len)
+{
+	size_t n = 0;
+
+	for (; *hex && *hex != '\n'; hex += 2) {
+		unsigned int byte;
+
+		if (n >= *len || sscanf(hex, "%2x", &byte) != 1 || !hex[1])
+			return false;
+		id[n++] = byte;
+	}
+
+	*len = n;
+	return n > 0;
+}
+
+/*
+ * The cache file is a text file: a header line naming the unwinder,
+ * as the offsets of the backends are not the same, then for every
+ * binary a line "B BUILD-ID" followed by lines
+ * "TRUE-OFFSET FUNCTION-OFFSET SYMBOL", or "TRUE-OFFSET FUNCTION-OFFSET"
+ * for the frames without a symbol.
+ */
+static void
+load_cache_file(void)
+{
+	FILE *const fp = fopen_stream(cache_filename, "r");
+
+	if (!fp) {
+		if (errno != ENOENT)
+			perror_msg("%s", cache_filename);
+		return;
+	}
+
+	/* Symbol names, of C++ functions in particular, have no limit. */
+	char *line = NULL;
+	size_t size = 0;
+	char magic[sizeof(CACHE_FILE_MAGIC) + 64];
+	const struct unwind_symcache_module *module = NULL;
+	unsigned int lineno = 1;
+
+	xsprintf(magic, "%s %s\n", CACHE_FILE_MAGIC, unwinder.name);
+	if (getline(&line, &size, fp) < 0 || strcmp(line, magic)) {
+		error_msg("%s: not a stack trace cache of the %s unwinder,"
+			  " ignored", cache_filename, unwinder.name);
+		free(line);
+		fclose(fp);
+		return;
+	}
+
+	while (getline(&line, &size, fp) >= 0) {
+		unsigned long true_offset, function_offset;
+		int name_pos = 0;
+
+		++lineno;
+		if (line[0] == 'B' && line[1] == ' ') {
+			unsigned char id[256];
+			size_t len = sizeof(id);
+
+			if (!parse_build_id(line + 2, id, &len))
+				break;
+			module = unwind_symcache_module_by_build_id(id, len,
+								    NULL);
+		} else if (module
+			   && sscanf(line, "%lx %lx%n", &true_offset,
+				     &function_offset, &name_pos) == 2
+			   && (line[name_pos] == ' '
+			       || line[name_pos] == '\n')) {
+			char *const name = line[name_pos] == ' '
+					   ? line + name_pos + 1 : NULL;
+			char *const end = strchr(line + name_pos, '\n');
+
+			if (!end)
+				break;
+			*end = '\0';
+			unwind_symcache_insert(module, true_offset, name,
+					       function_offset);
+		} else {
+			break;
+		}
+	}
+
+	if (!feof(fp))
+		error_msg("%s:%u: malformed stack trace cache entry,"
+			  " the rest is ignored", cache_filename, lineno);
+	free(line);
+	fclose(fp);
+
+	debug_msg("%s: loaded %zu stack trace cache entries",
+		  cache_filename, nentries);
+}
+
+static int
+entry_module_cmp(const void *a, const void *b)
+{
+	const struct symcache_entry *const ea =
+		*(const struct symcache_entry *const *) a;
+	const struct symcache_entry *const eb =
+		*(const struct symcache_entry *const *) b;
+
+	if (ea->module != eb->module)
+		return (uintptr_t) ea->module < (uintptr_t) eb->module
+		       ? -1 : 1;
+	return ea->true_offset < eb->true_offset ? -1
+	       : ea->true_offset > eb->true_offset;
+}
+
+/*
+ * Writes the entries with a build-id to a temporary file renamed over
+ * the cache file, so that a tracer reading it never sees half of it.
+ */
+static void
+save_cache_file(void)
+{
+	struct symcache_entry **const sorted =
+		xcalloc(nentries ? nentries : 1, sizeof(*sorted));
+	size_t n = 0;
+
+	for (size_t i = 0; i < entries_size; ++i) {
+		for (struct symcache_entry *e = entries[i]; e; e = e->next) {
+			if (e->module->build_id)
+				sorted[n++] = e;
+		}
+	}
+	qsort(sorted, n, sizeof(*sorted), entry_module_cmp);
+
+	char *const tmpname = xmalloc(strlen(cache_filename) + 8);
+
+	sprintf(tmpname, "%s.XXXXXX", cache_filename);
+
+	const int fd = mkstemp(tmpname);
+	FILE *fp = fd < 0 ? NULL : fdopen(fd, "w");
+
+	if (!fp) {
+		perror_msg("%s", tmpname);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		goto out;
+	}
+
+	fprintf(fp, "%s %s\n", CACHE_FILE_MAGIC, unwinder.name);
+	for (size_t i = 0; i < n; ++i) {
+		const struct symcache_entry *const e = sorted[i];
+
+		if (!i || e->module != sorted[i - 1]->module) {
+			fputs("B ", fp);
+			for (size_t j = 0; j < e->module->build_id_len; ++j)
+				fprintf(fp, "%02x", e->module->build_id[j]);
+			fputc('\n', fp);
+		}
+		fprintf(fp, "%lx %lx%s%s\n", e->true_offset,
+			(unsigned long) e->function_offset,
+			e->symbol_name ? " " : "",
+			e->symbol_name ? e->symbol_name : "");
+	}
+
+	if (fclose(fp) || rename(tmpname, cache_filename)) {
+		perror_msg("%s", cache_filename);
+		unlink(tmpname);
+	}
+
+out:
+	free(tmpname);
+	free(sorted);
+}
+
+void
+unwind_symcache_init(void)
+{
+	if (cache_filename)
+		load_cache_file();
+}
+
+void
+unwind_symcache_fin(void)
+{
+	debug_msg("stack trace cache: %" PRIu64 " hits, %" PRIu64 " misses,"
+		  " %zu entries", hits, misses, nentries);
+
+	if (cache_filename)
+		save_cache_file();
+}
@@ -38,6 +38,13 @@ unwind_init(void)
 {
 	if (unwinder.init)
 		unwinder.init();
+	unwind_symcache_init();
+}
+
+void
+unwind_fin(void)
+{
+	unwind_symcache_fin();
 }
 
 void
@@ -299,3 +306,21 @@ unwind_tcb_capture(struct tcb *tcp)
 				  tcp->unwind_queue);
 	}
 }
+
+/*
+ * walking the frames of the stack, without their symbols
+ */
+void
+unwind_tcb_walk_frames(struct tcb *tcp,
+		       unwind_frame_action_fn frame_action,
+		       unwind_error_action_fn error_action,
+		       void *data)
+{
+#if SUPPORTED_PERSONALITIES > 1
+	if (tcp->currpers != DEFAULT_PERSONALITY) {
+		/* disable stack trace */
+		return;
+	}
+#endif
+	unwinder.tcb_walk_frames(tcp, frame_action, error_action, data);
+}
@@ -28,6 +28,22 @@ typedef void (*unwind_error_action_fn)(void *data,
 				       const char *error,
 				       unsigned long true_offset);
 
+/*
+ * A binary in the symbol cache, see unwind-symcache.c.
+ */
+struct unwind_symcache_module {
+	struct unwind_symcache_module *next;	/* in the hash chain */
+	unsigned int id;			/* 0, 1, ... in creation order */
+	unsigned char *build_id;		/* NULL if there is none */
+	size_t build_id_len;
+	char *filename;				/* first file seen, or NULL */
+};
+
+/* Frames reported without resolving their symbols. */
+typedef void (*unwind_frame_action_fn)(void *data,
+				       const struct unwind_symcache_module *,
+				       unsigned long true_offset);
+
 struct unwind_unwinder_t {
 	const char *name;
 
@@ -43,8 +59,43 @@ struct unwind_unwinder_t {
 			   unwind_call_action_fn,
 			   unwind_error_action_fn,
 			   void *);
+
+	/* Walk the stack without looking up the symbols. */
+	void   (*tcb_walk_frames)(struct tcb *,
+				  unwind_frame_action_fn,
+				  unwind_error_action_fn,
+				  void *);
 };
 
 extern const struct unwind_unwinder_t unwinder;
 
+extern void unwind_tcb_walk_frames(struct tcb *, unwind_frame_action_fn,
+				   unwind_error_action_fn, void *);
+
+/*
+ * Symbol cache shared by the unwinders.
+ * A module is a binary, the offsets are the true_offset of the frames.
+ */
+extern struct unwind_symcache_module *
+unwind_symcache_module_by_build_id(const void *build_id, size_t len,
+				   const char *binary_filename);
+struct stat;
+/* The modification time of a file in ns, as unwind_symcache_module_by_file takes it. */
+extern unsigned long long unwind_symcache_mtime(const struct stat *);
+extern struct unwind_symcache_module *
+unwind_symcache_module_by_file(const char *binary_filename,
+			       unsigned long major, unsigned long minor,
+			       unsigned long inode, unsigned long long mtime);
+/* The symbol name is NULL for a cached frame without a symbol. */
+extern bool
+unwind_symcache_lookup(const struct unwind_symcache_module *,
+		       unsigned long true_offset, const char **symbol_name,
+		       unwind_function_offset_t *function_offset);
+extern const char *
+unwind_symcache_insert(const struct unwind_symcache_module *,
+		       unsigned long true_offset, const char *symbol_name,
+		       unwind_function_offset_t function_offset);
+extern void unwind_symcache_init(void);
+extern void unwind_symcache_fin(void);
+
 #endif /* !STRACE_UNWIND_H */
@@ -25,6 +25,7 @@
 
 #include "largefile_wrappers.h"
 #include "print_utils.h"
+#include "quote_simd.h"
 #include "static_assert.h"
 #include "string_to_uint.h"
 #include "xlat.h"
@@ -445,6 +446,34 @@ print_uuid(const unsigned char *uuid)
 	tprints(str);
 }
 
+/* Returns the thread group id of pid, or pid itself if it is unknown. */
+int
+get_tgid(const int pid)
+{
+	char filename[sizeof("/proc/4294967296/status")];
+	char buffer[64];
+	int tgid = pid;
+
+	xsprintf(filename, "/proc/%u/status", pid);
+
+	FILE *fp = fopen_stream(filename, "r");
+	if (!fp)
+		return pid;
+
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		if (strncmp(buffer, "Tgid:", 5))
+			continue;
+
+		const long val = strtol(buffer + 5, NULL, 10);
+		if (val > 0 && val <= INT_MAX)
+			tgid = val;
+		break;
+	}
+	fclose(fp);
+
+	return tgid;
+}
+
 enum sock_proto
 getfdproto(struct tcb *tcp, int fd)
 {
@@ -457,6 +486,10 @@ getfdproto(struct tcb *tcp, int fd)
 	if (fd < 0)
 		return SOCK_PROTO_UNKNOWN;
 
+	const enum sock_proto cached = fdtable_lookup_proto(tcp, fd);
+	if (cached != SOCK_PROTO_UNKNOWN)
+		return cached;
+
 	xsprintf(path, "/proc/%u/fd/%u", tcp->pid, fd);
 	r = getxattr(path, "system.sockprotoname", buf, bufsize - 1);
 	if (r <= 0)
@@ -468,7 +501,9 @@ getfdproto(struct tcb *tcp, int fd)
 		 */
 		buf[r] = '\0';
 
-		return get_proto_by_name(buf);
+		const enum sock_proto proto = get_proto_by_name(buf);
+		fdtable_store_proto(tcp, fd, proto);
+		return proto;
 	}
 #else
 	return SOCK_PROTO_UNKNOWN;
@@ -510,25 +545,34 @@ printsocket(struct tcb *tcp, int fd, const char *path)
 static bool
 printdev(struct tcb *tcp, int fd, const char *path)
 {
-	strace_stat_t st;
+	unsigned int type;
+	dev_t rdev;
 
 	if (path[0] != '/')
 		return false;
 
-	if (stat_file(path, &st)) {
-		debug_func_perror_msg("stat(\"%s\")", path);
-		return false;
+	if (!fdtable_lookup_type(tcp, fd, &type, &rdev)) {
+		strace_stat_t st;
+
+		if (stat_file(path, &st)) {
+			debug_func_perror_msg("stat(\"%s\")", path);
+			return false;
+		}
+
+		type = st.st_mode & S_IFMT;
+		rdev = st.st_rdev;
+		fdtable_store_type(tcp, fd, type, rdev);
 	}
 
-	switch (st.st_mode & S_IFMT) {
+	switch (type) {
 	case S_IFBLK:
 	case S_IFCHR:
 		print_quoted_string_ex(path, strlen(path),
 				       QUOTE_OMIT_LEADING_TRAILING_QUOTES,
 				       "<>");
 		tprintf("<%s %u:%u>",
-			S_ISBLK(st.st_mode)? "block" : "char",
-			major(st.st_rdev), minor(st.st_rdev));
+			type == S_IFBLK ? "block" : "char",
+			major(rdev), minor(rdev));
 		return true;
 	}
 
@@ -589,26 +633,11 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 		usehex = 1;
 	} else if (xflag) {
 		/* Check for presence of symbol which require
-		   to hex-quote the whole string. */
-		for (i = 0; i < size; ++i) {
-			c = ustr[i];
-			/* Check for NUL-terminated string. */
-			if (c == eol)
-				break;
-
-			/* Force hex unless c is printable or whitespace */
-			if (c > 0x7e) {
-				usehex = 1;
-				break;
-			}
-			/* In ASCII isspace is only these chars: "\t\n\v\f\r".
-			 * They happen to have ASCII codes 9,10,11,12,13.
-			 */
-			if (c < ' ' && (unsigned)(c - 9) >= 5) {
-				usehex = 1;
-				break;
-			}
-		}
+		   to hex-quote the whole string: force hex unless
+		   all chars are printable or whitespace, up to NUL
+		   if the string is NUL-terminated. */
+		i = quote_span_plain(ustr, size);
+		usehex = i < size && ustr[i] != eol;
 	}
 
 	if (style & QUOTE_EMIT_COMMENT)
@@ -618,20 +647,35 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 
 	if (usehex) {
 		/* Hex-quote the whole string. */
-		for (i = 0; i < size; ++i) {
-			c = ustr[i];
-			/* Check for NUL-terminated string. */
-			if (c == eol)
-				goto asciz_ended;
-			*s++ = '\\';
-			*s++ = 'x';
-			s = sprint_byte_hex(s, c);
-		}
+		const unsigned char *const end =
+			(style & QUOTE_0_TERMINATED)
+			? memchr(ustr, '\0', size) : NULL;
+
+		i = end ? end - ustr : size;
+		s = quote_hex_escape(s, ustr, i);
+		/* Check for NUL-terminated string. */
+		if (end)
+			goto asciz_ended;
 
 		goto string_ended;
 	}
 
 	for (i = 0; i < size; ++i) {
+		/* Copy the run of chars that need no quoting at once. */
+		unsigned int n = quote_span_verbatim(ustr + i, size - i);
+
+		for (const char *e = escape_chars; n && e && *e; ++e) {
+			const unsigned char *const p = memchr(ustr + i, *e, n);
+
+			if (p)
+				n = p - (ustr + i);
+		}
+		memcpy(s, ustr + i, n);
+		s += n;
+		i += n;
+		if (i == size)
+			break;
+
 		c = ustr[i];
 		/* Check for NUL-terminated string. */
 		if (c == eol)
@@ -1139,35 +1183,51 @@ dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
 			src = str;
 		}
 
-		/* hex dump */
-		do {
-			if (i < len) {
-				dst = sprint_byte_hex(dst, *src);
-			} else {
-				*dst++ = ' ';
-				*dst++ = ' ';
+		if (len - i >= DUMPSTR_WIDTH_BYTES) {
+			/* A full line, encoded all at once.  */
+			char hex[DUMPSTR_WIDTH_BYTES * 2];
+
+			quote_hex_pairs(hex, src, DUMPSTR_WIDTH_BYTES);
+			for (unsigned int j = 0; j < DUMPSTR_WIDTH_BYTES; ++j) {
+				memcpy(dst, hex + j * 2, 2);
+				dst += 3; /* space is there */
+				if (((j + 1) & DUMPSTR_GROUP_MASK) == 0)
+					dst++; /* space is there */
 			}
-			dst++; /* space is there */
-			i++;
-			if ((i & DUMPSTR_GROUP_MASK) == 0)
+			quote_print_or_dot(dst, src, DUMPSTR_WIDTH_BYTES);
+			src += DUMPSTR_WIDTH_BYTES;
+			i += DUMPSTR_WIDTH_BYTES;
+		} else {
+			/* hex dump */
+			do {
+				if (i < len) {
+					dst = sprint_byte_hex(dst, *src);
+				} else {
+					*dst++ = ' ';
+					*dst++ = ' ';
+				}
 				dst++; /* space is there */
-			src++;
-		} while (i & DUMPSTR_BYTES_MASK);
-
-		/* ASCII dump */
-		i -= DUMPSTR_WIDTH_BYTES;
-		src -= DUMPSTR_WIDTH_BYTES;
-		do {
-			if (i < len) {
-				if (is_print(*src))
-					*dst++ = *src;
-				else
-					*dst++ = '.';
-			} else {
-				*dst++ = ' ';
-			}
-			src++;
-		} while (++i & DUMPSTR_BYTES_MASK);
+				i++;
+				if ((i & DUMPSTR_GROUP_MASK) == 0)
+					dst++; /* space is there */
+				src++;
+			} while (i & DUMPSTR_BYTES_MASK);
+
+			/* ASCII dump */
+			i -= DUMPSTR_WIDTH_BYTES;
+			src -= DUMPSTR_WIDTH_BYTES;
+			do {
+				if (i < len) {
+					if (is_print(*src))
+						*dst++ = *src;
+					else
+						*dst++ = '.';
+				} else {
+					*dst++ = ' ';
+				}
+				src++;
+			} while (++i & DUMPSTR_BYTES_MASK);
+		}
 
 		tprintf(" | %0*" PRI_klx "  %s |\n",
 			offs_chars, i - DUMPSTR_WIDTH_BYTES, outbuf);
@@ -1487,10 +1547,10 @@ ds_get_path(struct tcb *tcp, long addr)
 		goto out;
 
 	/*
-	 * Note: xmalloc succeeds always or aborts the trace process
-	 * with an error message to stderr.
+	 * Note: ds_arena_alloc succeeds always or aborts the trace
+	 * process with an error message to stderr.
 	 */
-	path = xmalloc(PATH_MAX + 1);
+	path = ds_arena_alloc(tcp, PATH_MAX + 1);
 
 	/*
 	 * Fetch one byte more to find out whether path length is
@@ -1501,13 +1561,14 @@ ds_get_path(struct tcb *tcp, long addr)
 		goto out_free;
 	else {
 		path[PATH_MAX] = '\0';
+		/* Give the unused tail of the buffer back to the arena. */
+		ds_arena_trim(tcp, path, strlen(path) + 1);
+		ds_note_arg(path, strlen(path) + 1);
 		goto out;
 	}
 out_free:
-	if (path) {
-		free(path);
-		path = NULL;
-	}
+	ds_arena_trim(tcp, path, 0);
+	path = NULL;
 out:
 	return path;
 }
@@ -1527,22 +1588,161 @@ ds_get_buffer(struct tcb *tcp, long addr, long len)
 		goto out;
 
 	/*
-	 * Note: xmalloc succeeds always or aborts the trace process
-	 * with an error message to stderr.
+	 * Note: ds_arena_alloc succeeds always or aborts the trace
+	 * process with an error message to stderr.
 	 */
-	buf = xmalloc(len);
+	buf = ds_arena_alloc(tcp, len);
 
-	if (umoven(tcp, addr, len, buf) >= 0)
+	if (umoven(tcp, addr, len, buf) >= 0) {
+		ds_note_arg(buf, len);
 		goto out; /* Success condition */
-
-	if (buf) {
-		free(buf);
-		buf = NULL;
 	}
+
+	ds_arena_trim(tcp, buf, 0);
+	buf = NULL;
 out:
 	return buf;
 }
 
+/*
+ * Returns the number of bytes of a len bytes long payload
+ * that have to be copied from the tracee under the given policy.
+ */
+static size_t
+ds_capture_size(const struct ds_capture_policy *policy, size_t len)
+{
+	switch (policy->mode) {
+	case DS_CAPTURE_NONE:
+		return 0;
+	case DS_CAPTURE_TRUNCATE:
+		return MIN(len, policy->limit);
+	default:
+		return len;
+	}
+}
+
+/*
+ * Applies the capture policy to a payload of len bytes, buf holds
+ * the first ds_capture_size() bytes of it or NULL if they could not
+ * be fetched.  Returns what is to be stored in v_args.
+ */
+static void *
+ds_capture_finish(struct tcb *tcp, const struct ds_capture_policy *policy,
+		  void *buf, size_t len, unsigned int index,
+		  void **common_fields)
+{
+	switch (policy->mode) {
+	case DS_CAPTURE_NONE:
+		common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] =
+			(void *) true;
+		return NULL;
+	case DS_CAPTURE_TRUNCATE:
+		if (len <= policy->limit)
+			break;
+		if (buf)
+			ds_store_prefix(tcp, buf, policy->limit, len, index,
+					common_fields);
+		return NULL;
+	case DS_CAPTURE_HASH:
+		if (buf)
+			ds_store_digest(tcp, buf, len, index, common_fields);
+		return NULL;
+	case DS_CAPTURE_FULL:
+		break;
+	}
+
+	return ds_dedup_payload(tcp, buf, len, index, common_fields);
+}
+
+/*
+ * Returns whether a payload of len bytes is too large to be copied
+ * from the tracee in one go and has to be streamed instead.
+ */
+static bool
+ds_must_stream(const struct ds_capture_policy *policy, size_t len)
+{
+	return ds_stream_limit && ds_capture_size(policy, len) > ds_stream_limit;
+}
+
+/*
+ * Copies the part of a len bytes long payload at addr that the policy
+ * asks for to the payload store, ds_stream_piece_size() bytes at a time,
+ * so that at most that much memory is used whatever len is.
+ * The piece buffer is shared by all tracees and kept out of the
+ * per-tcb arenas, which would otherwise each hold on to it.
+ * Always returns NULL, as nothing is left to store in v_args.
+ */
+static void *
+ds_stream_payload(struct tcb *tcp, const struct ds_capture_policy *policy,
+		  long addr, size_t len, unsigned int index,
+		  void **common_fields)
+{
+	static void *buf;
+	const size_t piece_size = ds_stream_piece_size();
+	const size_t size = ds_capture_size(policy, len);
+	size_t off, n;
+
+	if (!buf)
+		buf = xmalloc(piece_size);
+
+	ds_stream_begin(tcp, len, policy->mode == DS_CAPTURE_HASH, index,
+			common_fields);
+	for (off = 0; off < size; off += n) {
+		n = MIN(size - off, piece_size);
+		if (umoven(tcp, addr + off, n, buf) < 0)
+			break;
+		ds_stream_piece(tcp, buf, n);
+	}
+	ds_stream_end(off >= size);
+
+	return NULL;
+}
+
+/*
+ * Like ds_get_buffer, but for read and write payloads, which are
+ * subject to the --ds-capture policy of the syscall and, with
+ * --dataseries-dedup, are moved to the chunk store (see ds_dedup.c).
+ * Payloads larger than --dataseries-buffer-limit are streamed to
+ * the store.  index is the position of the payload in v_args.
+ */
+void *
+ds_get_payload(struct tcb *tcp, long addr, long len, unsigned int index,
+	       void **common_fields)
+{
+	const struct ds_capture_policy *policy = ds_capture_policy(tcp);
+	void *buf = NULL;
+
+	if (len < 0)
+		return NULL;
+
+	if (addr && ds_must_stream(policy, len))
+		return ds_stream_payload(tcp, policy, addr, len, index,
+					 common_fields);
+
+	if (policy->mode != DS_CAPTURE_NONE)
+		buf = ds_get_buffer(tcp, addr, ds_capture_size(policy, len));
+
+	return ds_capture_finish(tcp, policy, buf, len, index, common_fields);
+}
+
+/*
+ * Like ds_get_buffer, but for buffers whose length comes from the
+ * tracee: those larger than --dataseries-buffer-limit are streamed
+ * to the payload store as a whole rather than copied.
+ */
+void *
+ds_get_bounded_buffer(struct tcb *tcp, long addr, long len,
+		      unsigned int index, void **common_fields)
+{
+	static const struct ds_capture_policy full = { DS_CAPTURE_FULL, 0 };
+
+	if (addr && len > 0 && ds_must_stream(&full, len))
+		return ds_stream_payload(tcp, &full, addr, len, index,
+					 common_fields);
+
+	return ds_get_buffer(tcp, addr, len);
+}
+
 /*
  * This function retrieves the name string passed as an argument to
  * system call.  It internally calls umovestr() function which
@@ -1558,10 +1758,10 @@ ds_get_name(struct tcb *tcp, long addr)
 		goto out;
 
 	/*
-	 * Note: xmalloc succeeds always or aborts the trace process
-	 * with an error message to stderr.
+	 * Note: ds_arena_alloc succeeds always or aborts the trace
+	 * process with an error message to stderr.
 	 */
-	name = xmalloc(NAME_MAX + 1);
+	name = ds_arena_alloc(tcp, NAME_MAX + 1);
 
 	/*
 	 * Fetch one byte more to find out whether name length is
@@ -1572,87 +1772,173 @@ ds_get_name(struct tcb *tcp, long addr)
 		goto out_free;
 	else {
 		name[NAME_MAX] = '\0';
+		ds_arena_trim(tcp, name, strlen(name) + 1);
+		ds_note_arg(name, strlen(name) + 1);
 		goto out;
 	}
 out_free:
-	if (name) {
-		free(name);
-		name = NULL;
-	}
+	ds_arena_trim(tcp, name, 0);
+	name = NULL;
 out:
 	return name;
 }
 
 /**
- * ds_write_iov_records - iteratievly copies each iov record buffer
- * and then calls the ds_write_record() to write each record in
- * dataseries file.
+ * ds_write_iov_records - writes the first record of a syscall with
+ * an iovec, then copies the iov records and their buffers and calls
+ * ds_submit_into_same_record() to write a record for each of them.
  * @struct tcb: trace control block structure
  * @start_addr: start address of iov records buffer
  * @sys_call_name: system call name
  * @common_fields: common fields
- * @v_args: variable args
+ * @v_args: variable args, those of the first record on entry
  * @iovcnt: number of iov records
+ *
+ * The whole struct iovec array is fetched with a single read, and all
+ * the buffers it describes are gathered with umove_iovec(), so a wide
+ * vector costs a couple of process_vm_readv calls instead of two per
+ * element.  At most --dataseries-buffer-limit bytes of the buffers are
+ * gathered in all: the buffers past that are left out of the gather
+ * and streamed to the payload store instead.  Whether any is, and so
+ * whether the records need an explicit unique id, is known before the
+ * first record is written.
  */
 void
 ds_write_iov_records(struct tcb *tcp, const long start_addr,
 		     const char *sys_call_name, void **common_fields,
 		     void **v_args, size_t iovcnt)
 {
+	const struct ds_capture_policy *policy = ds_capture_policy(tcp);
 	size_t iov_number, rec;
-	struct iovec *iov_buf, *current = (struct iovec *) start_addr;
-	unsigned long iov[2];
+	struct iovec *iov_buf, *local;
+	bool *fetched, *streamed, *unreadable = NULL;
+	unsigned long iov_len;
+	size_t budget = ds_stream_limit ? ds_stream_limit : SIZE_MAX;
+	bool split = false;
 
 	if (!start_addr) {
+		ds_dedup_claim_id(tcp, common_fields, false);
+		ds_submit_record(sys_call_name, tcp->u_arg,
+				 common_fields, v_args);
 		goto out;
 	}
 
+	/*
+	 * The kernel rejects vectors longer than this,
+	 * so there is nothing to capture beyond it.
+	 */
+	if (iovcnt > IOV_MAX)
+		iovcnt = IOV_MAX;
+
+	iov_buf = ds_get_buffer(tcp, start_addr, iovcnt * sizeof(*iov_buf));
+	if (!iov_buf) {
+		/*
+		 * Part of the array is not readable, fall back to
+		 * fetching it element by element and skip the
+		 * elements that cannot be read.
+		 */
+		iov_buf = ds_arena_alloc(tcp, iovcnt * sizeof(*iov_buf));
+		unreadable = ds_arena_alloc(tcp, iovcnt * sizeof(*unreadable));
+		for (rec = 0; rec < iovcnt; ++rec) {
+			unreadable[rec] =
+				umove(tcp, start_addr + rec * sizeof(*iov_buf),
+				      &iov_buf[rec]) < 0;
+			if (unreadable[rec]) {
+				iov_buf[rec].iov_base = NULL;
+				iov_buf[rec].iov_len = 0;
+			}
+		}
+	}
+
+	local = ds_arena_alloc(tcp, iovcnt * sizeof(*local));
+	fetched = ds_arena_alloc(tcp, iovcnt * sizeof(*fetched));
+	streamed = ds_arena_alloc(tcp, iovcnt * sizeof(*streamed));
+	for (rec = 0; rec < iovcnt; ++rec) {
+		const size_t size = iov_buf[rec].iov_base
+			? ds_capture_size(policy, iov_buf[rec].iov_len) : 0;
+
+		streamed[rec] = size > budget;
+		if (streamed[rec]) {
+			split = true;
+			budget = 0;
+		} else {
+			budget -= size;
+		}
+		local[rec].iov_len = streamed[rec] ? 0 : size;
+		local[rec].iov_base = ds_arena_alloc(tcp, local[rec].iov_len);
+		fetched[rec] = false;
+	}
+
+	ds_dedup_claim_id(tcp, common_fields, split);
+	ds_submit_record(sys_call_name, tcp->u_arg, common_fields, v_args);
+
+	if (policy->mode != DS_CAPTURE_NONE) {
+		/*
+		 * umove_iovec() expects the remote lengths to match
+		 * the local ones, so pass it the truncated lengths,
+		 * and nothing for the buffers that are streamed.
+		 */
+		struct iovec *const remote =
+			ds_arena_alloc(tcp, iovcnt * sizeof(*remote));
+
+		for (rec = 0; rec < iovcnt; ++rec) {
+			remote[rec].iov_base = iov_buf[rec].iov_base;
+			remote[rec].iov_len = local[rec].iov_len;
+		}
+		umove_iovec(tcp, remote, local, iovcnt, fetched);
+	}
+
 	// Start iov_number with '0'.
 	iov_number = 0;
 
 	/*
-	 * Iteratively copy each buffer and add record to
-	 * dataseries file.
+	 * Add a record to dataseries file for each buffer.
 	 */
 	for (rec = 0; rec < iovcnt; ++rec) {
-		iov_buf = (struct iovec *) ds_get_buffer(tcp,
-				(const long)(current + rec),
-				sizeof(struct iovec));
-
-		if (iov_buf == NULL)
+		if (unreadable && unreadable[rec])
 			continue;
 
-		// Stores the address of buffer.
-		iov[0] = ((uintptr_t) iov_buf->iov_base);
 		// Stores the length of buffer.
-		iov[1] = ((uint64_t) iov_buf->iov_len);
+		iov_len = iov_buf[rec].iov_len;
 
 		/*
 		 * Save iov_number, length of buffer and buffer
 		 * to v_args.
 		 */
-		v_args[0] = &iov_number;
-		v_args[1] = &iov[1];
-		v_args[2] = ds_get_buffer(tcp, iov[0], iov[1]);
+		v_args[0] = DS_SCALAR_ARG(iov_number);
+		v_args[1] = DS_SCALAR_ARG(iov_len);
+		common_fields[DS_COMMON_FIELD_BUFFER_NOT_CAPTURED] =
+			(void *) false;
+		if (streamed[rec])
+			v_args[2] = ds_stream_payload(tcp, policy,
+						      (long) iov_buf[rec].iov_base,
+						      iov_len, iov_number,
+						      common_fields);
+		else
+			v_args[2] = ds_capture_finish(tcp, policy,
+						      fetched[rec]
+						      && iov_buf[rec].iov_base
+						      ? local[rec].iov_base
+						      : NULL,
+						      iov_len, iov_number,
+						      common_fields);
+		ds_note_arg(v_args[2], iov_len);
 
 		// Write each individual record.
-		ds_write_into_same_record(ds_module, sys_call_name, tcp->u_arg,
-					  common_fields, v_args);
+		ds_submit_into_same_record(sys_call_name, tcp->u_arg,
+					   common_fields, v_args);
 
 		// Increment the iov number.
 		iov_number++;
-
-		// Free the memory allocated.
-		if (iov_buf) {
-			free(iov_buf);
-			iov_buf = NULL;
-		}
-		if (v_args[2]) {
-			free(v_args[2]);
-			v_args[2] = NULL;
-		}
 	}
 
+	/*
+	 * Give the vector and its buffers back to the arena,
+	 * they are not needed past this point.
+	 */
+	ds_arena_trim(tcp, iov_buf, 0);
+	v_args[2] = NULL;
+
 out:
 	v_args[0] = NULL;
 	v_args[1] = NULL;
@@ -1701,7 +1987,7 @@ write_record:
 
 		// Increment the continuation number
 		*continuation_number += 1;
-		v_args[0] = continuation_number;
+		v_args[0] = DS_SCALAR_ARG(*continuation_number);
 
 		// Copies the argument/environment strings
 		v_args[1] = ds_get_path(tcp,
@@ -1713,14 +1999,13 @@ write_record:
 		 * denotes whether the record stores argument variable
 		 * or environment variable.
 		 */
-		v_args[2] = (void *) arg_env;
+		v_args[2] = ds_note_arg((void *) arg_env, strlen(arg_env) + 1);
 
 		// Write each individual record
-		ds_write_record(ds_module, "execve", tcp->u_arg,
-				common_fields, v_args);
+		ds_submit_record("execve", tcp->u_arg, common_fields, v_args);
 
 		if (v_args[1]) {
-			free(v_args[1]);
+			ds_arena_trim(tcp, v_args[1], 0);
 			v_args[1] = NULL;
 		}
 	}
@@ -58,6 +58,78 @@ xlat_bsearch_compare(const void *a, const void *b)
 	return (val1 > val2) ? 1 : (val1 < val2) ? -1 : 0;
 }
 
+/*
+ * Lookup index of a generated xlat table: an open addressing hash of its
+ * values.  The values are only known to the compiler, so the index is
+ * built on the first lookup in the table rather than by xlat/gen.sh,
+ * and kept for the lifetime of strace.
+ */
+struct xlat_index {
+	uint32_t *slots;	/* 1 + index of an entry, 0 if free */
+	uint32_t mask;		/* number of slots - 1 */
+	unsigned int shift;	/* 64 - log2 of the number of slots */
+};
+
+/* Smaller tables are scanned as fast as they are hashed. */
+#define XLAT_INDEX_MIN_SIZE 8
+
+static inline size_t
+xlat_hash(const struct xlat_index *const ix, const uint64_t val)
+{
+	return (val * 0x9e3779b97f4a7c15ULL) >> ix->shift;
+}
+
+static struct xlat_index *
+build_xlat_index(const struct xlat *const x)
+{
+	struct xlat_index *const ix = xmalloc(sizeof(*ix));
+	unsigned int bits = 1;
+
+	while ((1U << bits) < 2 * x->size)
+		++bits;
+	ix->shift = 64 - bits;
+	ix->mask = (1U << bits) - 1;
+	ix->slots = xcalloc(1U << bits, sizeof(*ix->slots));
+
+	/* Only the first entry of a value is found, as by a linear scan. */
+	for (uint32_t i = 0; i < x->size; ++i) {
+		size_t h = xlat_hash(ix, x->data[i].val);
+
+		for (; ix->slots[h]; h = (h + 1) & ix->mask)
+			if (x->data[ix->slots[h] - 1].val == x->data[i].val)
+				break;
+		if (!ix->slots[h])
+			ix->slots[h] = i + 1;
+	}
+
+	return ix;
+}
+
+static const struct xlat_index *
+get_xlat_index(const struct xlat *const x)
+{
+	if (!x->index || x->size < XLAT_INDEX_MIN_SIZE)
+		return NULL;
+
+	if (!*x->index)
+		*x->index = build_xlat_index(x);
+
+	return *x->index;
+}
+
+/* Returns the index of the first entry of x with the value val, or -1. */
+static ssize_t
+xlat_index_find(const struct xlat *const x, const struct xlat_index *const ix,
+		const uint64_t val)
+{
+	for (size_t h = xlat_hash(ix, val); ix->slots[h];
+	     h = (h + 1) & ix->mask)
+		if (x->data[ix->slots[h] - 1].val == val)
+			return ix->slots[h] - 1;
+
+	return -1;
+}
+
 const char *
 xlookup(const struct xlat *xlat, const uint64_t val)
 {
@@ -73,6 +145,27 @@ xlookup(const struct xlat *xlat, const uint64_t val)
 	if (!x || !x->data)
 		return NULL;
 
+	/*
+	 * A new lookup in a table that has an index starts at the first
+	 * entry with the value, so that a continued one goes on from there
+	 * as usual.
+	 */
+	const struct xlat_index *const ix =
+		xlat && x->type != XT_INDEXED ? get_xlat_index(x) : NULL;
+
+	if (ix) {
+		const ssize_t i = xlat_index_find(x, ix, val);
+
+		if (i < 0) {
+			/* Where a failed scan ends, a failed bsearch does not. */
+			if (x->type == XT_NORMAL)
+				idx = x->size;
+			return NULL;
+		}
+		idx = i;
+		return x->data[idx].str;
+	}
+
 	switch (x->type) {
 	case XT_NORMAL:
 		for (; idx < x->size; idx++)
@@ -53,10 +53,18 @@ struct xlat_data {
 	const char *str;
 };
 
+struct xlat_index;
+
 struct xlat {
 	const struct xlat_data *data;
 	uint32_t size;
 	enum xlat_type type;
+	/**
+	 * Slot for the lookup index of the table, built by xlat.c on first
+	 * use.  Set by xlat/gen.sh for the generated tables, NULL for the
+	 * other ones, which are always searched as described by type.
+	 */
+	struct xlat_index **index;
 };
 
 # define XLAT(val)			{ (unsigned)(val), #val }
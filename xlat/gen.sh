@@ -247,6 +247,7 @@ gen_header()
 		esac
 	done < "${input}"
 	echo '};'
+	echo "static struct xlat_index *${name}_index;"
 
 	if [ -n "$in_defs" ]; then
 		:
@@ -267,6 +268,7 @@ gen_header()
 			 .data = ${name}_xdata,
 			 .size = ARRAY_SIZE(${name}_xdata),
 			 .type = ${xlat_type},
+			 .index = &${name}_index,
 		} };
 
 		# endif /* !IN_MPERS */